@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_AB_H_)
+#define _AB_H_
+
+#include <hardware/flash.h>
+#include <pico/stdlib.h>
+#include <stddef.h>
+
+/*
+ * Flash layout of the firmware self-update with two slots (build option
+ * USBLINK_AB_UPDATE), shared by the boot selector and the firmware
+ * (ab_update.c), so no usb or rpc headers here.
+ *
+ *   0         boot selector (boot/ab_boot.c, with the boot2 of the flash)
+ *   slot 0    firmware linked for this slot
+ *   slot 1    firmware linked for this slot
+ *   state     2 sectors behind slot 1, below the esc image store
+ *
+ * The running firmware takes a new image for the other slot over rpc while
+ * the bridge is idle, checks its crc32 and marks it as trial in the state.
+ * The selector boots a trial once, a reset before the trial firmware has
+ * confirmed itself boots the active slot again (rollback). The trial is
+ * confirmed by the firmware when usb is mounted and the main loop ran for
+ * AB_CONFIRM_MS.
+ *
+ * The state is a ring of one page records like the configuration, the newest
+ * valid record counts. The selector only reads it, the try is noted in a
+ * watchdog scratch register, which survives the watchdog and soft resets but
+ * not a power cycle.
+ */
+
+#ifndef USBLINK_AB_UPDATE
+#define USBLINK_AB_UPDATE 0
+#endif
+
+/*! @brief Flash for the boot selector
+ */
+#ifndef AB_BOOT_SIZE
+#define AB_BOOT_SIZE (32 * 1024)
+#endif
+
+/*! @brief Flash per firmware slot
+ */
+#ifndef AB_SLOT_SIZE
+#define AB_SLOT_SIZE (848 * 1024)
+#endif
+
+/*! @brief Healthy run of a trial firmware before it is made the active one
+ */
+#ifndef AB_CONFIRM_MS
+#define AB_CONFIRM_MS 5000
+#endif
+
+/*! @brief Watchdog the selector starts for a trial, until the firmware sets its own
+ */
+#ifndef AB_TRIAL_WATCHDOG_MS
+#define AB_TRIAL_WATCHDOG_MS 4000
+#endif
+
+#define AB_SLOTS 2
+#define AB_NONE 0xff
+#define AB_SLOT_OFFSET(slot) (AB_BOOT_SIZE + (slot) * AB_SLOT_SIZE)
+// the vector table follows the boot2 copy at the start of a slot
+#define AB_VECTOR_OFFSET 0x100
+
+#define AB_STATE_SECTORS 2
+#define AB_STATE_OFFSET AB_SLOT_OFFSET(AB_SLOTS)
+#define AB_STATE_PAGES (AB_STATE_SECTORS * FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define AB_STATE_MAGIC 0x42415355 /* "USAB" */
+
+// watchdog scratch register of the selector, values with the seq of the state
+#define AB_SCRATCH 0
+#define AB_SCRATCH_TRIAL(seq) (0xab100000 | ((seq) & 0xffff))
+#define AB_SCRATCH_ROLLBACK(seq) (0xab200000 | ((seq) & 0xffff))
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint8_t active;             // slot booted when no trial is pending
+    uint8_t trial;              // slot booted once, AB_NONE
+    uint8_t reserved[2];
+    uint32_t img_size[AB_SLOTS];// image size, 0 for an empty slot
+    uint32_t img_crc[AB_SLOTS]; // crc32 of the image
+    uint32_t crc;               // of the fields above
+} ab_state_t;
+
+// CRC-32 (zlib) without the dma, the selector has no driver for it
+static inline uint32_t ab_crc32(const uint8_t *data, uint32_t len)
+{
+    uint32_t crc = 0xffffffff;
+
+    while (len--)
+    {
+        crc ^= *data++;
+        for (uint32_t i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static inline const ab_state_t *ab_state_page(uint32_t page)
+{
+    return (const ab_state_t *)(XIP_BASE + AB_STATE_OFFSET + page * FLASH_PAGE_SIZE);
+}
+
+static inline bool ab_state_valid(const ab_state_t *st)
+{
+    return st->magic == AB_STATE_MAGIC && st->active < AB_SLOTS &&
+           ab_crc32((const uint8_t *)st, offsetof(ab_state_t, crc)) == st->crc;
+}
+
+// page of the newest valid record, -1 if there is none
+static inline int ab_state_find(void)
+{
+    int newest = -1;
+
+    for (uint32_t page = 0; page < AB_STATE_PAGES; page++)
+    {
+        const ab_state_t *st = ab_state_page(page);
+
+        if (ab_state_valid(st) && (newest < 0 || (int32_t)(st->seq - ab_state_page(newest)->seq) > 0))
+            newest = page;
+    }
+    return newest;
+}
+
+// stack pointer in ram and reset handler in the slot
+static inline bool ab_slot_bootable(uint slot)
+{
+    const uint32_t *vt = (const uint32_t *)(XIP_BASE + AB_SLOT_OFFSET(slot) + AB_VECTOR_OFFSET);
+
+    return vt[0] > SRAM_BASE && vt[0] <= SRAM_END &&
+           vt[1] > XIP_BASE + AB_SLOT_OFFSET(slot) && vt[1] < XIP_BASE + AB_SLOT_OFFSET(slot + 1);
+}
+
+#endif /* _AB_H_ */
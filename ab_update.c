@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/flash.h>
+#include <hardware/watchdog.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "ab_update.h"
+#include "cfg.h"
+#include "esc_boot.h"
+#include "tlog.h"
+#include "uart_bridge.h"
+
+#if USBLINK_AB_UPDATE
+
+#if AB_STATE_OFFSET + AB_STATE_SECTORS * FLASH_SECTOR_SIZE > ESC_IMG_FLASH_OFFSET
+#error "firmware slots overlap the esc image store"
+#endif
+
+#if !defined(MIN)
+#define MIN(a, b) ((a > b) ? b : a)
+#endif /* MIN */
+
+// time for the response of the switch command before the restart
+#define AB_REBOOT_DELAY_US 100000
+
+static struct
+{
+    ab_state_t st;   // newest record, ab_state_write() stores changes
+    int page;        // of the newest record, -1 none
+    uint8_t running;
+    bool trial;      // the running firmware is not confirmed yet
+    bool rolled_back;// the trial of the other slot failed
+    bool dirty;
+    bool reboot;
+    uint32_t reboot_at;
+    // upload into the other slot
+    bool upload;
+    uint32_t size;
+    uint32_t pos;
+    uint8_t page_buf[FLASH_PAGE_SIZE];
+} ab = {.page = -1};
+
+// first byte of this firmware in the flash, from the linker script
+extern char __flash_binary_start;
+
+static uint8_t ab_other(void)
+{
+    return ab.running ^ 1;
+}
+
+static void ab_state_write(void)
+{
+    uint8_t page[FLASH_PAGE_SIZE];
+    uint32_t next = (ab.page + 1) % AB_STATE_PAGES;
+    uint32_t offset = AB_STATE_OFFSET + next * FLASH_PAGE_SIZE;
+
+    ab.st.seq++;
+    ab.st.crc = ab_crc32((const uint8_t *)&ab.st, offsetof(ab_state_t, crc));
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &ab.st, sizeof(ab.st));
+    // the newest record stays in the other sector until this one is written
+    if ((offset % FLASH_SECTOR_SIZE) == 0)
+        cfg_flash_erase(offset, FLASH_SECTOR_SIZE);
+    cfg_flash_program(offset, page, FLASH_PAGE_SIZE);
+    ab.page = next;
+    ab.dirty = false;
+}
+
+// before core 1 runs, flash writes are left to ab_task()
+void ab_init(void)
+{
+    uint32_t scratch = watchdog_hw->scratch[AB_SCRATCH];
+
+    // not from the vtor, the runtime moves the vector table into ram
+    ab.running = ((uintptr_t)&__flash_binary_start - XIP_BASE - AB_BOOT_SIZE) / AB_SLOT_SIZE;
+    ab.page = ab_state_find();
+    if (ab.page >= 0)
+    {
+        ab.st = *ab_state_page(ab.page);
+    }
+    else
+    {
+        // first start after the installation
+        memset(&ab.st, 0, sizeof(ab.st));
+        ab.st.magic = AB_STATE_MAGIC;
+        ab.st.active = ab.running;
+        ab.st.trial = AB_NONE;
+        ab.dirty = true;
+    }
+
+    if (ab.st.trial == ab.running && scratch == AB_SCRATCH_TRIAL(ab.st.seq))
+    {
+        ab.trial = true;
+        TLOG(ab_trial, ab.running);
+        return;
+    }
+    if (ab.st.trial != AB_NONE)
+    {
+        // the selector went back to the active slot
+        TLOG(ab_rollback, ab.st.trial, ab.running);
+        ab.rolled_back = true;
+        ab.st.trial = AB_NONE;
+        ab.dirty = true;
+        watchdog_hw->scratch[AB_SCRATCH] = 0;
+    }
+    if (ab.st.active != ab.running)
+    {
+        // the selector fell back to this slot, the active one does not start
+        ab.st.active = ab.running;
+        ab.dirty = true;
+    }
+}
+
+// core 0 main loop, true when the restart into the selector is due
+bool ab_task(void)
+{
+    if (ab.trial && tud_mounted() && time_us_64() >= AB_CONFIRM_MS * 1000ull)
+    {
+        ab.trial = false;
+        ab.st.active = ab.running;
+        ab.st.trial = AB_NONE;
+        ab.dirty = true;
+        watchdog_hw->scratch[AB_SCRATCH] = 0;
+        TLOG(ab_confirm, ab.running);
+    }
+    if (ab.dirty)
+        ab_state_write();
+    return ab.reboot && (int32_t)(time_us_32() - ab.reboot_at) >= 0;
+}
+
+// running u8, active u8, trial u8 (0xff none), flags u8 (1 running a trial,
+// 2 rolled back, 4 upload open), slot size u32, per slot: size u32, crc u32
+static uint8_t rpc_ab_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 24))
+        return RPC_ERR_NOSPACE;
+    *p++ = ab.running;
+    *p++ = ab.st.active;
+    *p++ = ab.st.trial;
+    *p++ = ab.trial | (ab.rolled_back << 1) | (ab.upload << 2);
+    p = rpc_put_u32(p, AB_SLOT_SIZE);
+    for (uint32_t slot = 0; slot < AB_SLOTS; slot++)
+    {
+        p = rpc_put_u32(p, ab.st.img_size[slot]);
+        p = rpc_put_u32(p, ab.st.img_crc[slot]);
+    }
+    return RPC_OK;
+}
+
+// size u32, into the slot that is not running; not while a trial runs, the other slot is the way back
+static uint8_t rpc_ab_begin(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint32_t size;
+
+    if (arg_len != 4)
+        return RPC_ERR_ARGS;
+    size = rpc_get_u32(arg);
+    if (size == 0 || size > AB_SLOT_SIZE)
+        return RPC_ERR_RANGE;
+    if (ab.trial || ab.reboot || !uart_bridge_idle())
+        return RPC_ERR_STATE;
+
+    ab.upload = true;
+    ab.size = size;
+    ab.pos = 0;
+    // the old image is invalid from here on
+    if (ab.st.img_size[ab_other()])
+    {
+        ab.st.img_size[ab_other()] = 0;
+        ab.st.img_crc[ab_other()] = 0;
+        ab_state_write();
+    }
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// offset u32, data; in order, a sector is erased when the first page of it is written,
+// refused while the console is open or the bridge has data
+static uint8_t rpc_ab_write(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    const uint8_t *data = &arg[4];
+    uint32_t len;
+
+    if (arg_len < 4)
+        return RPC_ERR_ARGS;
+    len = arg_len - 4;
+    if (!ab.upload || rpc_get_u32(arg) != ab.pos || len > ab.size - ab.pos || !uart_bridge_idle())
+        return RPC_ERR_STATE;
+
+    while (len)
+    {
+        uint32_t fill = ab.pos % FLASH_PAGE_SIZE;
+        uint32_t n = MIN(len, FLASH_PAGE_SIZE - fill);
+
+        memcpy(&ab.page_buf[fill], data, n);
+        ab.pos += n;
+        data += n;
+        len -= n;
+
+        if ((ab.pos % FLASH_PAGE_SIZE) == 0 || ab.pos == ab.size)
+        {
+            uint32_t page = (ab.pos - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE;
+            uint32_t flash = AB_SLOT_OFFSET(ab_other()) + page;
+
+            if (ab.pos % FLASH_PAGE_SIZE)
+                memset(&ab.page_buf[ab.pos % FLASH_PAGE_SIZE], 0xff, FLASH_PAGE_SIZE - ab.pos % FLASH_PAGE_SIZE);
+            if ((page % FLASH_SECTOR_SIZE) == 0)
+            {
+                // the whole watchdog period for a slow erase
+                watchdog_update();
+                cfg_flash_erase(flash, FLASH_SECTOR_SIZE);
+            }
+            cfg_flash_program(flash, ab.page_buf, FLASH_PAGE_SIZE);
+        }
+    }
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// crc32 u32 of the image, the image must be linked for the slot
+static uint8_t rpc_ab_end(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint32_t crc;
+
+    if (arg_len != 4)
+        return RPC_ERR_ARGS;
+    if (!ab.upload || ab.pos != ab.size)
+        return RPC_ERR_STATE;
+    ab.upload = false;
+
+    crc = rpc_get_u32(arg);
+    if (cfg_crc32((const uint8_t *)(XIP_BASE + AB_SLOT_OFFSET(ab_other())), ab.size) != crc)
+        return RPC_ERR_CRC;
+    if (!ab_slot_bootable(ab_other()))
+        return RPC_ERR_RANGE;
+    ab.st.img_size[ab_other()] = ab.size;
+    ab.st.img_crc[ab_other()] = crc;
+    ab_state_write();
+    TLOG(ab_image, ab_other(), ab.size);
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// the restart is done in the main loop after the response is sent
+static uint8_t rpc_ab_switch(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (ab.trial || ab.upload || ab.reboot || ab.st.img_size[ab_other()] == 0 || !ab_slot_bootable(ab_other()))
+        return RPC_ERR_STATE;
+
+    ab.st.trial = ab_other();
+    ab_state_write();
+    TLOG(ab_switch, ab.st.trial);
+    ab.reboot = true;
+    ab.reboot_at = time_us_32() + AB_REBOOT_DELAY_US;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_ab_cmds[] = {
+    {RPC_OP_AB_STATUS, rpc_ab_status},
+    {RPC_OP_AB_BEGIN, rpc_ab_begin},
+    {RPC_OP_AB_WRITE, rpc_ab_write},
+    {RPC_OP_AB_END, rpc_ab_end},
+    {RPC_OP_AB_SWITCH, rpc_ab_switch},
+};
+const uint32_t rpc_ab_cmds_count = count_of(rpc_ab_cmds);
+
+#endif /* USBLINK_AB_UPDATE */
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_AB_UPDATE_H_)
+#define _AB_UPDATE_H_
+
+#include <tusb.h>
+
+#include "ab.h"
+#include "rpc.h"
+
+/*
+ * Firmware side of the A/B update (layout in ab.h). The image for the slot
+ * that is not running is uploaded like an esc image, page by page from the
+ * rpc task. A sector erase holds core 1 and the interrupts for typically
+ * 45ms, up to some 400ms, usb and the uart rx stop meanwhile, so the upload
+ * is refused while the console is open or the bridge has data
+ * (uart_bridge_idle). Keeping them alive would need tinyusb, the sdk code it
+ * calls and the uart interrupt in ram, a copy_to_ram build does not fit
+ * next to the wireless firmware. After the
+ * switch command the firmware restarts into the selector, which boots the
+ * trial.
+ */
+
+void ab_init(void);
+bool ab_task(void);
+
+extern const rpc_cmd_t rpc_ab_cmds[];
+extern const uint32_t rpc_ab_cmds_count;
+
+#endif /* _AB_UPDATE_H_ */
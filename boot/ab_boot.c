@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/structs/scb.h>
+#include <hardware/watchdog.h>
+#include <pico/bootrom.h>
+#include <pico/stdlib.h>
+
+#include "ab.h"
+
+/*
+ * Boot selector of the A/B update, linked to the start of the flash in place
+ * of the firmware. It reads the update state and starts the firmware of the
+ * active slot, or once the trial slot. Nothing is written to the flash.
+ */
+
+static void __attribute__((noreturn)) ab_start(uint slot)
+{
+    uint32_t vtor = XIP_BASE + AB_SLOT_OFFSET(slot) + AB_VECTOR_OFFSET;
+    const uint32_t *vt = (const uint32_t *)vtor;
+
+    scb_hw->vtor = vtor;
+    __asm volatile(
+        "msr msp, %0\n"
+        "bx %1\n"
+        :
+        : "r"(vt[0]), "r"(vt[1]));
+    __builtin_unreachable();
+}
+
+int main(void)
+{
+    int page = ab_state_find();
+    const ab_state_t *st = (page >= 0) ? ab_state_page(page) : NULL;
+    io_rw_32 *scratch = &watchdog_hw->scratch[AB_SCRATCH];
+    uint slot = st ? st->active : 0;
+
+    if (st && st->trial < AB_SLOTS)
+    {
+        if (*scratch == AB_SCRATCH_TRIAL(st->seq))
+        {
+            // reset while the trial ran, before it was confirmed
+            *scratch = AB_SCRATCH_ROLLBACK(st->seq);
+        }
+        else if (*scratch != AB_SCRATCH_ROLLBACK(st->seq) && ab_slot_bootable(st->trial))
+        {
+            *scratch = AB_SCRATCH_TRIAL(st->seq);
+            slot = st->trial;
+            // also a firmware that hangs before it starts its own watchdog;
+            // watchdog_enable() marks scratch 4, the firmware would take the
+            // switch for a watchdog reset (post-mortem, reboot blink)
+            uint32_t reboot_mark = watchdog_hw->scratch[4];
+            watchdog_enable(AB_TRIAL_WATCHDOG_MS, true);
+            watchdog_hw->scratch[4] = reboot_mark;
+        }
+    }
+    if (!ab_slot_bootable(slot))
+        slot ^= 1;
+    if (!ab_slot_bootable(slot))
+    {
+        // no firmware installed, wait for a uf2 copy
+        reset_usb_boot(0, 0);
+    }
+    ab_start(slot);
+}
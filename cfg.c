@@ -0,0 +1,372 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <assert.h>
+#include <hardware/dma.h>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <pico/multicore.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "esc_boot.h"
+#include "rc.h"
+#include "uart_bridge.h"
+#include "user_gpio.h"
+
+#define CFG_MAGIC 0x47464355 /* "UCFG" */
+#define CFG_ERASED 0xffffffff
+#define CFG_PAGES (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+#define CFG_MAX_PAIRS ((FLASH_PAGE_SIZE - sizeof(cfg_header_t)) / sizeof(cfg_pair_t))
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t crc;// over the rest of the header and the pairs
+    uint32_t seq;
+    uint16_t count;
+    uint16_t reserved;
+} cfg_header_t;
+
+typedef struct
+{
+    uint16_t key;
+    uint16_t reserved;
+    uint32_t value;
+} cfg_pair_t;
+
+typedef struct
+{
+    uint32_t def;
+    uint32_t min;
+    uint32_t max;
+} cfg_limits_t;
+
+// all keys go into the one page of a record
+static_assert(CFG_COUNT <= CFG_MAX_PAIRS, "too many configuration keys for one record");
+
+static const cfg_limits_t cfg_limits[CFG_COUNT] = {
+    [CFG_BOOT_MODE] = {opmode_undev, opmode_undev, opmode_relay},
+    [CFG_UART_BAUD] = {DEF_BIT_RATE, 1200, 3000000},
+    [CFG_SERVO_MIN_US] = {1000, 500, 2500},
+    [CFG_SERVO_MAX_US] = {2000, 500, 2500},
+    [CFG_SERVO_PROFILE] = {RC_PROTO_PWM, 0, RC_PROTO_COUNT - 1},
+    [CFG_RC_MIN_US] = {750, 100, 3000},
+    [CFG_RC_MAX_US] = {2250, 100, 3000},
+    [CFG_RECV_UPDATE_MS] = {100, 10, 10000},
+    [CFG_SERVO_UPDATE_MS] = {200, 10, 10000},
+    [CFG_MSG_UPDATE_MS] = {1000, 100, 60000},
+    [CFG_ESC_IMAGE] = {0, 0, ESC_IMG_SLOTS - 1},
+    [CFG_ESC_FLASH_DIFF] = {0, 0, 1},
+    [CFG_ESC_LINE_CTRL] = {0, 0, 1},
+    [CFG_RELAY_IN_PIN] = {RELAY_IN_PIN, 0, 22},
+    [CFG_RELAY_PROFILE] = {RC_PROTO_PWM, 0, RC_PROTO_COUNT - 1},
+    [CFG_RELAY_RATE] = {100, 0, 200},
+    [CFG_RELAY_EXPO] = {0, 0, 100},
+    [CFG_RELAY_MIN_US] = {1000, 500, 2500},
+    [CFG_RELAY_MAX_US] = {2000, 500, 2500},
+    [CFG_RELAY_FAILSAFE_US] = {0, 0, 2500},
+    [CFG_RELAY_TIMEOUT_MS] = {100, 20, 5000},
+    [CFG_BRIDGE_FLUSH_US] = {0, 0, 10000},
+};
+
+// ranges, the first key must stay below the second
+static const cfg_key cfg_ranges[][2] = {
+    {CFG_SERVO_MIN_US, CFG_SERVO_MAX_US},
+    {CFG_RC_MIN_US, CFG_RC_MAX_US},
+    {CFG_RELAY_MIN_US, CFG_RELAY_MAX_US},
+};
+
+static uint32_t cfg_values[CFG_COUNT];
+static bool cfg_dirty;
+static uint32_t cfg_seq;
+// position of the next record
+static uint32_t cfg_next_sector;
+static uint32_t cfg_next_page;
+
+static uint8_t cfg_page_buf[FLASH_PAGE_SIZE];
+
+// CRC-32 (zlib) bit by bit, while all dma channels are taken
+static uint32_t cfg_crc32_sw(const uint8_t *data, uint32_t len)
+{
+    uint32_t crc = 0xffffffff;
+
+    while (len--)
+    {
+        crc ^= *data++;
+        for (uint32_t i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+// CRC-32 (zlib) by the dma sniffer, the bytes are copied into a dummy word
+uint32_t cfg_crc32(const uint8_t *data, uint32_t len)
+{
+    static uint32_t dummy;
+    dma_channel_config c;
+    int chan;
+    uint32_t crc;
+
+    if (len == 0)
+        return 0;
+
+    // the logic analyser and the playback hold channels too
+    chan = dma_claim_unused_channel(false);
+    if (chan < 0)
+        return cfg_crc32_sw(data, len);
+    c = dma_channel_get_default_config(chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_sniff_enable(&c, true);
+
+    // bit reversed input and output plus final inversion give the reflected crc,
+    // enable first, it rewrites the whole sniffer control
+    dma_sniffer_enable(chan, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    dma_sniffer_set_output_reverse_enabled(true);
+    dma_sniffer_set_output_invert_enabled(true);
+    dma_sniffer_set_data_accumulator(0xffffffff);
+
+    dma_channel_configure(chan, &c, &dummy, data, len, true);
+    dma_channel_wait_for_finish_blocking(chan);
+    crc = dma_sniffer_get_data_accumulator();
+
+    dma_sniffer_disable();
+    dma_channel_unclaim(chan);
+    return crc;
+}
+
+// flash writes, core 1 is held and interrupts are off meanwhile
+void cfg_flash_erase(uint32_t offset, uint32_t len)
+{
+    uint32_t irq_status;
+
+    multicore_lockout_start_blocking();
+    irq_status = save_and_disable_interrupts();
+    flash_range_erase(offset, len);
+    restore_interrupts(irq_status);
+    multicore_lockout_end_blocking();
+}
+
+void cfg_flash_program(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    uint32_t irq_status;
+
+    multicore_lockout_start_blocking();
+    irq_status = save_and_disable_interrupts();
+    flash_range_program(offset, data, len);
+    restore_interrupts(irq_status);
+    multicore_lockout_end_blocking();
+}
+
+// value with the other end of its range, true if the range is not inverted
+static bool cfg_range_ok(cfg_key key, uint32_t value)
+{
+    for (uint32_t i = 0; i < count_of(cfg_ranges); i++)
+    {
+        if (key == cfg_ranges[i][0] && value >= cfg_values[cfg_ranges[i][1]])
+            return false;
+        if (key == cfg_ranges[i][1] && value <= cfg_values[cfg_ranges[i][0]])
+            return false;
+    }
+    return true;
+}
+
+// inverted ranges from a record back to the defaults
+static void cfg_check_ranges(void)
+{
+    for (uint32_t i = 0; i < count_of(cfg_ranges); i++)
+    {
+        cfg_key lo = cfg_ranges[i][0];
+        cfg_key hi = cfg_ranges[i][1];
+
+        if (cfg_values[lo] >= cfg_values[hi])
+        {
+            cfg_values[lo] = cfg_limits[lo].def;
+            cfg_values[hi] = cfg_limits[hi].def;
+            cfg_dirty = true;
+        }
+    }
+}
+
+static const cfg_header_t *cfg_page(uint32_t sector, uint32_t page)
+{
+    return (const cfg_header_t *)(XIP_BASE + CFG_FLASH_OFFSET + sector * FLASH_SECTOR_SIZE + page * FLASH_PAGE_SIZE);
+}
+
+static bool cfg_page_valid(const cfg_header_t *hdr)
+{
+    if (hdr->magic != CFG_MAGIC || hdr->count > CFG_MAX_PAIRS)
+        return false;
+    return cfg_crc32((const uint8_t *)&hdr->seq, 8 + hdr->count * sizeof(cfg_pair_t)) == hdr->crc;
+}
+
+static void cfg_load_page(const cfg_header_t *hdr)
+{
+    const cfg_pair_t *pair = (const cfg_pair_t *)(hdr + 1);
+
+    // keys unknown to this firmware are skipped, missing ones keep the default;
+    // the ranges are checked when all values are in
+    for (uint32_t i = 0; i < hdr->count; i++)
+    {
+        uint32_t key = pair[i].key;
+
+        if (key < CFG_COUNT && pair[i].value >= cfg_limits[key].min && pair[i].value <= cfg_limits[key].max)
+        {
+            cfg_values[key] = pair[i].value;
+        }
+    }
+    cfg_seq = hdr->seq;
+}
+
+void cfg_init(void)
+{
+    uint32_t order[CFG_SECTORS];
+    uint32_t count = 0;
+
+    cfg_reset();
+    cfg_seq = 0;
+    cfg_next_sector = 0;
+    cfg_next_page = 0;
+
+    // sectors with a valid first record, newest first
+    for (uint32_t s = 0; s < CFG_SECTORS; s++)
+    {
+        const cfg_header_t *hdr = cfg_page(s, 0);
+        uint32_t k;
+
+        if (!cfg_page_valid(hdr))
+            continue;
+        for (k = count; k > 0 && cfg_page(order[k - 1], 0)->seq < hdr->seq; k--)
+        {
+            order[k] = order[k - 1];
+        }
+        order[k] = s;
+        count++;
+    }
+
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t s = order[n];
+        uint32_t lo = 0;
+        uint32_t hi = CFG_PAGES - 1;
+
+        // records are written in page order, find the last used page
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi + 1) / 2;
+            if (cfg_page(s, mid)->magic != CFG_ERASED)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+
+        // the next record goes behind the last used page, also if that one is torn
+        if (n == 0)
+        {
+            cfg_next_sector = (lo + 1 < CFG_PAGES) ? s : (s + 1) % CFG_SECTORS;
+            cfg_next_page = (lo + 1 < CFG_PAGES) ? lo + 1 : 0;
+        }
+
+        for (int32_t p = lo; p >= 0; p--)
+        {
+            if (cfg_page_valid(cfg_page(s, p)))
+            {
+                cfg_load_page(cfg_page(s, p));
+                cfg_dirty = false;
+                cfg_check_ranges();
+                return;
+            }
+        }
+    }
+}
+
+uint32_t cfg_get(cfg_key key)
+{
+    if (key >= CFG_COUNT)
+        return 0;
+    return cfg_values[key];
+}
+
+bool cfg_set(cfg_key key, uint32_t value)
+{
+    if (key >= CFG_COUNT || value < cfg_limits[key].min || value > cfg_limits[key].max)
+        return false;
+    if (!cfg_range_ok(key, value))
+        return false;
+    if (cfg_values[key] != value)
+    {
+        cfg_values[key] = value;
+        cfg_dirty = true;
+    }
+    return true;
+}
+
+// back to the defaults, the flash is not changed before the next commit
+void cfg_reset(void)
+{
+    for (uint32_t i = 0; i < CFG_COUNT; i++)
+    {
+        cfg_values[i] = cfg_limits[i].def;
+    }
+    cfg_dirty = true;
+}
+
+bool cfg_is_dirty(void)
+{
+    return cfg_dirty;
+}
+
+uint32_t cfg_get_seq(void)
+{
+    return cfg_seq;
+}
+
+// write a snapshot of all values, core 1 is held and interrupts are off meanwhile
+bool cfg_commit(void)
+{
+    cfg_header_t *hdr = (cfg_header_t *)cfg_page_buf;
+    cfg_pair_t *pair = (cfg_pair_t *)(hdr + 1);
+    uint32_t offset = CFG_FLASH_OFFSET + cfg_next_sector * FLASH_SECTOR_SIZE + cfg_next_page * FLASH_PAGE_SIZE;
+    if (!cfg_dirty)
+        return true;
+
+    cfg_check_ranges();
+    memset(cfg_page_buf, 0xff, sizeof(cfg_page_buf));
+    for (uint32_t i = 0; i < CFG_COUNT; i++)
+    {
+        pair[i].key = i;
+        pair[i].reserved = 0;
+        pair[i].value = cfg_values[i];
+    }
+    hdr->magic = CFG_MAGIC;
+    hdr->seq = cfg_seq + 1;
+    hdr->count = CFG_COUNT;
+    hdr->reserved = 0;
+    hdr->crc = cfg_crc32((const uint8_t *)&hdr->seq, 8 + CFG_COUNT * sizeof(cfg_pair_t));
+
+    // a new sector is erased right before its first record, the previous sector stays intact
+    if (cfg_next_page == 0)
+    {
+        cfg_flash_erase(offset, FLASH_SECTOR_SIZE);
+    }
+    cfg_flash_program(offset, cfg_page_buf, FLASH_PAGE_SIZE);
+
+    if (++cfg_next_page == CFG_PAGES)
+    {
+        cfg_next_page = 0;
+        cfg_next_sector = (cfg_next_sector + 1) % CFG_SECTORS;
+    }
+
+    cfg_seq = hdr->seq;
+    if (memcmp((const void *)(XIP_BASE + offset), cfg_page_buf, FLASH_PAGE_SIZE) != 0)
+        return false;
+
+    cfg_dirty = false;
+    return true;
+}
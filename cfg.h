@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_CFG_H_)
+#define _CFG_H_
+
+#include <hardware/flash.h>
+#include <tusb.h>
+
+/*
+ * Persistent configuration in the last sectors of the flash.
+ *
+ * Every commit writes a snapshot of all values as one 256 byte page record
+ * (header plus key/value pairs) behind the last one, the sectors are used
+ * as a ring, which spreads the erase cycles over the whole area. A record
+ * that was torn by a power loss fails its crc and the previous one is used.
+ * Loading reads the first page of each sector and does a binary search in
+ * the newest one, so the boot time does not depend on the number of commits.
+ */
+
+// flash area, must not overlap the program
+#define CFG_SECTORS 4
+#define CFG_FLASH_SIZE (CFG_SECTORS * FLASH_SECTOR_SIZE)
+#define CFG_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - CFG_FLASH_SIZE)
+
+typedef enum
+{
+    CFG_BOOT_MODE,       // 0 button selection, else opmode to start when the button is not pressed
+    CFG_UART_BAUD,       // one-wire bit rate until the host sets one
+    CFG_SERVO_MIN_US,    // pulse range of the pwm profiles
+    CFG_SERVO_MAX_US,
+    CFG_SERVO_PROFILE,   // output profile at start of servo mode
+    CFG_RC_MIN_US,       // valid receiver pulse window
+    CFG_RC_MAX_US,
+    CFG_RECV_UPDATE_MS,  // console update intervals
+    CFG_SERVO_UPDATE_MS,
+    CFG_MSG_UPDATE_MS,
+    CFG_ESC_IMAGE,       // image slot flashed by a short button press in esc mode
+    CFG_ESC_FLASH_DIFF,  // write only the chunks that differ
+    CFG_ESC_LINE_CTRL,   // rts of the console holds the one-wire line low until esc power up
+    CFG_RELAY_IN_PIN,    // receiver input of the signal relay
+    CFG_RELAY_PROFILE,   // output profile of the signal relay
+    CFG_RELAY_RATE,      // percent of the input travel
+    CFG_RELAY_EXPO,      // percent of cubic share in the curve
+    CFG_RELAY_MIN_US,    // output limits
+    CFG_RELAY_MAX_US,
+    CFG_RELAY_FAILSAFE_US,// output without signal, 0 stops the pulses
+    CFG_RELAY_TIMEOUT_MS,// no valid pulse for this long is a signal loss
+    CFG_BRIDGE_FLUSH_US, // 0 usb flush per write, else a partial packet waits up to this long
+    CFG_COUNT
+} cfg_key;
+
+void cfg_init(void);
+uint32_t cfg_get(cfg_key key);
+bool cfg_set(cfg_key key, uint32_t value);
+void cfg_reset(void);
+bool cfg_commit(void);
+bool cfg_is_dirty(void);
+uint32_t cfg_get_seq(void);
+
+// flash helpers for the stores, offsets from the start of the flash
+void cfg_flash_erase(uint32_t offset, uint32_t len);
+void cfg_flash_program(uint32_t offset, const uint8_t *data, uint32_t len);
+uint32_t cfg_crc32(const uint8_t *data, uint32_t len);
+
+#endif /* _CFG_H_ */
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <stdio.h>
+#include <tusb.h>
+
+#include "diag.h"
+#include "uart_bridge.h"
+
+// one trace per core, so marks need no locking
+static struct
+{
+    diag_boot_mark_t mark[DIAG_BOOT_MAX];
+    volatile uint32_t count;
+} diag_boot[2];
+
+// record the end of a boot stage, time in us since reset
+void diag_boot_mark(const char *stage)
+{
+    uint32_t now = time_us_32();
+    uint core = get_core_num();
+
+    if (diag_boot[core].count < DIAG_BOOT_MAX)
+    {
+        diag_boot[core].mark[diag_boot[core].count].stage = stage;
+        diag_boot[core].mark[diag_boot[core].count].time_us = now;
+        __compiler_memory_barrier();
+        diag_boot[core].count++;
+    }
+}
+
+// copy the marks of both cores sorted by time, returns the number of marks
+uint32_t diag_boot_get(diag_boot_mark_t *marks, uint32_t max)
+{
+    uint32_t n0 = diag_boot[0].count;
+    uint32_t n1 = diag_boot[1].count;
+    uint32_t i0 = 0;
+    uint32_t i1 = 0;
+    uint32_t n;
+
+    for (n = 0; n < max && (i0 < n0 || i1 < n1); n++)
+    {
+        if (i1 >= n1 || (i0 < n0 && diag_boot[0].mark[i0].time_us <= diag_boot[1].mark[i1].time_us))
+        {
+            marks[n] = diag_boot[0].mark[i0++];
+        }
+        else
+        {
+            marks[n] = diag_boot[1].mark[i1++];
+        }
+    }
+    return n;
+}
+
+// print the boot trace to the console, with the time of each stage
+void diag_boot_print(void)
+{
+    diag_boot_mark_t marks[2 * DIAG_BOOT_MAX];
+    uint8_t print_buf[80];
+    uint32_t last = 0;
+    uint32_t n;
+
+    n = diag_boot_get(marks, count_of(marks));
+    dbg_print_usb("Boot trace us:\n");
+    for (uint32_t i = 0; i < n; i++)
+    {
+        sprintf(print_buf, "%8lu %+7ld %s\n", marks[i].time_us, (int32_t)(marks[i].time_us - last), marks[i].stage);
+        dbg_print_usb(print_buf);
+        last = marks[i].time_us;
+    }
+}
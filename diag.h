@@ -0,0 +1,24 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_DIAG_H_)
+#define _DIAG_H_
+
+#include <tusb.h>
+
+// boot trace entries per core
+#define DIAG_BOOT_MAX 12
+
+typedef struct
+{
+    const char *stage;
+    uint32_t time_us;
+} diag_boot_mark_t;
+
+void diag_boot_mark(const char *stage);
+uint32_t diag_boot_get(diag_boot_mark_t *marks, uint32_t max);
+void diag_boot_print(void);
+
+#endif /* _DIAG_H_ */
@@ -0,0 +1,622 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/flash.h>
+#include <hardware/uart.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "esc_boot.h"
+#include "tlog.h"
+#include "uart_bridge.h"
+#include "user_gpio.h"
+
+#if !defined(MIN)
+#define MIN(a, b) ((a > b) ? b : a)
+#endif /* MIN */
+
+#define ESC_IMG_MAGIC 0x47494d45 /* "EMIG" */
+
+#define ESCB_BIT_RATE 19200
+// one byte on the wire at 19200 8N1 in us
+#define ESCB_BYTE_US 521
+#define ESCB_ACK 0x30
+#define ESCB_CHUNK 256
+#define ESCB_INIT_TRIES 5
+
+// timeouts after the last byte sent, in us
+#define ESCB_TIMEOUT_ACK 50000
+#define ESCB_TIMEOUT_INIT 200000
+#define ESCB_TIMEOUT_PROG 500000
+// quiet time after a command without answer (buffer, run), in us
+#define ESCB_BUFFER_GAP 2000
+
+// bootloader commands
+#define ESCB_CMD_RUN 0x00
+#define ESCB_CMD_PROG_FLASH 0x01
+#define ESCB_CMD_READ_FLASH 0x03
+#define ESCB_CMD_SET_BUFFER 0xfe
+#define ESCB_CMD_SET_ADDRESS 0xff
+
+// steps of one chunk
+enum
+{
+    ST_INIT,
+    ST_CADDRESS,
+    ST_CREAD,
+    ST_ADDRESS,
+    ST_BUFFER,
+    ST_DATA,
+    ST_PROG,
+    ST_VADDRESS,
+    ST_READ,
+    ST_RUN,
+};
+
+static const uint8_t esc_boot_init[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x0d, 'B', 'L', 'H', 'e', 'l', 'i', 0xf4, 0x7d};
+
+// image upload in progress
+static struct
+{
+    int slot;
+    esc_image_t hdr;
+    uint32_t pos;
+    uint8_t page[FLASH_PAGE_SIZE];
+} upload = {.slot = -1};
+
+// bootloader jobs
+static struct
+{
+    uint8_t state;
+    uint8_t error;
+    uint8_t job;
+    uint8_t step;
+    uint8_t tries;
+    bool diff;
+    // stay in the bootloader after the job, esc_boot_release() starts the firmware
+    bool keep;
+    bool connected;
+    // read/write jobs are numbered, their result is kept until it was collected
+    uint32_t seq;
+    bool collected;
+    uint8_t info[8];
+    uint32_t written;
+    uint32_t address;
+    uint32_t size;
+    const uint8_t *data;
+    uint8_t *dest;
+    uint32_t pos;
+    uint32_t len;
+    // one transfer on the wire
+    uint8_t tx[ESCB_CHUNK + 2];
+    uint32_t tx_len;
+    uint32_t tx_pos;
+    uint32_t echo;
+    uint8_t rx[ESCB_CHUNK + 3];
+    uint32_t rx_len;
+    uint32_t rx_pos;
+    uint32_t timeout;
+    uint32_t deadline;
+} escb;
+
+//
+// image store
+//
+
+static uint32_t esc_img_offset(uint slot)
+{
+    return ESC_IMG_FLASH_OFFSET + slot * ESC_IMG_SLOT_SIZE;
+}
+
+const esc_image_t *esc_img_get(uint slot)
+{
+    const esc_image_t *hdr;
+
+    if (slot >= ESC_IMG_SLOTS)
+        return NULL;
+    hdr = (const esc_image_t *)(XIP_BASE + esc_img_offset(slot));
+    if (hdr->magic != ESC_IMG_MAGIC || hdr->size == 0 || hdr->size > ESC_IMG_MAX_SIZE)
+        return NULL;
+    return hdr;
+}
+
+static const uint8_t *esc_img_data(uint slot)
+{
+    return (const uint8_t *)(XIP_BASE + esc_img_offset(slot) + FLASH_SECTOR_SIZE);
+}
+
+// the old image is invalid from here on, the header is written last by esc_img_end()
+bool esc_img_begin(uint slot, uint32_t size, uint32_t address, const char *name, uint32_t name_len)
+{
+    if (slot >= ESC_IMG_SLOTS || size == 0 || size > ESC_IMG_MAX_SIZE || escb.state == escb_busy)
+        return false;
+
+    upload.slot = slot;
+    upload.pos = 0;
+    memset(&upload.hdr, 0, sizeof(upload.hdr));
+    upload.hdr.magic = ESC_IMG_MAGIC;
+    upload.hdr.size = size;
+    upload.hdr.address = address;
+    memcpy(upload.hdr.name, name, MIN(name_len, ESC_IMG_NAME_LEN - 1));
+
+    cfg_flash_erase(esc_img_offset(slot), FLASH_SECTOR_SIZE);
+    return true;
+}
+
+// data must be written in order, a sector is erased when the first page of it is written
+bool esc_img_write(uint slot, uint32_t offset, const uint8_t *data, uint32_t len)
+{
+    if (upload.slot != (int)slot || offset != upload.pos || len > upload.hdr.size - upload.pos)
+        return false;
+
+    while (len)
+    {
+        uint32_t fill = upload.pos % FLASH_PAGE_SIZE;
+        uint32_t n = MIN(len, FLASH_PAGE_SIZE - fill);
+
+        memcpy(&upload.page[fill], data, n);
+        upload.pos += n;
+        data += n;
+        len -= n;
+
+        if ((upload.pos % FLASH_PAGE_SIZE) == 0 || upload.pos == upload.hdr.size)
+        {
+            uint32_t page = (upload.pos - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE;
+            uint32_t flash = esc_img_offset(slot) + FLASH_SECTOR_SIZE + page;
+
+            if (upload.pos % FLASH_PAGE_SIZE)
+                memset(&upload.page[upload.pos % FLASH_PAGE_SIZE], 0xff, FLASH_PAGE_SIZE - upload.pos % FLASH_PAGE_SIZE);
+            if ((page % FLASH_SECTOR_SIZE) == 0)
+                cfg_flash_erase(flash, FLASH_SECTOR_SIZE);
+            cfg_flash_program(flash, upload.page, FLASH_PAGE_SIZE);
+        }
+    }
+    return true;
+}
+
+bool esc_img_end(uint slot, uint32_t crc)
+{
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    if (upload.slot != (int)slot || upload.pos != upload.hdr.size)
+        return false;
+    upload.slot = -1;
+
+    if (cfg_crc32(esc_img_data(slot), upload.hdr.size) != crc)
+        return false;
+    upload.hdr.crc = crc;
+
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &upload.hdr, sizeof(upload.hdr));
+    cfg_flash_program(esc_img_offset(slot), page, FLASH_PAGE_SIZE);
+    return esc_img_get(slot) != NULL;
+}
+
+//
+// bootloader protocol
+//
+
+static uint16_t esc_boot_crc16(const uint8_t *data, uint32_t len)
+{
+    uint16_t crc = 0;
+
+    while (len--)
+    {
+        crc ^= *data++;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+// queue a transfer, crc is appended if requested; rx_len bytes are expected after the echo,
+// without answer the transfer ends after timeout
+static void esc_boot_xfer(const uint8_t *data, uint32_t len, bool crc, uint32_t rx_len, uint32_t timeout)
+{
+    memcpy(escb.tx, data, len);
+    if (crc)
+    {
+        uint16_t c = esc_boot_crc16(data, len);
+        escb.tx[len++] = c & 0xff;
+        escb.tx[len++] = c >> 8;
+    }
+    escb.tx_len = len;
+    escb.tx_pos = 0;
+    escb.echo = len;
+    escb.rx_len = rx_len;
+    escb.rx_pos = 0;
+    escb.timeout = timeout;
+    // runs from the start of the transfer, the time on the wire is added
+    escb.deadline = time_us_32() + len * ESCB_BYTE_US + timeout;
+}
+
+static void esc_boot_cmd(uint8_t c0, uint8_t c1, uint8_t c2, uint8_t c3, uint32_t len, uint32_t rx_len, uint32_t timeout)
+{
+    uint8_t cmd[4] = {c0, c1, c2, c3};
+
+    esc_boot_xfer(cmd, len, true, rx_len, timeout);
+}
+
+// moves bytes, true when the transfer is complete or timed out
+static bool esc_boot_xfer_done(bool *timeout)
+{
+    uart_inst_t *uart = UART_ID.inst;
+
+    while (escb.tx_pos < escb.tx_len && uart_is_writable(uart))
+    {
+        uart_putc_raw(uart, escb.tx[escb.tx_pos++]);
+    }
+
+    while (uart_is_readable(uart))
+    {
+        uint8_t c = uart_getc(uart);
+        if (escb.echo)
+            escb.echo--;
+        else if (escb.rx_pos < escb.rx_len)
+            escb.rx[escb.rx_pos++] = c;
+    }
+
+    *timeout = false;
+    if (escb.rx_len && escb.tx_pos == escb.tx_len && escb.echo == 0 && escb.rx_pos == escb.rx_len)
+        return true;
+    if ((int32_t)(time_us_32() - escb.deadline) > 0)
+    {
+        // the gap after a command without answer is over
+        *timeout = escb.rx_len || escb.echo;
+        return true;
+    }
+    return false;
+}
+
+static void esc_boot_finish(uint8_t error)
+{
+    TLOG(escb_finish, error);
+    escb.state = error ? escb_fail : escb_pass;
+    escb.error = error;
+    if (error || !escb.keep)
+    {
+        escb.connected = false;
+        uart_bridge_resume();
+    }
+    if (escb.job == escb_job_image)
+        set_blue_led(error ? 0 : 1);
+}
+
+static void esc_boot_address(uint8_t step)
+{
+    uint32_t address = escb.address + escb.pos;
+
+    esc_boot_cmd(ESCB_CMD_SET_ADDRESS, 0, (address >> 8) & 0xff, address & 0xff, 4, 1, ESCB_TIMEOUT_ACK);
+    escb.step = step;
+}
+
+// read chunk, 0 reads 256 bytes
+static void esc_boot_read_chunk(uint8_t step)
+{
+    esc_boot_cmd(ESCB_CMD_READ_FLASH, escb.len & 0xff, 0, 0, 2, escb.len + 3, ESCB_TIMEOUT_ACK);
+    escb.step = step;
+}
+
+// the read answer is complete and its crc matches
+static bool esc_boot_read_ok(bool ack)
+{
+    return ack && esc_boot_crc16(escb.rx, escb.len) == (escb.rx[escb.len] | (escb.rx[escb.len + 1] << 8));
+}
+
+// set address, buffer, data, program and read back for the current chunk;
+// with diff the chunk is read first and only written if it differs
+static void esc_boot_chunk(void)
+{
+    escb.len = MIN(ESCB_CHUNK, escb.size - escb.pos);
+    esc_boot_address(escb.diff || escb.job == escb_job_read ? ST_CADDRESS : ST_ADDRESS);
+}
+
+static void esc_boot_next(void)
+{
+    TLOG(escb_chunk, escb.address + escb.pos, escb.written);
+    escb.pos += escb.len;
+    toggle_blue_led();
+    if (escb.pos < escb.size)
+    {
+        esc_boot_chunk();
+    }
+    else if (escb.keep)
+    {
+        esc_boot_finish(ESCB_ERR_NONE);
+    }
+    else
+    {
+        // start the new firmware, there is no answer
+        esc_boot_cmd(ESCB_CMD_RUN, 0, 0, 0, 2, 0, ESCB_BUFFER_GAP);
+        escb.step = ST_RUN;
+    }
+}
+
+// connect to the bootloader unless a kept session is open, then run the chunks
+static bool esc_boot_begin(uint8_t job, uint32_t address, uint32_t size)
+{
+    escb.job = job;
+    escb.error = ESCB_ERR_NONE;
+    if (!ceck_escpwr())
+    {
+        escb.connected = false;
+        escb.state = escb_fail;
+        escb.error = ESCB_ERR_POWER;
+        return false;
+    }
+    escb.address = address;
+    escb.size = size;
+    escb.pos = 0;
+    escb.written = 0;
+    escb.tries = 0;
+    escb.state = escb_busy;
+    escb.seq++;
+    escb.collected = (job == escb_job_image);
+    TLOG(escb_begin, job, address, size);
+
+    if (escb.connected)
+    {
+        esc_boot_chunk();
+        return true;
+    }
+    uart_bridge_suspend(ESCB_BIT_RATE);
+    esc_boot_xfer(esc_boot_init, sizeof(esc_boot_init), false, 9, ESCB_TIMEOUT_INIT);
+    escb.step = ST_INIT;
+    return true;
+}
+
+bool esc_boot_start(uint slot, bool diff)
+{
+    const esc_image_t *img;
+
+    if (!esc_boot_is_free())
+        return false;
+
+    img = esc_img_get(slot);
+    if (img == NULL)
+    {
+        escb.job = escb_job_image;
+        escb.state = escb_fail;
+        escb.error = ESCB_ERR_IMAGE;
+        return false;
+    }
+    escb.data = esc_img_data(slot);
+    escb.diff = diff;
+    escb.keep = false;
+    return esc_boot_begin(escb_job_image, img->address, img->size);
+}
+
+// job number for esc_boot_collect(), 0 if the job could not be started
+uint32_t esc_boot_read(uint32_t address, uint8_t *buf, uint32_t len)
+{
+    if (!esc_boot_is_free() || len == 0)
+        return 0;
+
+    escb.dest = buf;
+    escb.diff = false;
+    escb.keep = true;
+    return esc_boot_begin(escb_job_read, address, len) ? escb.seq : 0;
+}
+
+uint32_t esc_boot_write(uint32_t address, const uint8_t *buf, uint32_t len)
+{
+    if (!esc_boot_is_free() || len == 0)
+        return 0;
+
+    escb.data = buf;
+    escb.diff = false;
+    escb.keep = true;
+    return esc_boot_begin(escb_job_write, address, len) ? escb.seq : 0;
+}
+
+// true when the job is over, error holds its result
+bool esc_boot_collect(uint32_t seq, uint8_t *error)
+{
+    if (seq != escb.seq)
+    {
+        *error = ESCB_ERR_ABORT;
+        return true;
+    }
+    if (escb.state == escb_busy)
+        return false;
+    escb.collected = true;
+    *error = escb.error;
+    return true;
+}
+
+// no job running and no result waiting for its owner
+bool esc_boot_is_free(void)
+{
+    return escb.state != escb_busy && (escb.collected || escb.job == escb_job_image || escb.job == escb_job_run);
+}
+
+// leave a kept session, the esc starts its firmware and the bridge takes the uart back
+void esc_boot_release(void)
+{
+    if (!esc_boot_is_free() || !escb.connected)
+        return;
+
+    escb.seq++;
+    escb.collected = true;
+    escb.job = escb_job_run;
+    escb.keep = false;
+    escb.state = escb_busy;
+    esc_boot_cmd(ESCB_CMD_RUN, 0, 0, 0, 2, 0, ESCB_BUFFER_GAP);
+    escb.step = ST_RUN;
+}
+
+bool esc_boot_is_connected(void)
+{
+    return escb.connected;
+}
+
+// "471" and the bootloader info of the last connect
+bool esc_boot_get_info(uint8_t *info)
+{
+    memcpy(info, escb.info, sizeof(escb.info));
+    return escb.info[0] == '4';
+}
+
+uint8_t esc_boot_get_job(void)
+{
+    return escb.job;
+}
+
+void esc_boot_abort(void)
+{
+    escb.collected = true;
+    if (escb.state == escb_busy)
+    {
+        esc_boot_finish(ESCB_ERR_ABORT);
+    }
+    else if (escb.connected)
+    {
+        escb.connected = false;
+        uart_bridge_resume();
+    }
+}
+
+bool esc_boot_is_running(void)
+{
+    return escb.state == escb_busy;
+}
+
+uint8_t esc_boot_get_state(void)
+{
+    return escb.state;
+}
+
+uint8_t esc_boot_get_error(void)
+{
+    return escb.error;
+}
+
+void esc_boot_get_progress(uint32_t *done, uint32_t *total)
+{
+    *done = escb.pos;
+    *total = escb.size;
+}
+
+uint32_t esc_boot_get_written(void)
+{
+    return escb.written;
+}
+
+// runs the transfers from the main loop, never blocks
+void esc_boot_task(void)
+{
+    bool timeout;
+    bool ack;
+
+    if (escb.state != escb_busy || !esc_boot_xfer_done(&timeout))
+        return;
+
+    ack = !timeout && escb.rx_len && escb.rx[escb.rx_len - 1] == ESCB_ACK;
+
+    switch (escb.step)
+    {
+        case ST_INIT:
+            if (ack && memcmp(escb.rx, "471", 3) == 0)
+            {
+                memcpy(escb.info, escb.rx, sizeof(escb.info));
+                escb.connected = true;
+                esc_boot_chunk();
+            }
+            else if (++escb.tries < ESCB_INIT_TRIES)
+            {
+                esc_boot_xfer(esc_boot_init, sizeof(esc_boot_init), false, 9, ESCB_TIMEOUT_INIT);
+            }
+            else
+            {
+                esc_boot_finish(ESCB_ERR_CONNECT);
+            }
+            break;
+        case ST_CADDRESS:
+            if (!ack)
+            {
+                esc_boot_finish(ESCB_ERR_CONNECT);
+                break;
+            }
+            esc_boot_read_chunk(ST_CREAD);
+            break;
+        case ST_CREAD:
+            if (!esc_boot_read_ok(ack))
+            {
+                esc_boot_finish(ESCB_ERR_CONNECT);
+            }
+            else if (escb.job == escb_job_read)
+            {
+                memcpy(&escb.dest[escb.pos], escb.rx, escb.len);
+                esc_boot_next();
+            }
+            else if (memcmp(escb.rx, &escb.data[escb.pos], escb.len) == 0)
+            {
+                esc_boot_next();
+            }
+            else
+            {
+                esc_boot_address(ST_ADDRESS);
+            }
+            break;
+        case ST_ADDRESS:
+            if (!ack)
+            {
+                esc_boot_finish(ESCB_ERR_WRITE);
+                break;
+            }
+            // no answer, the bootloader gets a short gap before the data
+            esc_boot_cmd(ESCB_CMD_SET_BUFFER, 0, (escb.len >> 8) & 0xff, escb.len & 0xff, 4, 0, ESCB_BUFFER_GAP);
+            escb.step = ST_BUFFER;
+            break;
+        case ST_BUFFER:
+            esc_boot_xfer(&escb.data[escb.pos], escb.len, true, 1, ESCB_TIMEOUT_ACK);
+            escb.step = ST_DATA;
+            break;
+        case ST_DATA:
+            if (!ack)
+            {
+                esc_boot_finish(ESCB_ERR_WRITE);
+                break;
+            }
+            esc_boot_cmd(ESCB_CMD_PROG_FLASH, 0x01, 0, 0, 2, 1, ESCB_TIMEOUT_PROG);
+            escb.step = ST_PROG;
+            break;
+        case ST_PROG:
+            if (!ack)
+            {
+                esc_boot_finish(ESCB_ERR_WRITE);
+                break;
+            }
+            escb.written += escb.len;
+            esc_boot_address(ST_VADDRESS);
+            break;
+        case ST_VADDRESS:
+            if (!ack)
+            {
+                esc_boot_finish(ESCB_ERR_VERIFY);
+                break;
+            }
+            esc_boot_read_chunk(ST_READ);
+            break;
+        case ST_READ:
+            if (!esc_boot_read_ok(ack) || memcmp(escb.rx, &escb.data[escb.pos], escb.len) != 0)
+            {
+                esc_boot_finish(ESCB_ERR_VERIFY);
+                break;
+            }
+            esc_boot_next();
+            break;
+        case ST_RUN:
+            esc_boot_finish(ESCB_ERR_NONE);
+            break;
+        default:
+            esc_boot_finish(ESCB_ERR_ABORT);
+            break;
+    }
+}
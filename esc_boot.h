@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_ESC_BOOT_H_)
+#define _ESC_BOOT_H_
+
+#include <hardware/flash.h>
+#include <tusb.h>
+
+#include "cfg.h"
+
+/*
+ * On-device ESC flashing. Firmware images are uploaded once into a store
+ * below the configuration area and written to the ESC with the BLHeli/AM32
+ * one-wire bootloader protocol (19200 8N1, CRC-16 poly 0xA001):
+ *
+ *   init      12x 0x00 0x0D "BLHeli" crc    -> "471" info (8 bytes) ack
+ *   address   0xFF 0 addr_hi addr_lo crc    -> ack
+ *   buffer    0xFE 0 len_hi len_lo crc      -> no answer, 2 ms gap
+ *   data      data crc                      -> ack
+ *   program   0x01 0x01 crc                 -> ack
+ *   read      0x03 len crc                  -> data crc ack
+ *   run       0x00 0x00 crc
+ *
+ * ack is 0x30. Every byte sent on the one-wire line is echoed on rx.
+ *
+ * The bootloader has no page checksum command, for an incremental flash every
+ * chunk is read first and written only if it differs from the image chunk.
+ * At 19200 baud that read costs about half a full write of the chunk, so the
+ * diff only pays off when most chunks are unchanged and is off by default.
+ */
+
+// image store
+#define ESC_IMG_SLOTS 4
+#define ESC_IMG_MAX_SIZE (64 * 1024)
+#define ESC_IMG_SLOT_SIZE (FLASH_SECTOR_SIZE + ESC_IMG_MAX_SIZE)
+#define ESC_IMG_FLASH_OFFSET (CFG_FLASH_OFFSET - ESC_IMG_SLOTS * ESC_IMG_SLOT_SIZE)
+#define ESC_IMG_NAME_LEN 32
+
+/*! @brief Bootloader address of the ESC settings page, default AM32 on STM32F051
+ */
+#ifndef ESC_EEPROM_ADDRESS
+#define ESC_EEPROM_ADDRESS 0x7c00
+#endif
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t size;
+    uint32_t address;// bootloader address of the first byte
+    uint32_t crc;    // crc32 of the data
+    char name[ESC_IMG_NAME_LEN];
+} esc_image_t;
+
+// flashing state
+#define escb_idle 0
+#define escb_busy 1
+#define escb_pass 2
+#define escb_fail 3
+
+// jobs
+#define escb_job_image 0
+#define escb_job_read 1
+#define escb_job_write 2
+#define escb_job_run 3
+
+// failure reasons
+#define ESCB_ERR_NONE 0
+#define ESCB_ERR_IMAGE 1
+#define ESCB_ERR_POWER 2
+#define ESCB_ERR_CONNECT 3
+#define ESCB_ERR_WRITE 4
+#define ESCB_ERR_VERIFY 5
+#define ESCB_ERR_ABORT 6
+
+bool esc_img_begin(uint slot, uint32_t size, uint32_t address, const char *name, uint32_t name_len);
+bool esc_img_write(uint slot, uint32_t offset, const uint8_t *data, uint32_t len);
+bool esc_img_end(uint slot, uint32_t crc);
+const esc_image_t *esc_img_get(uint slot);
+
+bool esc_boot_start(uint slot, bool diff);
+// raw access, the bootloader stays connected until esc_boot_release()
+uint32_t esc_boot_read(uint32_t address, uint8_t *buf, uint32_t len);
+uint32_t esc_boot_write(uint32_t address, const uint8_t *buf, uint32_t len);
+bool esc_boot_collect(uint32_t seq, uint8_t *error);
+bool esc_boot_is_free(void);
+void esc_boot_release(void);
+bool esc_boot_is_connected(void);
+bool esc_boot_get_info(uint8_t *info);
+uint8_t esc_boot_get_job(void);
+void esc_boot_abort(void);
+void esc_boot_task(void);
+bool esc_boot_is_running(void);
+uint8_t esc_boot_get_state(void);
+uint8_t esc_boot_get_error(void);
+void esc_boot_get_progress(uint32_t *done, uint32_t *total);
+uint32_t esc_boot_get_written(void);
+
+#endif /* _ESC_BOOT_H_ */
@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/uart.h>
+#include <pico/stdlib.h>
+#include <pico/sync.h>
+
+#include "cfg.h"
+#include "esc_line.h"
+#include "tlog.h"
+#include "uart_bridge.h"
+#include "user_gpio.h"
+
+// SEND_BREAK lengths without end
+#define ESC_LINE_BREAK_ON 0xffff
+
+static struct
+{
+    critical_section_t cs;
+    bool attached;       // the uart is initialized
+    bool hold;           // rts or rpc
+    bool brk;            // SEND_BREAK
+    volatile bool armed; // release the hold at esc power up
+    uint32_t brk_seq;    // SEND_BREAK requests, an alarm ends only its own break
+    uint32_t power_up_us;// time of the last release at power up
+} line;
+
+// with line.cs held
+static inline void esc_line_set(void)
+{
+    if (line.attached)
+        uart_set_break(UART_ID.inst, line.hold || line.brk);
+}
+
+// by the bridge after the uart is initialized and before it is reset again,
+// the level is kept over a mode switch
+void esc_line_attach(bool attached)
+{
+    critical_section_enter_blocking(&line.cs);
+    line.attached = attached;
+    esc_line_set();
+    critical_section_exit(&line.cs);
+}
+
+void esc_line_hold(bool hold, bool arm)
+{
+    critical_section_enter_blocking(&line.cs);
+    line.hold = hold;
+    line.armed = hold && arm;
+    esc_line_set();
+    critical_section_exit(&line.cs);
+    TLOG(line_hold, hold, arm);
+}
+
+// from the edge interrupt of the esc power input
+void esc_line_power_edge(void)
+{
+    if (!line.armed)
+        return;
+
+    critical_section_enter_blocking(&line.cs);
+    line.hold = false;
+    line.armed = false;
+    esc_line_set();
+    line.power_up_us = time_us_32();
+    critical_section_exit(&line.cs);
+    TLOG(line_power_up);
+}
+
+static int64_t esc_line_break_end(alarm_id_t id, void *user_data)
+{
+    critical_section_enter_blocking(&line.cs);
+    if (line.brk_seq == (uint32_t)(uintptr_t)user_data)
+    {
+        line.brk = false;
+        esc_line_set();
+    }
+    critical_section_exit(&line.cs);
+    return 0;
+}
+
+// before core 1 is started and the inputs are initialized
+void esc_line_init(void)
+{
+    critical_section_init(&line.cs);
+}
+
+// host SET_CONTROL_LINE_STATE, RTS holds the line and arms the release (cfg esc_line_ctrl),
+// DTR is the connection of the terminal
+void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
+{
+    if (itf != 0 || !cfg_get(CFG_ESC_LINE_CTRL))
+        return;
+    if (rts != line.hold)
+        esc_line_hold(rts, true);
+}
+
+// host SEND_BREAK, 0 ends a break, 0xffff until the next one
+void tud_cdc_send_break_cb(uint8_t itf, uint16_t duration_ms)
+{
+    uint32_t seq;
+
+    if (itf != 0)
+        return;
+    critical_section_enter_blocking(&line.cs);
+    seq = ++line.brk_seq;
+    line.brk = duration_ms != 0;
+    esc_line_set();
+    critical_section_exit(&line.cs);
+    // the alarm of an earlier break fires without effect
+    if (duration_ms != 0 && duration_ms != ESC_LINE_BREAK_ON)
+        add_alarm_in_us(duration_ms * 1000ull, esc_line_break_end, (void *)(uintptr_t)seq, true);
+    TLOG(line_break, duration_ms);
+}
+
+// no args: status, hold u8, arm u8: set the hold
+// status: hold u8, break u8, armed u8, esc power u8, time of the last release at power up u32
+static uint8_t rpc_line(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0 && arg_len != 2)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 8))
+        return RPC_ERR_NOSPACE;
+    if (arg_len == 2)
+        esc_line_hold(arg[0], arg[1]);
+    rsp[0] = line.hold;
+    rsp[1] = line.brk;
+    rsp[2] = line.armed;
+    rsp[3] = get_escpower();
+    rpc_put_u32(&rsp[4], line.power_up_us);
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_line_cmds[] = {
+    {RPC_OP_ESC_LINE, rpc_line},
+};
+const uint32_t rpc_line_cmds_count = count_of(rpc_line_cmds);
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_ESC_LINE_H_)
+#define _ESC_LINE_H_
+
+#include <tusb.h>
+
+#include "rpc.h"
+
+/*
+ * Level control of the one-wire line for the ESC bootloader entry. The line is
+ * pulled low by the break of the uart, so the uart keeps the pin and the bridge
+ * runs on when the line is released.
+ *
+ * The line is low while it is held (RTS of the console with cfg esc_line_ctrl,
+ * or the rpc line command) or a CDC SEND_BREAK runs. The break length is timed
+ * by a timer alarm. Armed, the hold is released in the edge interrupt of the
+ * ESC power input (input.c), the bootloader finds the line idle high from its first sample
+ * and an ESC without power is not fed through the signal pin before.
+ */
+
+void esc_line_init(void);
+void esc_line_power_edge(void);
+void esc_line_attach(bool attached);
+void esc_line_hold(bool hold, bool arm);
+
+extern const rpc_cmd_t rpc_line_cmds[];
+extern const uint32_t rpc_line_cmds_count;
+
+#endif /* _ESC_LINE_H_ */
@@ -0,0 +1,527 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <tusb.h>
+
+#include "esc_boot.h"
+#include "esc_msc.h"
+#include "user_gpio.h"
+
+#if USBLINK_MSC
+
+#if !defined(MIN)
+#define MIN(a, b) ((a > b) ? b : a)
+#endif /* MIN */
+
+// fixed FAT12 layout, one block per cluster
+#define MSC_BLOCK_SIZE 512
+#define MSC_BLOCK_COUNT 1024
+#define MSC_FAT_BLOCKS 3
+#define MSC_LBA_FAT0 1
+#define MSC_LBA_FAT1 (MSC_LBA_FAT0 + MSC_FAT_BLOCKS)
+#define MSC_LBA_ROOT (MSC_LBA_FAT1 + MSC_FAT_BLOCKS)
+#define MSC_LBA_DATA (MSC_LBA_ROOT + 1)
+#define MSC_ROOT_ENTRIES 16
+#define MSC_INFO_SIZE 256
+// 2025-01-01
+#define MSC_DATE (((2025 - 1980) << 9) | (1 << 5) | 1)
+
+#define MSC_CLUSTERS(size) (((size) + MSC_BLOCK_SIZE - 1) / MSC_BLOCK_SIZE)
+
+// transfer handed from core 1 to core 0
+#define msc_req_idle 0
+#define msc_req_read 1
+#define msc_req_write 2
+#define msc_req_busy 3
+#define msc_req_done 4
+#define msc_req_fail 5
+
+typedef struct
+{
+    char name[11];
+    uint8_t attr;
+    uint32_t address; // bootloader address, 0 for generated files
+    uint32_t size;
+    uint32_t cluster;
+} msc_file_t;
+
+static const msc_file_t msc_files[] = {
+    {"INFO    TXT", 0x01, 0, MSC_INFO_SIZE, 2},
+    {"FIRMWAREBIN", 0x20, ESC_MSC_FW_ADDRESS, ESC_MSC_FW_SIZE, 3},
+    {"EEPROM  BIN", 0x20, ESC_MSC_EEPROM_ADDRESS, ESC_MSC_EEPROM_SIZE, 3 + MSC_CLUSTERS(ESC_MSC_FW_SIZE)},
+};
+
+static const uint8_t msc_boot_sector[] = {
+    0xeb, 0x3c, 0x90, 'M', 'S', 'D', 'O', 'S', '5', '.', '0',
+    MSC_BLOCK_SIZE & 0xff, MSC_BLOCK_SIZE >> 8, // bytes per sector
+    1,                                          // sectors per cluster
+    MSC_LBA_FAT0, 0,                            // reserved sectors
+    2,                                          // fats
+    MSC_ROOT_ENTRIES, 0,                        // root entries
+    MSC_BLOCK_COUNT & 0xff, MSC_BLOCK_COUNT >> 8,
+    0xf8,                                       // media
+    MSC_FAT_BLOCKS, 0,                          // sectors per fat
+    1, 0, 1, 0,                                 // sectors per track, heads
+    0, 0, 0, 0, 0, 0, 0, 0,                     // hidden, total sectors 32
+    0x80, 0, 0x29, 0x4b, 0x4e, 0x4c, 0x55,      // drive, boot signature, serial
+    'U', 'S', 'B', 'L', 'I', 'N', 'K', ' ', 'E', 'S', 'C',
+    'F', 'A', 'T', '1', '2', ' ', ' ', ' ',
+};
+
+static struct
+{
+    volatile bool active;
+    volatile bool ejected;
+    volatile bool release;
+    volatile bool flush;
+    volatile uint32_t access_time;
+    uint32_t pwr_changes; // core 0
+    // one transfer at a time, owned by core 0 between read/write and done/fail
+    volatile uint8_t req;
+    uint8_t req_op;
+    uint32_t req_address;
+    uint32_t req_len;
+    uint8_t req_buf[MSC_BLOCK_SIZE];
+    // bootloader job of the transfer, core 0
+    uint32_t job;
+    // read cache, only used on core 1
+    uint32_t cache_address[ESC_MSC_CACHE_BLOCKS];
+    bool cache_valid[ESC_MSC_CACHE_BLOCKS];
+    uint8_t cache[ESC_MSC_CACHE_BLOCKS][MSC_BLOCK_SIZE];
+    uint32_t cache_next;
+    uint8_t block[MSC_BLOCK_SIZE];
+} msc;
+
+//
+// generated blocks
+//
+
+static uint32_t msc_fat_entry(uint32_t n)
+{
+    if (n < 2)
+        return n ? 0xfff : 0xff8;
+    for (uint32_t i = 0; i < count_of(msc_files); i++)
+    {
+        const msc_file_t *f = &msc_files[i];
+        uint32_t end = f->cluster + MSC_CLUSTERS(f->size);
+
+        if (n >= f->cluster && n < end)
+            return n + 1 < end ? n + 1 : 0xfff;
+    }
+    return 0;
+}
+
+static void msc_fat_block(uint32_t block, uint8_t *buf)
+{
+    for (uint32_t i = 0; i < MSC_BLOCK_SIZE; i++)
+    {
+        // two 12 bit entries in three bytes
+        uint32_t pos = block * MSC_BLOCK_SIZE + i;
+        uint32_t e0 = msc_fat_entry(pos / 3 * 2);
+        uint32_t e1 = msc_fat_entry(pos / 3 * 2 + 1);
+
+        switch (pos % 3)
+        {
+            case 0:
+                buf[i] = e0 & 0xff;
+                break;
+            case 1:
+                buf[i] = (e0 >> 8) | ((e1 & 0x0f) << 4);
+                break;
+            default:
+                buf[i] = e1 >> 4;
+                break;
+        }
+    }
+}
+
+static void msc_root_block(uint8_t *buf)
+{
+    uint8_t *e = buf;
+
+    memcpy(e, "USBLINK ESC", 11);
+    e[11] = 0x08;
+    e += 32;
+    for (uint32_t i = 0; i < count_of(msc_files); i++, e += 32)
+    {
+        const msc_file_t *f = &msc_files[i];
+
+        memcpy(e, f->name, 11);
+        e[11] = f->attr;
+        e[16] = e[24] = MSC_DATE & 0xff;
+        e[17] = e[25] = MSC_DATE >> 8;
+        e[26] = f->cluster & 0xff;
+        e[27] = f->cluster >> 8;
+        e[28] = f->size & 0xff;
+        e[29] = (f->size >> 8) & 0xff;
+        e[30] = (f->size >> 16) & 0xff;
+        e[31] = f->size >> 24;
+    }
+}
+
+static void msc_info_block(uint8_t *buf)
+{
+    uint8_t info[8];
+    int len;
+
+    esc_boot_get_info(info);
+    len = snprintf((char *)buf, MSC_INFO_SIZE,
+                   "ESC bootloader %.3s, info %02x %02x %02x %02x %02x\n"
+                   "firmware.bin 0x%04x %u bytes\n"
+                   "eeprom.bin   0x%04x %u bytes\n",
+                   info, info[3], info[4], info[5], info[6], info[7],
+                   ESC_MSC_FW_ADDRESS, ESC_MSC_FW_SIZE, ESC_MSC_EEPROM_ADDRESS, ESC_MSC_EEPROM_SIZE);
+    // fixed file size, padded with blanks
+    memset(&buf[len], ' ', MSC_INFO_SIZE - len);
+    buf[MSC_INFO_SIZE - 1] = '\n';
+}
+
+// generated boot, fat or directory block
+static void msc_layout_block(uint32_t lba, uint8_t *buf)
+{
+    memset(buf, 0, MSC_BLOCK_SIZE);
+    if (lba == 0)
+    {
+        memcpy(buf, msc_boot_sector, sizeof(msc_boot_sector));
+        buf[510] = 0x55;
+        buf[511] = 0xaa;
+    }
+    else if (lba < MSC_LBA_ROOT)
+    {
+        msc_fat_block((lba - MSC_LBA_FAT0) % MSC_FAT_BLOCKS, buf);
+    }
+    else
+    {
+        msc_root_block(buf);
+    }
+}
+
+// a layout write is taken if it keeps the generated block, in the directory
+// the times and dates may change (access and write time of a file written in place)
+static bool msc_layout_kept(uint32_t lba, const uint8_t *data)
+{
+    msc_layout_block(lba, msc.block);
+    if (lba != MSC_LBA_ROOT)
+        return memcmp(data, msc.block, MSC_BLOCK_SIZE) == 0;
+    for (uint32_t i = 0; i < MSC_BLOCK_SIZE; i += 32)
+    {
+        // name and attribute, first cluster and size
+        if (memcmp(&data[i], &msc.block[i], 13) || memcmp(&data[i + 26], &msc.block[i + 26], 6))
+            return false;
+    }
+    return true;
+}
+
+// file and byte position of a data block
+static const msc_file_t *msc_file(uint32_t lba, uint32_t *pos)
+{
+    uint32_t cluster = lba - MSC_LBA_DATA + 2;
+
+    for (uint32_t i = 0; i < count_of(msc_files); i++)
+    {
+        const msc_file_t *f = &msc_files[i];
+
+        if (cluster >= f->cluster && cluster < f->cluster + MSC_CLUSTERS(f->size))
+        {
+            *pos = (cluster - f->cluster) * MSC_BLOCK_SIZE;
+            return f;
+        }
+    }
+    return NULL;
+}
+
+//
+// transfers, core 1 side
+//
+
+static void msc_post(uint8_t op, uint32_t address, uint32_t len)
+{
+    msc.req_op = op;
+    msc.req_address = address;
+    msc.req_len = len;
+    __dmb();
+    msc.req = op;
+}
+
+// drop the result of a transfer the host does not ask for any more
+static void msc_drop_stale(uint8_t op, uint32_t address)
+{
+    if ((msc.req == msc_req_done || msc.req == msc_req_fail) && (msc.req_op != op || msc.req_address != address))
+        msc.req = msc_req_idle;
+}
+
+// 1 block ready in *data, 0 busy, -1 failed
+static int msc_fetch(uint32_t address, uint32_t len, const uint8_t **data)
+{
+    uint32_t i;
+
+    if (msc.flush)
+    {
+        msc.flush = false;
+        memset(msc.cache_valid, 0, sizeof(msc.cache_valid));
+    }
+    for (i = 0; i < ESC_MSC_CACHE_BLOCKS; i++)
+    {
+        if (msc.cache_valid[i] && msc.cache_address[i] == address)
+        {
+            *data = msc.cache[i];
+            return 1;
+        }
+    }
+
+    msc_drop_stale(msc_req_read, address);
+    switch (msc.req)
+    {
+        case msc_req_idle:
+            msc_post(msc_req_read, address, len);
+            return 0;
+        case msc_req_done:
+            i = msc.cache_next++ % ESC_MSC_CACHE_BLOCKS;
+            memcpy(msc.cache[i], msc.req_buf, len);
+            msc.cache_address[i] = address;
+            msc.cache_valid[i] = true;
+            msc.req = msc_req_idle;
+            *data = msc.cache[i];
+            return 1;
+        case msc_req_fail:
+            msc.req = msc_req_idle;
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+// 1 written, 0 busy, -1 failed
+static int msc_store(uint32_t address, const uint8_t *data, uint32_t len)
+{
+    msc_drop_stale(msc_req_write, address);
+    switch (msc.req)
+    {
+        case msc_req_idle:
+            memcpy(msc.req_buf, data, len);
+            msc_post(msc_req_write, address, len);
+            return 0;
+        case msc_req_done:
+            for (uint32_t i = 0; i < ESC_MSC_CACHE_BLOCKS; i++)
+            {
+                if (msc.cache_valid[i] && msc.cache_address[i] == address)
+                    memcpy(msc.cache[i], data, len);
+            }
+            msc.req = msc_req_idle;
+            return 1;
+        case msc_req_fail:
+            msc.req = msc_req_idle;
+            return -1;
+        default:
+            return 0;
+    }
+}
+
+//
+// tinyusb msc callbacks, core 1
+//
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
+{
+    memcpy(vendor_id, "USBLink ", 8);
+    memcpy(product_id, "ESC flash       ", 16);
+    memcpy(product_rev, "1.0 ", 4);
+}
+
+// no medium outside of esc mode, after an eject or with esc power off
+bool tud_msc_test_unit_ready_cb(uint8_t lun)
+{
+    if (!msc.active || msc.ejected || !ceck_escpwr())
+    {
+        // another esc may come
+        msc.flush = true;
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3a, 0x00);
+        return false;
+    }
+    return true;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count, uint16_t *block_size)
+{
+    *block_count = MSC_BLOCK_COUNT;
+    *block_size = MSC_BLOCK_SIZE;
+}
+
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject)
+{
+    if (load_eject)
+    {
+        msc.ejected = !start;
+        msc.release = !start;
+    }
+    return true;
+}
+
+// a transfer not ready yet returns 0, tinyusb calls again
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize)
+{
+    const msc_file_t *f;
+    const uint8_t *data = msc.block;
+    uint32_t pos;
+    uint8_t info[8];
+    int ret;
+
+    if (!msc.active)
+    {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3a, 0x00);
+        return -1;
+    }
+    msc.access_time = time_us_32();
+    memset(msc.block, 0, MSC_BLOCK_SIZE);
+
+    if (lba < MSC_LBA_DATA)
+    {
+        msc_layout_block(lba, msc.block);
+    }
+    else if ((f = msc_file(lba, &pos)) != NULL)
+    {
+        // the info comes with the connect, the first firmware block connects
+        ret = f->address ? msc_fetch(f->address + pos, MIN(MSC_BLOCK_SIZE, f->size - pos), &data)
+                         : (esc_boot_get_info(info) ? 1 : msc_fetch(ESC_MSC_FW_ADDRESS, MSC_BLOCK_SIZE, &data));
+        if (ret == 0)
+            return 0;
+        if (ret < 0)
+        {
+            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
+            return -1;
+        }
+        if (f->address == 0)
+        {
+            msc_info_block(msc.block);
+            data = msc.block;
+        }
+    }
+
+    memcpy(buffer, &data[offset], MIN(bufsize, MSC_BLOCK_SIZE - offset));
+    return MIN(bufsize, MSC_BLOCK_SIZE - offset);
+}
+
+bool tud_msc_is_writable_cb(uint8_t lun)
+{
+    return true;
+}
+
+// writes into firmware.bin and eeprom.bin are programmed, the layout is fixed: a write that changes
+// boot sector, fat or directory, or goes to info.txt or a free cluster fails as write protected
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize)
+{
+    const msc_file_t *f;
+    uint32_t pos;
+    int ret;
+
+    if (!msc.active)
+    {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3a, 0x00);
+        return -1;
+    }
+    msc.access_time = time_us_32();
+
+    // whole blocks only, the endpoint buffer holds one
+    if (offset || bufsize < MSC_BLOCK_SIZE)
+    {
+        tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00);
+        return -1;
+    }
+    if (lba < MSC_LBA_DATA)
+    {
+        if (msc_layout_kept(lba, buffer))
+            return MSC_BLOCK_SIZE;
+        tud_msc_set_sense(lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);
+        return -1;
+    }
+    f = msc_file(lba, &pos);
+    if (f == NULL || f->address == 0)
+    {
+        tud_msc_set_sense(lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);
+        return -1;
+    }
+
+    ret = msc_store(f->address + pos, buffer, MIN(MSC_BLOCK_SIZE, f->size - pos));
+    if (ret == 0)
+        return 0;
+    if (ret < 0)
+    {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0c, 0x00);
+        return -1;
+    }
+    return MSC_BLOCK_SIZE;
+}
+
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, uint16_t bufsize)
+{
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+    return -1;
+}
+
+//
+// core 0
+//
+
+void esc_msc_start(void)
+{
+    msc.flush = true;
+    msc.req = msc_req_idle;
+    msc.ejected = false;
+    msc.release = false;
+    __dmb();
+    msc.active = true;
+}
+
+void esc_msc_stop(void)
+{
+    msc.active = false;
+    if (msc.req != msc_req_idle)
+        msc.req = msc_req_fail;
+}
+
+// runs the transfers requested by the usb callbacks in the esc mode task
+void esc_msc_task(void)
+{
+    uint8_t req = msc.req;
+    uint8_t error;
+
+    // the cached blocks are outdated by an image flash or a power cycle
+    if (esc_boot_is_running() && esc_boot_get_job() == escb_job_image)
+        msc.flush = true;
+    if (msc.pwr_changes != get_escpwr_changes())
+    {
+        msc.pwr_changes = get_escpwr_changes();
+        msc.flush = true;
+    }
+
+    if (req == msc_req_read || req == msc_req_write)
+    {
+        if (!esc_boot_is_free())
+            return;
+        __dmb();
+        msc.job = req == msc_req_read ? esc_boot_read(msc.req_address, msc.req_buf, msc.req_len)
+                                      : esc_boot_write(msc.req_address, msc.req_buf, msc.req_len);
+        msc.req = msc.job ? msc_req_busy : msc_req_fail;
+    }
+    else if (req == msc_req_busy)
+    {
+        if (esc_boot_collect(msc.job, &error))
+            msc.req = error == ESCB_ERR_NONE ? msc_req_done : msc_req_fail;
+    }
+    else if (esc_boot_is_connected() && esc_boot_is_free() &&
+             (msc.release || time_us_32() - msc.access_time > ESC_MSC_IDLE_US))
+    {
+        // the esc runs its firmware again and the bridge is back for the configurator
+        msc.release = false;
+        esc_boot_release();
+    }
+}
+
+#endif /* USBLINK_MSC */
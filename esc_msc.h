@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_ESC_MSC_H_)
+#define _ESC_MSC_H_
+
+#include <tusb.h>
+
+#include "esc_boot.h"
+
+/*
+ * Mass storage view of the ESC on the one-wire bus (build option
+ * USBLINK_MSC). A fixed FAT12 volume holds info.txt, firmware.bin and
+ * eeprom.bin. Boot sector, FAT and directory are generated, file blocks are
+ * read on demand through the bootloader and kept in a small cache, writes
+ * into firmware.bin and eeprom.bin are programmed into the ESC. Writes that
+ * would change the layout (new, renamed, deleted or resized files) fail as
+ * write protected. The usb callbacks run on core 1 and hand the transfers to
+ * esc_msc_task() on core 0.
+ */
+
+/*! @brief Bootloader address and size of firmware.bin, default AM32 on STM32F051
+ */
+#ifndef ESC_MSC_FW_ADDRESS
+#define ESC_MSC_FW_ADDRESS 0x1000
+#endif
+#ifndef ESC_MSC_FW_SIZE
+#define ESC_MSC_FW_SIZE 0x6c00
+#endif
+
+/*! @brief Bootloader address and size of eeprom.bin (AM32 settings page)
+ */
+#ifndef ESC_MSC_EEPROM_ADDRESS
+#define ESC_MSC_EEPROM_ADDRESS ESC_EEPROM_ADDRESS
+#endif
+#ifndef ESC_MSC_EEPROM_SIZE
+#define ESC_MSC_EEPROM_SIZE 0x400
+#endif
+
+/*! @brief Number of 512 byte blocks kept in the read cache
+ */
+#ifndef ESC_MSC_CACHE_BLOCKS
+#define ESC_MSC_CACHE_BLOCKS 8
+#endif
+
+/*! @brief The ESC is released to its firmware after this time without access, in micro seconds
+ */
+#ifndef ESC_MSC_IDLE_US
+#define ESC_MSC_IDLE_US 2000000
+#endif
+
+void esc_msc_start(void);
+void esc_msc_stop(void);
+void esc_msc_task(void);
+
+#endif /* _ESC_MSC_H_ */
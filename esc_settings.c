@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "esc_boot.h"
+#include "esc_settings.h"
+#include "user_gpio.h"
+
+// steps
+#define escs_none 0
+#define escs_load 1
+#define escs_write 2
+
+static struct
+{
+    uint8_t state;
+    uint8_t error;
+    uint8_t step;
+    uint32_t job;
+    bool valid;
+    bool apply;
+    bool changed;
+    uint32_t pwr_changes; // esc power changes when the cache was loaded
+    uint8_t cache[ESC_SETTINGS_SIZE];
+    uint8_t buf[ESC_SETTINGS_SIZE];
+    uint8_t changes[ESC_SETTINGS_MAX_CHANGES];
+    uint32_t changes_len;
+} escs;
+
+// the job is over, the esc starts its firmware again
+static void esc_settings_finish(uint8_t error)
+{
+    escs.state = error ? escb_fail : escb_pass;
+    escs.error = error;
+    escs.step = escs_none;
+    esc_boot_release();
+}
+
+static void esc_settings_write(void)
+{
+    const uint8_t *c = escs.changes;
+    const uint8_t *end = &escs.changes[escs.changes_len];
+
+    memcpy(escs.buf, escs.cache, ESC_SETTINGS_SIZE);
+    while (c < end)
+    {
+        memcpy(&escs.buf[c[0]], &c[2], c[1]);
+        c += 2 + c[1];
+    }
+
+    if (memcmp(escs.buf, escs.cache, ESC_SETTINGS_SIZE) == 0)
+    {
+        esc_settings_finish(ESCB_ERR_NONE);
+        return;
+    }
+    escs.step = escs_write;
+    escs.job = 0;
+}
+
+// runs in the esc mode task, the bootloader jobs are started when the engine is free
+void esc_settings_task(void)
+{
+    uint8_t error;
+
+    // another esc may be connected after a power cycle
+    if (escs.pwr_changes != get_escpwr_changes())
+    {
+        escs.pwr_changes = get_escpwr_changes();
+        escs.valid = false;
+    }
+
+    if (escs.step == escs_none)
+        return;
+
+    if (escs.job == 0)
+    {
+        if (!esc_boot_is_free())
+            return;
+        escs.job = escs.step == escs_load ? esc_boot_read(ESC_EEPROM_ADDRESS, escs.buf, ESC_SETTINGS_SIZE)
+                                          : esc_boot_write(ESC_EEPROM_ADDRESS, escs.buf, ESC_SETTINGS_SIZE);
+        if (escs.job == 0)
+            esc_settings_finish(esc_boot_get_error());
+        return;
+    }
+
+    if (!esc_boot_collect(escs.job, &error))
+        return;
+    if (error != ESCB_ERR_NONE)
+    {
+        escs.valid = false;
+        esc_settings_finish(error);
+        return;
+    }
+
+    if (escs.step == escs_load)
+    {
+        memcpy(escs.cache, escs.buf, ESC_SETTINGS_SIZE);
+        escs.valid = true;
+        if (escs.apply)
+            esc_settings_write();
+        else
+            esc_settings_finish(ESCB_ERR_NONE);
+    }
+    else
+    {
+        // written and read back by the bootloader job
+        memcpy(escs.cache, escs.buf, ESC_SETTINGS_SIZE);
+        escs.changed = true;
+        esc_settings_finish(ESCB_ERR_NONE);
+    }
+}
+
+void esc_settings_stop(void)
+{
+    if (escs.step != escs_none)
+    {
+        escs.state = escb_fail;
+        escs.error = ESCB_ERR_ABORT;
+        escs.step = escs_none;
+    }
+    escs.valid = false;
+}
+
+// read the block unless it is cached already
+bool esc_settings_load(bool force)
+{
+    if (escs.state == escb_busy)
+        return false;
+
+    escs.apply = false;
+    escs.changed = false;
+    escs.error = ESCB_ERR_NONE;
+    if (escs.valid && !force)
+    {
+        escs.state = escb_pass;
+        return true;
+    }
+    escs.state = escb_busy;
+    escs.step = escs_load;
+    escs.job = 0;
+    return true;
+}
+
+// changes as (offset u8, len u8, data) ..., checked against the block size
+bool esc_settings_apply(const uint8_t *changes, uint32_t len)
+{
+    const uint8_t *c = changes;
+    const uint8_t *end = &changes[len];
+
+    if (escs.state == escb_busy || len > ESC_SETTINGS_MAX_CHANGES)
+        return false;
+    while (c < end)
+    {
+        if (end - c < 2 || end - c - 2 < c[1] || c[0] + c[1] > ESC_SETTINGS_SIZE)
+            return false;
+        c += 2 + c[1];
+    }
+
+    memcpy(escs.changes, changes, len);
+    escs.changes_len = len;
+    escs.apply = true;
+    escs.changed = false;
+    escs.error = ESCB_ERR_NONE;
+    escs.state = escb_busy;
+    if (escs.valid)
+    {
+        esc_settings_write();
+    }
+    else
+    {
+        escs.step = escs_load;
+        escs.job = 0;
+    }
+    return true;
+}
+
+// cached block, NULL if it was not read since the last power cycle
+const uint8_t *esc_settings_get(void)
+{
+    return escs.valid ? escs.cache : NULL;
+}
+
+uint8_t esc_settings_get_state(void)
+{
+    return escs.state;
+}
+
+uint8_t esc_settings_get_error(void)
+{
+    return escs.error;
+}
+
+// the last apply wrote the block
+bool esc_settings_changed(void)
+{
+    return escs.changed;
+}
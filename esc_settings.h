@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_ESC_SETTINGS_H_)
+#define _ESC_SETTINGS_H_
+
+#include <tusb.h>
+
+#include "esc_boot.h"
+
+/*
+ * Device side copy of the ESC settings. The block at ESC_EEPROM_ADDRESS is
+ * read once per ESC power cycle, a profile of changes is applied to the
+ * copy and the block is only written if the result differs. The write is
+ * read back and compared by the bootloader job.
+ */
+
+/*! @brief Size of the settings block, one bootloader chunk
+ */
+#ifndef ESC_SETTINGS_SIZE
+#define ESC_SETTINGS_SIZE 256
+#endif
+
+// changes of one apply as (offset u8, len u8, data) ...
+#define ESC_SETTINGS_MAX_CHANGES 250
+
+void esc_settings_task(void);
+void esc_settings_stop(void);
+bool esc_settings_load(bool force);
+bool esc_settings_apply(const uint8_t *changes, uint32_t len);
+const uint8_t *esc_settings_get(void);
+uint8_t esc_settings_get_state(void);
+uint8_t esc_settings_get_error(void);
+bool esc_settings_changed(void);
+
+#endif /* _ESC_SETTINGS_H_ */
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <pico/stdlib.h>
+
+#include "esc_line.h"
+#include "input.h"
+#include "user_gpio.h"
+
+#define INPUT_MASK (INPUT_QUEUE_SIZE - 1)
+#define INPUT_EDGES (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)
+
+typedef struct
+{
+    uint gpio;
+    bool active_low;
+    uint32_t debounce_us;
+    uint8_t ev_active;  // event of a change to active
+    uint8_t ev_inactive;
+    volatile uint8_t level;// debounced, 1 active
+    bool known;         // the last change was seen, len_us is valid
+    uint32_t edge_us;   // first edge of the pending change
+    uint32_t change_us; // last debounced change
+} input_pin_t;
+
+static input_pin_t inputs[in_count] = {
+    [in_button] = {SW_PIN, true, INPUT_BUTTON_DEBOUNCE_US, in_button_down, in_button_up},
+    [in_power] = {ESC_PWR_PIN, false, INPUT_POWER_DEBOUNCE_US, in_power_up, in_power_down},
+};
+
+// written by the interrupts of core 0, read by the main loop
+static input_event_t input_queue[INPUT_QUEUE_SIZE];
+static volatile uint32_t input_head;
+static volatile uint32_t input_tail;
+static uint32_t input_dropped;
+
+static inline uint8_t input_read(const input_pin_t *p)
+{
+    return gpio_get(p->gpio) != p->active_low;
+}
+
+static void input_push(uint8_t type, uint32_t time_us, uint32_t len_us)
+{
+    input_event_t *ev;
+
+    if (input_head - input_tail >= INPUT_QUEUE_SIZE)
+    {
+        input_dropped++;
+        return;
+    }
+    ev = &input_queue[input_head & INPUT_MASK];
+    ev->time_us = time_us;
+    ev->len_us = len_us;
+    ev->type = type;
+    __mem_fence_release();
+    input_head++;
+}
+
+// level after the debounce time, the edges are enabled again
+static int64_t input_debounce(alarm_id_t id, void *user_data)
+{
+    input_pin_t *p = &inputs[(uintptr_t)user_data];
+    uint8_t level = input_read(p);
+
+    if (level != p->level)
+    {
+        p->level = level;
+        input_push(level ? p->ev_active : p->ev_inactive, p->edge_us, p->known ? p->edge_us - p->change_us : 0);
+        p->change_us = p->edge_us;
+        p->known = true;
+    }
+    gpio_set_irq_enabled(p->gpio, INPUT_EDGES, true);
+    // an edge before the enable is not latched, the level tells
+    if (input_read(p) != p->level)
+    {
+        gpio_set_irq_enabled(p->gpio, INPUT_EDGES, false);
+        p->edge_us = time_us_32();
+        return -(int64_t)p->debounce_us;
+    }
+    return 0;
+}
+
+static void input_irq(void)
+{
+    for (uintptr_t in = 0; in < in_count; in++)
+    {
+        input_pin_t *p = &inputs[in];
+        uint32_t events = gpio_get_irq_event_mask(p->gpio) & INPUT_EDGES;
+
+        if (!events)
+            continue;
+        gpio_set_irq_enabled(p->gpio, INPUT_EDGES, false);
+        gpio_acknowledge_irq(p->gpio, events);
+        p->edge_us = time_us_32();
+        // the bootloader entry does not wait for the debounce
+        if (in == in_power && (events & GPIO_IRQ_EDGE_RISE))
+            esc_line_power_edge();
+        // without a free alarm the pin would stay deaf, take the edges again
+        if (add_alarm_in_us(p->debounce_us, input_debounce, (void *)in, true) < 0)
+            gpio_set_irq_enabled(p->gpio, INPUT_EDGES, true);
+    }
+}
+
+// core 0, after the pins are initialized
+void input_init(void)
+{
+    for (uint32_t in = 0; in < in_count; in++)
+    {
+        inputs[in].level = input_read(&inputs[in]);
+        gpio_set_irq_enabled(inputs[in].gpio, INPUT_EDGES, true);
+    }
+    gpio_add_raw_irq_handler_masked((1u << SW_PIN) | (1u << ESC_PWR_PIN), input_irq);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+// oldest event, false if there is none
+bool input_pop(input_event_t *ev)
+{
+    if (input_tail == input_head)
+        return false;
+    __mem_fence_acquire();
+    *ev = input_queue[input_tail & INPUT_MASK];
+    input_tail++;
+    return true;
+}
+
+// debounced level, 1 button pressed or esc power on
+uint8_t input_get_level(uint8_t in)
+{
+    return inputs[in].level;
+}
+
+uint32_t input_get_dropped(void)
+{
+    return input_dropped;
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_INPUT_H_)
+#define _INPUT_H_
+
+#include <tusb.h>
+
+/*
+ * Button and ESC power input. An edge interrupt takes the time of the first
+ * edge and disables the edges of the pin, a timer alarm reads the level after
+ * the debounce time. A changed level is queued as event with the time of its
+ * first edge, a button release carries the length of the press. The times do
+ * not depend on the main loop, the pins are not polled.
+ */
+
+/*! @brief Debounce time of the push button in micro seconds
+ */
+#ifndef INPUT_BUTTON_DEBOUNCE_US
+#define INPUT_BUTTON_DEBOUNCE_US 20000
+#endif
+
+/*! @brief Debounce time of the ESC power input in micro seconds
+ */
+#ifndef INPUT_POWER_DEBOUNCE_US
+#define INPUT_POWER_DEBOUNCE_US 5000
+#endif
+
+// events in the queue, power of 2
+#define INPUT_QUEUE_SIZE 16
+
+// inputs
+#define in_button 0
+#define in_power 1
+#define in_count 2
+
+// events
+#define in_button_down 0
+#define in_button_up 1
+#define in_power_up 2
+#define in_power_down 3
+
+typedef struct
+{
+    uint32_t time_us;// first edge of the change
+    uint32_t len_us; // time in the previous state, 0 if unknown
+    uint8_t type;
+} input_event_t;
+
+void input_init(void);
+bool input_pop(input_event_t *ev);
+uint8_t input_get_level(uint8_t in);
+uint32_t input_get_dropped(void);
+
+#endif /* _INPUT_H_ */
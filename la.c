@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/pio.h>
+#include <hardware/structs/io_bank0.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "la.h"
+#include "la.pio.h"
+#include "user_gpio.h"
+
+/*! @brief Records converted per call of the task
+ */
+#ifndef LA_BATCH
+#define LA_BATCH 256
+#endif
+
+#define LA_RING_MASK (LA_RING_WORDS - 1)
+#define LA_RECORD_BYTES 5
+
+// pio timing, see la.pio
+#define LA_COUNT_START 0x0fffffff
+#define LA_LOOP_CYCLES 7
+#define LA_FIRST_CYCLES 6
+#define LA_CHANGE_CYCLES 13
+#define LA_OVERFLOW_CYCLES 16
+
+typedef struct
+{
+    uint8_t level;
+    uint32_t time;
+} la_pwr_t;
+
+// the dma write ring has to be aligned to its size
+static uint32_t la_ring[LA_RING_WORDS] __attribute__((aligned(1u << LA_RING_BITS)));
+
+static struct
+{
+    uint8_t state;
+    bool claimed;
+    bool running;
+    uint sm;
+    uint offset;
+    uint dma;
+    uint8_t flags;
+    uint8_t mask;
+    uint8_t value;
+    uint8_t invert;    // channels read through an input inversion, undone for the host
+    uint16_t pre;
+    uint16_t post;
+    uint16_t div;
+    uint32_t clk_hz;
+    uint64_t start_us;
+    uint32_t rd;       // next word for the host
+    uint32_t proc;     // next word to convert
+    uint32_t post_cnt;
+    uint32_t t_next;   // pio time of the next sample
+    uint32_t trig_time;
+    uint8_t last;      // sample of the last converted record
+    uint8_t level;     // sample before the record at rd
+    la_pwr_t pwr[LA_PWR_RECORDS];
+    uint32_t pwr_head;
+    uint32_t pwr_tail;
+    bool pwr_level;
+} la;
+
+// words written by the dma since the start
+static inline uint32_t la_written(void)
+{
+    return 0xffffffff - dma_hw->ch[la.dma].transfer_count;
+}
+
+static inline uint8_t la_sample(uint32_t word)
+{
+    return (((word & 0x80000000) ? ~word : word) & 3) ^ la.invert;
+}
+
+// the uart modes invert the rx input (GPIO13) but not the tx pin, the pio sees the pins after the override
+static uint8_t la_inverted(void)
+{
+    uint8_t invert = 0;
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        uint32_t over = (io_bank0_hw->io[LA_PIN_BASE + i].ctrl & IO_BANK0_GPIO0_CTRL_INOVER_BITS) >>
+                        IO_BANK0_GPIO0_CTRL_INOVER_LSB;
+
+        if (over == GPIO_OVERRIDE_INVERT)
+            invert |= 1u << i;
+    }
+    return invert;
+}
+
+static void la_halt(void)
+{
+    if (!la.running)
+        return;
+    pio_sm_set_enabled(pio0, la.sm, false);
+    dma_channel_abort(la.dma);
+    la.running = false;
+}
+
+// keeps the last changes, the oldest one is dropped when the ring is full
+static void la_pwr_sample(bool force)
+{
+    bool level = get_escpower();
+    la_pwr_t *p;
+
+    if (!force && level == la.pwr_level)
+        return;
+    la.pwr_level = level;
+    if (la.pwr_head - la.pwr_tail == LA_PWR_RECORDS)
+        la.pwr_tail++;
+    p = &la.pwr[la.pwr_head++ % LA_PWR_RECORDS];
+    p->level = level;
+    p->time = (uint32_t)((time_us_64() - la.start_us) * la.clk_hz / 1000000 / la.div);
+}
+
+// counter to time in place, trigger and post trigger count
+static void la_convert(void)
+{
+    uint32_t *r = &la_ring[la.proc & LA_RING_MASK];
+    uint32_t t = la.t_next + LA_LOOP_CYCLES * (LA_COUNT_START - r[1]);
+    uint8_t s;
+
+    r[1] = t;
+    la.proc += 2;
+    if (r[0] & 0x80000000)
+    {
+        la.t_next = t + LA_OVERFLOW_CYCLES;
+        return;
+    }
+    la.t_next = t + LA_CHANGE_CYCLES;
+
+    s = la_sample(r[0]);
+    if (la.state == la_armed)
+    {
+        if ((s & la.mask) == la.value && (la.last & la.mask) != la.value)
+        {
+            la.state = la_triggered;
+            la.trig_time = t;
+        }
+    }
+    else if (la.post != 0 && ++la.post_cnt >= la.post)
+    {
+        la_halt();
+        la.state = la_done;
+    }
+    la.last = s;
+}
+
+static void la_process(uint32_t max)
+{
+    uint32_t written = la_written();
+
+    // the dma has overwritten records the host did not read
+    if (written - la.rd > LA_RING_WORDS - 2)
+    {
+        la_halt();
+        la.state = la_overrun;
+        return;
+    }
+
+    for (uint32_t n = 0; n < max && written - la.proc >= 2; n++)
+    {
+        if (la.state != la_armed && la.state != la_triggered)
+            break;
+        la_convert();
+        // pre trigger records beyond pre are dropped
+        if (la.state == la_armed && la.proc - la.rd > 2u * la.pre)
+        {
+            la.level = la_sample(la_ring[la.rd & LA_RING_MASK]);
+            la.rd += 2;
+        }
+    }
+}
+
+// trigger when the masked sample changes to value, mask 0 starts at once, post 0 runs until stopped
+bool la_start(uint8_t flags, uint8_t mask, uint8_t value, uint16_t pre, uint16_t post, uint16_t div)
+{
+    pio_sm_config c;
+    dma_channel_config dc;
+
+    if (div == 0 || (mask & ~3) || (value & ~mask) || pre > LA_RING_WORDS / 4)
+        return false;
+
+    if (!la.claimed)
+    {
+        la.offset = pio_add_program(pio0, &la_rle_program);
+        la.sm = pio_claim_unused_sm(pio0, true);
+        la.dma = dma_claim_unused_channel(true);
+        la.claimed = true;
+    }
+    la_halt();
+
+    la.flags = flags;
+    la.mask = mask;
+    la.value = value;
+    la.pre = pre;
+    la.post = post;
+    la.div = div;
+    la.clk_hz = clock_get_hz(clk_sys);
+    la.rd = 0;
+    la.proc = 0;
+    la.post_cnt = 0;
+    la.t_next = LA_FIRST_CYCLES;
+    la.trig_time = 0;
+    // both channels are reported with the pad level, the pio starts from a low sample
+    la.invert = la_inverted();
+    la.last = la.invert;
+    la.level = la.invert;
+    la.pwr_head = 0;
+    la.pwr_tail = 0;
+    la.state = mask ? la_armed : la_triggered;
+
+    c = la_rle_program_get_default_config(la.offset);
+    sm_config_set_in_pins(&c, LA_PIN_BASE);
+    sm_config_set_in_shift(&c, false, false, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv_int_frac(&c, div, 0);
+    pio_sm_init(pio0, la.sm, la.offset + la_rle_offset_start, &c);
+    // the first sample is a change unless both pins are low
+    pio_sm_exec(pio0, la.sm, pio_encode_mov(pio_x, pio_null));
+
+    dc = dma_channel_get_default_config(la.dma);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, true);
+    channel_config_set_ring(&dc, true, LA_RING_BITS);
+    channel_config_set_dreq(&dc, pio_get_dreq(pio0, la.sm, false));
+    dma_channel_configure(la.dma, &dc, la_ring, &pio0->rxf[la.sm], 0xffffffff, true);
+
+    la.start_us = time_us_64();
+    pio_sm_set_enabled(pio0, la.sm, true);
+    la.running = true;
+    if (flags & LA_FLAG_POWER)
+        la_pwr_sample(true);
+    return true;
+}
+
+// records captured so far stay readable
+void la_stop(void)
+{
+    if (!la.running)
+        return;
+    la_halt();
+    la_process(LA_RING_WORDS / 2);
+    if (la.state == la_armed || la.state == la_triggered)
+        la.state = la_done;
+}
+
+// main loop, all modes
+void la_task(void)
+{
+    if (!la.running)
+        return;
+    if (la.flags & LA_FLAG_POWER)
+        la_pwr_sample(false);
+    la_process(LA_BATCH);
+}
+
+uint8_t la_get_state(void)
+{
+    return la.state;
+}
+
+static uint32_t la_available(void)
+{
+    if (la.state == la_idle || la.state == la_armed)
+        return 0;
+    return (la.proc - la.rd) / 2 + la.pwr_head - la.pwr_tail;
+}
+
+static uint8_t rpc_la_start(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 9)
+        return RPC_ERR_ARGS;
+    if (!la_start(arg[0], arg[1], arg[2], rpc_get_u16(&arg[3]), rpc_get_u16(&arg[5]), rpc_get_u16(&arg[7])))
+        return RPC_ERR_RANGE;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_la_stop(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    la_stop();
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_la_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 14))
+        return RPC_ERR_NOSPACE;
+    *p++ = la.state;
+    *p++ = la.level;
+    p = rpc_put_u16(p, la_available());
+    p = rpc_put_u32(p, la.trig_time);
+    p = rpc_put_u32(p, la.clk_hz);
+    rpc_put_u16(p, la.div);
+    return RPC_OK;
+}
+
+// power records first, then the line records in order
+static uint8_t rpc_la_read(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint32_t n = *rsp_len / LA_RECORD_BYTES;
+    uint8_t *p = rsp;
+    const la_pwr_t *pwr;
+    const uint32_t *r;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (la_available() == 0)
+        n = 0;
+
+    while (n && la.pwr_tail != la.pwr_head)
+    {
+        pwr = &la.pwr[la.pwr_tail++ % LA_PWR_RECORDS];
+        *p++ = LA_REC_POWER | pwr->level;
+        p = rpc_put_u32(p, pwr->time);
+        n--;
+    }
+    while (n && la.rd != la.proc)
+    {
+        r = &la_ring[la.rd & LA_RING_MASK];
+        la.level = la_sample(r[0]);
+        *p++ = ((r[0] & 0x80000000) ? LA_REC_OVERFLOW : 0) | la.level;
+        p = rpc_put_u32(p, r[1]);
+        la.rd += 2;
+        n--;
+    }
+    *rsp_len = p - rsp;
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_la_cmds[] = {
+    {RPC_OP_LA_START, rpc_la_start},
+    {RPC_OP_LA_STOP, rpc_la_stop},
+    {RPC_OP_LA_STATUS, rpc_la_status},
+    {RPC_OP_LA_READ, rpc_la_read},
+};
+const uint32_t rpc_la_cmds_count = count_of(rpc_la_cmds);
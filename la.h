@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_LA_H_)
+#define _LA_H_
+
+#include <tusb.h>
+
+#include "rpc.h"
+
+/*
+ * Logic analyser on the one-wire line. A pio state machine samples GPIO12
+ * (tx) and GPIO13 (rx) every 7 pio cycles and pushes a record only when the
+ * level changes, dma moves the records into a ring. Records are run length
+ * coded in the ring and converted in place:
+ *
+ *   word 0  sample (bits 0-1), ~sample for a counter overflow (bit 31 set)
+ *   word 1  down counter from the pio, replaced by the time in pio cycles
+ *
+ * ESC power is sampled by the cpu in the main loop with loop resolution.
+ */
+
+/*! @brief First of the two sampled pins, the one-wire tx pin and rx on the next one
+ */
+#ifndef LA_PIN_BASE
+#define LA_PIN_BASE 12
+#endif
+
+/*! @brief Record ring size as power of 2 in bytes, 8 bytes per record
+ */
+#ifndef LA_RING_BITS
+#define LA_RING_BITS 13
+#endif
+
+/*! @brief Number of ESC power changes kept for the host
+ */
+#ifndef LA_PWR_RECORDS
+#define LA_PWR_RECORDS 32
+#endif
+
+#define LA_RING_WORDS ((1u << LA_RING_BITS) / 4)
+
+// capture state
+#define la_idle 0
+#define la_armed 1
+#define la_triggered 2
+#define la_done 3
+#define la_overrun 4
+
+// start flags
+#define LA_FLAG_POWER 0x01
+
+// record flags sent to the host
+#define LA_REC_OVERFLOW 0x80
+#define LA_REC_POWER 0x40
+
+bool la_start(uint8_t flags, uint8_t mask, uint8_t value, uint16_t pre, uint16_t post, uint16_t div);
+void la_stop(void);
+void la_task(void);
+uint8_t la_get_state(void);
+
+extern const rpc_cmd_t rpc_la_cmds[];
+extern const uint32_t rpc_la_cmds_count;
+
+#endif /* _LA_H_ */
@@ -13,29 +13,172 @@
 #include <string.h>
 #include <tusb.h>
 
-#include "rc.h"
+#include "ab_update.h"
+#include "cfg.h"
+#include "diag.h"
+#include "esc_line.h"
+#include "la.h"
+#include "mem.h"
+#include "modes.h"
+#include "prof.h"
+#include "rpc.h"
+#include "sniff.h"
+#include "tlog.h"
 #include "uart_bridge.h"
 #include "usb_descriptors.h"
 #include "user_gpio.h"
+#include "watch.h"
 
 
+// running and requested operating mode
+static uint8_t opmode;
+static volatile uint8_t next_opmode;
+
+static const opmode_ops_t *const opmode_ops[] = {
+    [opmode_esc] = &mode_esc_ops,
+    [opmode_rec] = &mode_rec_ops,
+    [opmode_servo] = &mode_servo_ops,
+    [opmode_bench] = &mode_bench_ops,
+    [opmode_relay] = &mode_relay_ops,
+};
+
+static uint8_t rpc_info(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (!rpc_room(rsp_len, 4))
+        return RPC_ERR_NOSPACE;
+    rsp[0] = RPC_VERSION;
+    rsp[1] = opmode;
+    rpc_put_u16(&rsp[2], RPC_MAX_FRAME);
+    return RPC_OK;
+}
+
+// the switch is done in the main loop after the response is queued
+static uint8_t rpc_mode_set(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 1)
+        return RPC_ERR_ARGS;
+    if (arg[0] != opmode_esc && arg[0] != opmode_rec && arg[0] != opmode_servo && arg[0] != opmode_bench &&
+        arg[0] != opmode_relay)
+        return RPC_ERR_RANGE;
+    next_opmode = arg[0];
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// boot trace as (time u32, name length u8, name) per stage
+static uint8_t rpc_boot_trace(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    diag_boot_mark_t marks[2 * DIAG_BOOT_MAX];
+    uint32_t n;
+    uint32_t len;
+    uint32_t pos = 0;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    n = diag_boot_get(marks, count_of(marks));
+    for (uint32_t i = 0; i < n; i++)
+    {
+        len = strlen(marks[i].stage);
+        if (pos + 5 + len > *rsp_len)
+            return RPC_ERR_NOSPACE;
+        rpc_put_u32(&rsp[pos], marks[i].time_us);
+        rsp[pos + 4] = len;
+        memcpy(&rsp[pos + 5], marks[i].stage, len);
+        pos += 5 + len;
+    }
+    *rsp_len = pos;
+    return RPC_OK;
+}
+
+static uint8_t rpc_cfg_get(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 1)
+        return RPC_ERR_ARGS;
+    if (arg[0] >= CFG_COUNT)
+        return RPC_ERR_RANGE;
+    if (!rpc_room(rsp_len, 4))
+        return RPC_ERR_NOSPACE;
+    rpc_put_u32(rsp, cfg_get(arg[0]));
+    return RPC_OK;
+}
+
+// values are used from the next start of a mode, commit to keep them
+static uint8_t rpc_cfg_set(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 5)
+        return RPC_ERR_ARGS;
+    if (!cfg_set(arg[0], rpc_get_u32(&arg[1])))
+        return RPC_ERR_RANGE;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_cfg_commit(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!cfg_commit())
+        return RPC_ERR_STATE;
+    if (!rpc_room(rsp_len, 4))
+        return RPC_ERR_NOSPACE;
+    rpc_put_u32(rsp, cfg_get_seq());
+    return RPC_OK;
+}
+
+static uint8_t rpc_cfg_reset(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    cfg_reset();
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static const rpc_cmd_t rpc_common_cmds[] = {
+    {RPC_OP_INFO, rpc_info},
+    {RPC_OP_MODE_SET, rpc_mode_set},
+    {RPC_OP_BOOT_TRACE, rpc_boot_trace},
+    {RPC_OP_CFG_GET, rpc_cfg_get},
+    {RPC_OP_CFG_SET, rpc_cfg_set},
+    {RPC_OP_CFG_COMMIT, rpc_cfg_commit},
+    {RPC_OP_CFG_RESET, rpc_cfg_reset},
+};
+
+// usb is configured by the host
+void tud_mount_cb(void)
+{
+    diag_boot_mark("usb mounted");
+}
+
 // main program core 1
 void core1_entry(void)
 {
     int con;
 
+    // core 0 holds core 1 while it writes the flash
+    multicore_lockout_victim_init();
+    prof_init_core();
     tusb_init();
+    diag_boot_mark("tusb init");
 
     while (1)
     {
+        watch_loop(1);
+        watch_step(1, watch_st_usb);
         tud_task();
 
         con = 0;
         if (tud_cdc_n_connected(0))
         {
             con = 1;
+            watch_step(1, watch_st_cdc);
             usb_cdc_process();
         }
+        if (tud_cdc_n_connected(RPC_ITF))
+        {
+            watch_step(1, watch_st_rpc_usb);
+            rpc_usb_process();
+        }
 
         gpio_put(LED_PIN_RED, con);
     }
@@ -44,31 +187,50 @@ void core1_entry(void)
 // main program core 0
 int main(void)
 {
-    const uint32_t looptime = 10;
-    const uint32_t pwrupdlytime = 3 * 1000 / looptime;
-    const uint32_t pwmupdatetime = 200 * 1000 / looptime;
-    const uint32_t recvupdatetime = 100 * 1000 / looptime;
-    const uint32_t msgupdatetime = 1000 * 1000 / looptime;
-    static uint32_t state;
-    uint32_t pulse;
-    uint32_t angle;
-    bool update_angle;
-    bool update_print_angle;
-    bool escpower;
-    uint32_t escpower_cnt;
-    uint8_t opmode;
-    uint8_t print_buf[BUFFER_SIZE];
-    uint32_t print_buf_pos;
-    uint8_t stdin_buf[BUFFER_SIZE];
-    uint32_t stdin_buf_pos;
+    bool boot_print;
+    uint8_t button = bt_undev;
     uint32_t x;
-    rc_servo Servo1;
 
+    // before anything runs deep on the stacks
+    mem_init();
+    // the record of the last run before it is reused
+    watch_init();
+    diag_boot_mark("main");
+    cfg_init();
+    diag_boot_mark("cfg load");
+#if USBLINK_AB_UPDATE
+    ab_init();
+#endif
+
+    // usb first, nothing on core 0 may delay the enumeration
+    usbd_serial_init();
+    init_uart_data();
+    sniff_init();
+    esc_line_init();
+    rpc_init();
+    rpc_register(rpc_common_cmds, count_of(rpc_common_cmds));
+    rpc_register(rpc_esc_cmds, rpc_esc_cmds_count);
+    rpc_register(rpc_la_cmds, rpc_la_cmds_count);
+    rpc_register(rpc_sniff_cmds, rpc_sniff_cmds_count);
+    rpc_register(rpc_tlog_cmds, rpc_tlog_cmds_count);
+    rpc_register(rpc_prof_cmds, rpc_prof_cmds_count);
+    rpc_register(rpc_mem_cmds, rpc_mem_cmds_count);
+    rpc_register(rpc_bridge_cmds, rpc_bridge_cmds_count);
+    rpc_register(rpc_line_cmds, rpc_line_cmds_count);
+    rpc_register(rpc_watch_cmds, rpc_watch_cmds_count);
+#if USBLINK_AB_UPDATE
+    rpc_register(rpc_ab_cmds, rpc_ab_cmds_count);
+#endif
+    prof_init_core();
+    // start core 1, usb stays up while the modes are switched
+    multicore_launch_core1(core1_entry);
+    diag_boot_mark("core1 launched");
 
     // init gpio but not uart pins
     init_gpio();
+    diag_boot_mark("gpio init");
 
-    if (watchdog_enable_caused_reboot())
+    if (!QUIET_BOOT && watchdog_enable_caused_reboot())
     {
         for (x = 0; x < 3; x++)
         {
@@ -78,334 +240,76 @@ int main(void)
             sleep_ms(450);
         }
         set_onboard_led(1);
+        diag_boot_mark("reboot blink");
     }
     // start watchdog
     watchdog_enable(500, 1);
 
     // check for push button to select operation mode
-    opmode = opmode_select();
+    opmode = opmode_select(cfg_get(CFG_BOOT_MODE));
+    next_opmode = opmode;
+    watch_set_mode(opmode);
+    diag_boot_mark("mode select");
 
     watchdog_update();
-    // esc programmer
-    if (opmode == opmode_esc)
+    mem_reset();
+    opmode_ops[opmode]->start();
+    diag_boot_mark("mode start");
+    boot_print = (opmode != opmode_esc);
+    while (1)
     {
-        usbd_serial_init();
-        init_uart_data();
-        init_uart_hw();
-        // start core 1
-        multicore_launch_core1(core1_entry);
-
-        escpower_cnt = 0;
-        while (1)
+        watchdog_update();
+        watch_loop(0);
+        watch_step(0, watch_st_uart_cfg);
+        update_uart_cfg();
+        watch_step(0, watch_st_rpc);
+        rpc_task();
+        watch_step(0, watch_st_la);
+        la_task();
+
+        if (next_opmode != opmode)
         {
-            watchdog_update();
-            update_uart_cfg();
-            uart_write_bytes();
-            escpower = ceck_escpwr();
-
-            if (escpower == 0)
-            {
-                escpower_cnt++;
-                if (escpower_cnt > msgupdatetime)
-                {
-                    dbg_print_usb("Switch power on\n");
-                    escpower_cnt = 0;
-                }
-            }
-
-            sleep_us(looptime);
-            if (check_button_event() == bt_evtup_long)
-            {
-                if (escpower == 0)
-                {
-                    dbg_print_usb("Going down esc progrmmer\n");
-                }
-                trigger_reset();
-            }
+            watch_step(0, watch_st_mode_switch);
+            opmode_ops[opmode]->stop();
+            TLOG(mode_switch, opmode, next_opmode);
+            opmode = next_opmode;
+            watch_set_mode(opmode);
+            mem_reset();
+            opmode_ops[opmode]->start();
         }
-        return 0;
-    }
-    // reciever mode
-    else if (opmode == opmode_rec)
-    {
-        usbd_serial_init();
-
-        init_uart_data();
 
-        // start core 1
-        multicore_launch_core1(core1_entry);
+        watch_step(0, watch_st_mode_task);
+        opmode_ops[opmode]->task(button);
 
-        escpower_cnt = 0;
-        state = 0;
-        memset(stdin_buf, 0, sizeof(stdin_buf));
-        while (1)
+        // trace on the console, but not into the esc configurator
+        if (boot_print && tud_mounted())
         {
-            watchdog_update();
-            update_uart_cfg();
-            dbg_read_usb(stdin_buf);
-            escpower = ceck_escpwr();
-
-            switch (state)
-            {
-                case 0:
-                    gpio_init(SERV_CH1_PIN);
-                    gpio_set_dir(SERV_CH1_PIN, GPIO_OUT);
-                    gpio_put(SERV_CH1_PIN, 0);
-                    rc_init_input(RECV_CH1_PIN, true);
-                    escpower_cnt = 0;
-                    state = 1;
-                    break;
-                case 1:
-                    if (escpower)
-                    {
-                        escpower_cnt = 0;
-                        state = 2;
-                    }
-                    else
-                    {
-                        escpower_cnt++;
-                        if (escpower_cnt > msgupdatetime)
-                        {
-                            dbg_print_usb("Switch power on\n");
-                            escpower_cnt = 0;
-                        }
-                    }
-                    break;
-                case 2:
-                    if (escpower)
-                    {
-                        escpower_cnt++;
-                        if (escpower_cnt > pwrupdlytime)
-                        {
-                            rc_reset_input_pulse_width(RECV_CH1_PIN);
-                            dbg_print_usb("Start reading pulses\n");
-                            escpower_cnt = 0;
-                            state = 3;
-                        }
-                    }
-                    else
-                    {
-                        dbg_print_usb("Power is off\n");
-                        escpower_cnt = 0;
-                        state = 4;
-                    }
-                    break;
-                case 3:
-                    if (escpower)
-                    {
-                        escpower_cnt++;
-                        if (escpower_cnt > recvupdatetime)
-                        {
-                            // Read input from RC receiver - that is pulse width on input pin.
-                            pulse = rc_get_input_pulse_width(RECV_CH1_PIN);
-                            sprintf(print_buf, "Pulse ch1 = %lu\n", pulse);
-                            dbg_print_usb(print_buf);
-                            escpower_cnt = 0;
-                        }
-                    }
-                    else
-                    {
-                        dbg_print_usb("Power is off\n");
-                        escpower_cnt = 0;
-                        state = 4;
-                    }
-                    break;
-                case 4:
-                    if (escpower)
-                    {
-                        dbg_print_usb("Power is on again\n");
-                        escpower_cnt = 0;
-                        state = 2;
-                    }
-                    break;
-                default:
-                    break;
-            }
-
-            sleep_us(looptime);
-            if (check_button_event() == bt_evtup_long)
-            {
-                dbg_print_usb("Going down receiver test\n");
-                trigger_reset();
-            }
+            boot_print = 0;
+            diag_boot_print();
         }
-        return 0;
-    }
-    // servo mode
-    else if (opmode == opmode_servo)
-    {
-        usbd_serial_init();
-
-        init_uart_data();
 
-        // start core 1
-        multicore_launch_core1(core1_entry);
-
-        angle = 90;
-        update_angle = 0;
-        escpower_cnt = 0;
-        state = 0;
-        memset(stdin_buf, 0, sizeof(stdin_buf));
-        while (1)
+        watch_step(0, watch_st_sleep);
+        sleep_us(MODE_LOOPTIME);
+        button = check_button_event();
+        if (button == bt_evtup_long)
         {
-            watchdog_update();
-            update_uart_cfg();
-            dbg_read_usb(stdin_buf);
-            escpower = ceck_escpwr();
-
-            stdin_buf_pos = 0;
-            while (stdin_buf[stdin_buf_pos] && stdin_buf_pos < sizeof(stdin_buf))
-            {
-                if (stdin_buf[stdin_buf_pos] == '+')
-                {
-                    if (angle < 180)
-                    {
-                        angle++;
-                        update_angle = 1;
-                    }
-                    update_print_angle = 1;
-                }
-                else if (stdin_buf[stdin_buf_pos] == '-')
-                {
-                    if (angle > 0)
-                    {
-                        angle--;
-                        update_angle = 1;
-                    }
-                    update_print_angle = 1;
-                }
-                else if (stdin_buf[stdin_buf_pos] == 'o')
-                {
-                    angle = 180;
-                    update_angle = 1;
-                    update_print_angle = 1;
-                }
-                else if (stdin_buf[stdin_buf_pos] == 'k')
-                {
-                    angle = 90;
-                    update_angle = 1;
-                    update_print_angle = 1;
-                }
-                else if (stdin_buf[stdin_buf_pos] == 'm')
-                {
-                    angle = 0;
-                    update_angle = 1;
-                    update_print_angle = 1;
-                }
-                stdin_buf[stdin_buf_pos] = 0;
-                stdin_buf_pos++;
-            }
-
-            if (update_print_angle)
-            {
-                update_print_angle = 0;
-                sprintf(print_buf, "Set ch1 = %lu deg\n", angle);
-                dbg_print_usb(print_buf);
-            }
-
-            switch (state)
-            {
-                case 0:
-                    if (escpower)
-                    {
-                        escpower_cnt++;
-                        if (escpower_cnt > msgupdatetime)
-                        {
-                            dbg_print_usb("Switch power off first\n");
-                            escpower_cnt = 0;
-                        }
-                    }
-                    else
-                    {
-                        state = 1;
-                    }
-                    break;
-                case 1:// init wait for power up
-                    if (escpower)
-                    {
-                        dbg_print_usb("Init PWM\n");
-                        Servo1 = rc_servo_init(SERV_CH1_PIN);
-                        rc_init_input(RECV_CH1_PIN, true);
-                        escpower_cnt = 0;
-                        state = 2;
-                    }
-                    break;
-                case 2:// power up delay
-                    if (escpower)
-                    {
-                        escpower_cnt++;
-                        if (escpower_cnt > pwrupdlytime)
-                        {
-                            rc_servo_start(&Servo1, angle);// set servo1 start degrees
-                            sprintf(print_buf, "Start ch1 = %lu deg\n", angle);
-                            dbg_print_usb(print_buf);
-                            escpower_cnt = 0;
-                            state = 3;
-                        }
-                    }
-                    else
-                    {
-                        dbg_print_usb("Power is off\n");
-                        escpower_cnt = 0;
-                        state = 4;
-                    }
-                    break;
-                case 3:
-                    if (escpower)
-                    {
-                        escpower_cnt++;
-                        if (escpower_cnt == pwmupdatetime / 2)
-                        {
-                            // Read input from RC receiver - that is pulse width on input pin.
-                            pulse = rc_get_input_pulse_width(RECV_CH1_PIN);
-                            sprintf(print_buf, "Pulse ch1 = %lu\n", pulse);
-                            dbg_print_usb(print_buf);
-                        }
-
-                        if (escpower_cnt > pwmupdatetime)
-                        {
-                            escpower_cnt = 0;
-                            if (update_angle)
-                            {
-                                update_angle = 0;
-                                rc_servo_set_angle(&Servo1, angle);
-                                sprintf(print_buf, "Write ch1 = %lu deg\n", angle);
-                                dbg_print_usb(print_buf);
-                            }
-                        }
-                    }
-                    else
-                    {
-                        rc_servo_stop(&Servo1, true);
-                        dbg_print_usb("Power is off\n");
-                        escpower_cnt = 0;
-                        state = 4;
-                    }
-                    break;
-                case 4:
-                    if (escpower)
-                    {
-                        dbg_print_usb("Restart without init PWM\n");
-                        escpower_cnt = 0;
-                        state = 2;
-                    }
-                    break;
-                default:
-                    break;
-            }
-
-            sleep_us(looptime);
-            if (check_button_event() == bt_evtup_long)
-            {
-                dbg_print_usb("Going down servo test\n");
-                trigger_reset();
-            }
+            TLOG(mode_reset, opmode);
+            // the watchdog reset that follows is requested
+            watch_step(0, watch_st_reset);
+            opmode_ops[opmode]->stop();
+            trigger_reset();
         }
-        return 0;
-    }
-    // should never get here
-    else
-    {
-        return 0;
+#if USBLINK_AB_UPDATE
+        // restart into the boot selector after a firmware switch
+        if (ab_task())
+        {
+            watch_step(0, watch_st_reset);
+            opmode_ops[opmode]->stop();
+            watchdog_reboot(0, 0, 10);
+            while (1)
+                tight_loop_contents();
+        }
+#endif
     }
+    return 0;
 }
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+
+#include "mem.h"
+
+#define MEM_STACK_PATTERN 0xdeadbeef
+// words below the live frame of main that are not painted
+#define MEM_STACK_MARGIN 16
+
+// stacks of core 0 and core 1 from the linker script
+extern uint32_t __StackBottom[];
+extern uint32_t __StackTop[];
+extern uint32_t __StackOneBottom[];
+extern uint32_t __StackOneTop[];
+
+static uint8_t __attribute__((aligned(8))) mem_arena[MEM_ARENA_SIZE];
+static uint32_t mem_used;
+static uint32_t mem_peak;
+
+static uint32_t *const mem_stack_bottom[2] = {__StackBottom, __StackOneBottom};
+static uint32_t *const mem_stack_top[2] = {__StackTop, __StackOneTop};
+
+// first thing in main, core 1 is not started yet
+void mem_init(void)
+{
+    uint32_t *sp;
+    uint32_t *p;
+
+    __asm volatile("mov %0, sp" : "=r"(sp));
+    for (p = __StackBottom; p < sp - MEM_STACK_MARGIN; p++)
+    {
+        *p = MEM_STACK_PATTERN;
+    }
+    for (p = __StackOneBottom; p < __StackOneTop; p++)
+    {
+        *p = MEM_STACK_PATTERN;
+    }
+}
+
+// for the running mode, the memory is valid until the next mem_reset
+void *mem_alloc(uint32_t size)
+{
+    void *p;
+
+    size = MEM_ROUND(size);
+    // the arena is too small for a mode, a build error
+    hard_assert(size <= MEM_ARENA_SIZE - mem_used);
+    p = &mem_arena[mem_used];
+    mem_used += size;
+    if (mem_used > mem_peak)
+        mem_peak = mem_used;
+    return p;
+}
+
+// before a mode is started
+void mem_reset(void)
+{
+    mem_used = 0;
+}
+
+uint32_t mem_stack_size(uint core)
+{
+    return (mem_stack_top[core] - mem_stack_bottom[core]) * 4;
+}
+
+// deepest use since boot, the whole size if the stack ran over its bottom
+uint32_t mem_stack_used(uint core)
+{
+    const uint32_t *p = mem_stack_bottom[core];
+
+    while (p < mem_stack_top[core] && *p == MEM_STACK_PATTERN)
+    {
+        p++;
+    }
+    return (mem_stack_top[core] - p) * 4;
+}
+
+static uint8_t rpc_mem_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 28))
+        return RPC_ERR_NOSPACE;
+    p = rpc_put_u32(p, MEM_ARENA_SIZE);
+    p = rpc_put_u32(p, mem_used);
+    p = rpc_put_u32(p, mem_peak);
+    for (uint32_t core = 0; core < 2; core++)
+    {
+        p = rpc_put_u32(p, mem_stack_size(core));
+        p = rpc_put_u32(p, mem_stack_used(core));
+    }
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_mem_cmds[] = {
+    {RPC_OP_MEM_STATUS, rpc_mem_status},
+};
+const uint32_t rpc_mem_cmds_count = count_of(rpc_mem_cmds);
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_MEM_H_)
+#define _MEM_H_
+
+#include <tusb.h>
+
+#include "rc.h"
+#include "rpc.h"
+#include "uart_bridge.h"
+
+/*
+ * RAM budget. Only one operating mode runs at a time, so the buffers of a mode
+ * are taken from an arena in its start function instead of each mode keeping
+ * its own static buffers. The arena is emptied before the next mode starts.
+ * Buffers used in all modes (uart bridge, capture, log) stay static.
+ *
+ * The free part of both stacks is filled with a pattern at boot, the deepest
+ * overwritten word gives the high-water mark.
+ */
+
+// size of an allocation in the arena
+#define MEM_ROUND(size) (((size) + 7) & ~7u)
+
+/*! @brief Arena size in bytes, sized for the servo tester: two console buffers, the
+ *         two words per frame of the playback table and the servo group
+ */
+#ifndef MEM_ARENA_SIZE
+#define MEM_ARENA_SIZE (2 * MEM_ROUND(BUFFER_SIZE) + 2 * MEM_ROUND(RC_PLAY_MAX_POINTS * 4) + \
+                        MEM_ROUND(sizeof(rc_servo_group)))
+#endif
+
+void mem_init(void);
+void *mem_alloc(uint32_t size);
+void mem_reset(void);
+uint32_t mem_stack_size(uint core);
+uint32_t mem_stack_used(uint core);
+
+extern const rpc_cmd_t rpc_mem_cmds[];
+extern const uint32_t rpc_mem_cmds_count;
+
+#endif /* _MEM_H_ */
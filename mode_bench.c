@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <tusb.h>
+
+#include "modes.h"
+#include "uart_bridge.h"
+#include "user_gpio.h"
+
+// bridge benchmark, the programmer data path with the uart in internal loopback,
+// started by rpc only (tools/bench.py)
+static void bench_start(void)
+{
+    init_uart_hw();
+    uart_bridge_loopback(true);
+    set_blue_led(1);
+}
+
+static void bench_task(uint8_t button)
+{
+    uart_write_bytes();
+}
+
+static void bench_stop(void)
+{
+    set_blue_led(0);
+    uart_bridge_loopback(false);
+    deinit_uart_hw();
+}
+
+const opmode_ops_t mode_bench_ops = {
+    .name = "bridge benchmark",
+    .start = bench_start,
+    .task = bench_task,
+    .stop = bench_stop,
+};
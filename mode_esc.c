@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#include "cfg.h"
+#include "esc_boot.h"
+#include "esc_msc.h"
+#include "esc_settings.h"
+#include "modes.h"
+#include "tlog.h"
+#include "uart_bridge.h"
+#include "user_gpio.h"
+
+static uint32_t msgupdatetime;
+static uint32_t escpower_cnt;
+static uint32_t blink_cnt;
+static uint8_t flash_state;
+static bool running;
+
+// rpc handlers, called from rpc_task() in the main loop
+
+// slot u8, size u32, address u32, name
+static uint8_t rpc_img_begin(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len < 9)
+        return RPC_ERR_ARGS;
+    if (esc_boot_is_running() || !uart_bridge_idle())
+        return RPC_ERR_STATE;
+    if (!esc_img_begin(arg[0], rpc_get_u32(&arg[1]), rpc_get_u32(&arg[5]), (const char *)&arg[9], arg_len - 9))
+        return RPC_ERR_RANGE;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// slot u8, offset u32, data
+static uint8_t rpc_img_write(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len < 5)
+        return RPC_ERR_ARGS;
+    if (!uart_bridge_idle() || !esc_img_write(arg[0], rpc_get_u32(&arg[1]), &arg[5], arg_len - 5))
+        return RPC_ERR_STATE;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// slot u8, crc32 u32
+static uint8_t rpc_img_end(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 5)
+        return RPC_ERR_ARGS;
+    if (!uart_bridge_idle() || !esc_img_end(arg[0], rpc_get_u32(&arg[1])))
+        return RPC_ERR_STATE;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// size u32, address u32, crc u32, name of the image in the slot; size 0 if empty
+static uint8_t rpc_img_info(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    const esc_image_t *img;
+    uint32_t len;
+
+    if (arg_len != 1)
+        return RPC_ERR_ARGS;
+    if (arg[0] >= ESC_IMG_SLOTS)
+        return RPC_ERR_RANGE;
+    img = esc_img_get(arg[0]);
+    len = img ? strnlen(img->name, ESC_IMG_NAME_LEN - 1) : 0;
+    if (!rpc_room(rsp_len, 12 + len))
+        return RPC_ERR_NOSPACE;
+    rpc_put_u32(&rsp[0], img ? img->size : 0);
+    rpc_put_u32(&rsp[4], img ? img->address : 0);
+    rpc_put_u32(&rsp[8], img ? img->crc : 0);
+    if (len)
+        memcpy(&rsp[12], img->name, len);
+    return RPC_OK;
+}
+
+// slot u8, diff u8 (optional, esc_flash_diff if missing), only in esc mode
+static uint8_t rpc_esc_flash(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 1 && arg_len != 2)
+        return RPC_ERR_ARGS;
+    if (!running || esc_boot_is_running())
+        return RPC_ERR_STATE;
+    if (esc_img_get(arg[0]) == NULL)
+        return RPC_ERR_RANGE;
+    // power and connection errors are reported by the status
+    esc_boot_start(arg[0], arg_len == 2 ? arg[1] : cfg_get(CFG_ESC_FLASH_DIFF));
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// state u8, error u8, done u32, total u32, written u32
+static uint8_t rpc_esc_flash_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint32_t done;
+    uint32_t total;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 14))
+        return RPC_ERR_NOSPACE;
+    esc_boot_get_progress(&done, &total);
+    rsp[0] = esc_boot_get_state();
+    rsp[1] = esc_boot_get_error();
+    rpc_put_u32(&rsp[2], done);
+    rpc_put_u32(&rsp[6], total);
+    rpc_put_u32(&rsp[10], esc_boot_get_written());
+    return RPC_OK;
+}
+
+// force u8 (optional), reads the settings unless they are cached, only in esc mode
+static uint8_t rpc_esc_set_load(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len > 1)
+        return RPC_ERR_ARGS;
+    if (!running || !esc_settings_load(arg_len && arg[0]))
+        return RPC_ERR_STATE;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// offset u8, len u8 of the cached settings
+static uint8_t rpc_esc_set_get(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    const uint8_t *settings = esc_settings_get();
+
+    if (arg_len != 2)
+        return RPC_ERR_ARGS;
+    if (settings == NULL)
+        return RPC_ERR_STATE;
+    if (arg[0] + arg[1] > ESC_SETTINGS_SIZE)
+        return RPC_ERR_RANGE;
+    if (!rpc_room(rsp_len, arg[1]))
+        return RPC_ERR_NOSPACE;
+    memcpy(rsp, &settings[arg[0]], arg[1]);
+    return RPC_OK;
+}
+
+// (offset u8, len u8, data) ..., written only if the settings change, only in esc mode
+static uint8_t rpc_esc_set_apply(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (!running || esc_settings_get_state() == escb_busy)
+        return RPC_ERR_STATE;
+    if (!esc_settings_apply(arg, arg_len))
+        return RPC_ERR_ARGS;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// state u8, error u8, cached u8, written u8
+static uint8_t rpc_esc_set_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 4))
+        return RPC_ERR_NOSPACE;
+    rsp[0] = esc_settings_get_state();
+    rsp[1] = esc_settings_get_error();
+    rsp[2] = esc_settings_get() != NULL;
+    rsp[3] = esc_settings_changed();
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_esc_cmds[] = {
+    {RPC_OP_IMG_BEGIN, rpc_img_begin},
+    {RPC_OP_IMG_WRITE, rpc_img_write},
+    {RPC_OP_IMG_END, rpc_img_end},
+    {RPC_OP_IMG_INFO, rpc_img_info},
+    {RPC_OP_ESC_FLASH, rpc_esc_flash},
+    {RPC_OP_ESC_FLASH_STATUS, rpc_esc_flash_status},
+    {RPC_OP_ESC_SET_LOAD, rpc_esc_set_load},
+    {RPC_OP_ESC_SET_GET, rpc_esc_set_get},
+    {RPC_OP_ESC_SET_APPLY, rpc_esc_set_apply},
+    {RPC_OP_ESC_SET_STATUS, rpc_esc_set_status},
+};
+const uint32_t rpc_esc_cmds_count = count_of(rpc_esc_cmds);
+
+// esc programmer, usb to one-wire uart bridge
+static void esc_start(void)
+{
+    msgupdatetime = cfg_get(CFG_MSG_UPDATE_MS) * 1000 / MODE_LOOPTIME;
+    init_uart_hw();
+    escpower_cnt = 0;
+    flash_state = escb_idle;
+    running = true;
+#if USBLINK_MSC
+    esc_msc_start();
+#endif
+}
+
+static void esc_task(uint8_t button)
+{
+    uint8_t state;
+
+    // short press flashes the configured image without a pc
+    if (button == bt_evtup_short && !esc_boot_is_running())
+    {
+        TLOG(esc_flash_start, cfg_get(CFG_ESC_IMAGE));
+        esc_boot_start(cfg_get(CFG_ESC_IMAGE), cfg_get(CFG_ESC_FLASH_DIFF));
+    }
+
+    esc_boot_task();
+    // settings and mass storage share the bootloader engine, one job at a time
+    esc_settings_task();
+#if USBLINK_MSC
+    esc_msc_task();
+#endif
+    state = esc_boot_get_state();
+    // the mass storage transfers are not reported
+    if (esc_boot_get_job() == escb_job_image && state != flash_state)
+    {
+        flash_state = state;
+        if (state == escb_pass)
+        {
+            TLOG(esc_flash_ok, esc_boot_get_written());
+        }
+        else if (state == escb_fail)
+        {
+            TLOG(esc_flash_fail, esc_boot_get_error());
+            blink_cnt = 0;
+        }
+    }
+    if (state == escb_busy)
+    {
+        return;
+    }
+    // fast blink until the next try
+    if (flash_state == escb_fail && ++blink_cnt > 100000 / MODE_LOOPTIME)
+    {
+        toggle_blue_led();
+        blink_cnt = 0;
+    }
+
+    uart_write_bytes();
+
+    if (ceck_escpwr() == 0)
+    {
+        escpower_cnt++;
+        if (escpower_cnt > msgupdatetime)
+        {
+            TLOG(esc_power_off);
+            escpower_cnt = 0;
+        }
+    }
+}
+
+static void esc_stop(void)
+{
+    running = false;
+#if USBLINK_MSC
+    esc_msc_stop();
+#endif
+    esc_settings_stop();
+    esc_boot_abort();
+    set_blue_led(0);
+    deinit_uart_hw();
+}
+
+const opmode_ops_t mode_esc_ops = {
+    .name = "esc programmer",
+    .start = esc_start,
+    .task = esc_task,
+    .stop = esc_stop,
+};
@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#include "cfg.h"
+#include "mem.h"
+#include "modes.h"
+#include "rc.h"
+#include "tlog.h"
+#include "uart_bridge.h"
+#include "user_gpio.h"
+
+static const uint32_t pwrupdlytime = 3 * 1000 / MODE_LOOPTIME;
+static uint32_t recvupdatetime;
+static uint32_t msgupdatetime;
+static uint32_t state;
+static uint32_t escpower_cnt;
+// from the mode arena
+static uint8_t *stdin_buf;
+
+// pulse of the receiver input, 0 without signal or if the input is not running
+static uint8_t rpc_recv_get_pulse(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 4))
+        return RPC_ERR_NOSPACE;
+    rpc_put_u32(rsp, rc_get_input_pulse_width(RECV_CH1_PIN));
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_recv_cmds[] = {
+    {RPC_OP_RECV_GET_PULSE, rpc_recv_get_pulse},
+};
+const uint32_t rpc_recv_cmds_count = count_of(rpc_recv_cmds);
+
+// receiver tester
+static void rec_start(void)
+{
+    recvupdatetime = cfg_get(CFG_RECV_UPDATE_MS) * 1000 / MODE_LOOPTIME;
+    msgupdatetime = cfg_get(CFG_MSG_UPDATE_MS) * 1000 / MODE_LOOPTIME;
+    rc_set_input_limits(cfg_get(CFG_RC_MIN_US), cfg_get(CFG_RC_MAX_US));
+    rpc_register(rpc_recv_cmds, rpc_recv_cmds_count);
+    stdin_buf = mem_alloc(BUFFER_SIZE);
+    // drop what was typed for another mode
+    dbg_read_usb(stdin_buf);
+    escpower_cnt = 0;
+    state = 0;
+}
+
+static void rec_task(uint8_t button)
+{
+    bool escpower;
+    uint32_t pulse;
+
+    // the receiver tester has no keys, input is discarded
+    dbg_read_usb(stdin_buf);
+    escpower = ceck_escpwr();
+
+    switch (state)
+    {
+        case 0:
+            gpio_init(SERV_CH1_PIN);
+            gpio_set_dir(SERV_CH1_PIN, GPIO_OUT);
+            gpio_put(SERV_CH1_PIN, 0);
+            rc_init_input(RECV_CH1_PIN, true);
+            escpower_cnt = 0;
+            state = 1;
+            break;
+        case 1:
+            if (escpower)
+            {
+                escpower_cnt = 0;
+                state = 2;
+            }
+            else
+            {
+                escpower_cnt++;
+                if (escpower_cnt > msgupdatetime)
+                {
+                    TLOG(power_on_wait);
+                    escpower_cnt = 0;
+                }
+            }
+            break;
+        case 2:
+            if (escpower)
+            {
+                escpower_cnt++;
+                if (escpower_cnt > pwrupdlytime)
+                {
+                    rc_reset_input_pulse_width(RECV_CH1_PIN);
+                    dbg_print_usb("Start reading pulses\n");
+                    escpower_cnt = 0;
+                    state = 3;
+                }
+            }
+            else
+            {
+                dbg_print_usb("Power is off\n");
+                escpower_cnt = 0;
+                state = 4;
+            }
+            break;
+        case 3:
+            if (escpower)
+            {
+                escpower_cnt++;
+                if (escpower_cnt > recvupdatetime)
+                {
+                    // Read input from RC receiver - that is pulse width on input pin.
+                    pulse = rc_get_input_pulse_width(RECV_CH1_PIN);
+                    TLOG(rec_pulse, pulse);
+                    escpower_cnt = 0;
+                }
+            }
+            else
+            {
+                dbg_print_usb("Power is off\n");
+                escpower_cnt = 0;
+                state = 4;
+            }
+            break;
+        case 4:
+            if (escpower)
+            {
+                dbg_print_usb("Power is on again\n");
+                escpower_cnt = 0;
+                state = 2;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void rec_stop(void)
+{
+    rpc_unregister(rpc_recv_cmds);
+    rc_deinit_input(RECV_CH1_PIN);
+    gpio_init(SERV_CH1_PIN);
+}
+
+const opmode_ops_t mode_rec_ops = {
+    .name = "receiver test",
+    .start = rec_start,
+    .task = rec_task,
+    .stop = rec_stop,
+};
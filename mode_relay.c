@@ -0,0 +1,412 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/gpio.h>
+#include <hardware/pwm.h>
+#include <hardware/sync.h>
+#include <pico/stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#include "cfg.h"
+#include "mem.h"
+#include "modes.h"
+#include "rc.h"
+#include "tlog.h"
+#include "uart_bridge.h"
+#include "user_gpio.h"
+
+#if !defined(MIN)
+#define MIN(a, b) ((a > b) ? b : a)
+#endif /* MIN */
+#if !defined(MAX)
+#define MAX(a, b) ((a > b) ? a : b)
+#endif /* MAX */
+
+/*
+ * Signal relay: the pulses of a receiver are conditioned and sent on to the
+ * esc. Receiver input and esc output share the one-wire signal of the board,
+ * so the receiver is connected to a free pin (CFG_RELAY_IN_PIN) and the
+ * output goes to the one-wire line (SERV_CH1_PIN).
+ *
+ * Each pulse is handled in the gpio interrupt of its trailing edge: the width
+ * is normalized with the servo range (CFG_SERVO_MIN_US/MAX_US), shaped by
+ * expo and rate, clamped to the limits and mapped onto the output profile.
+ * The profile is synchronized, the write restarts the pwm frame, so every
+ * input frame goes out in the same frame. The idle repeat of the output is
+ * slower than the input frame rate and only runs in failsafe.
+ * The latency is counted from the capture of the trailing edge to the write,
+ * the output pulse trails the input pulse by its width plus this latency.
+ */
+
+// output idle repeat in percent of the frame rate of the profile
+#define RELAY_REPEAT_PCT 75
+// normalized travel -1..1 as Q14
+#define RELAY_ONE (1 << 14)
+// pins of the board, not available as receiver input
+#define RELAY_PINS_USED ((1u << ESC_PWR_PIN) | (1u << SW_PIN) | (1u << LED_PIN_BLUE) | (1u << LED_PIN_RED) | \
+                         (1u << RECV_CH1_PIN) | (1u << SERV_CH1_PIN))
+
+#define relay_st_off 0  // no esc power
+#define relay_st_delay 1// power up delay, no pulses
+#define relay_st_run 2
+
+static const uint32_t pwrupdlytime = 3 * 1000 / MODE_LOOPTIME;
+static uint32_t msgupdatetime;
+static uint32_t state;
+static uint32_t escpower_cnt;
+static uint32_t msg_cnt;
+static uint32_t lost_us;// signal loss, or mode start
+static bool signal_shown;// led and log
+static uint32_t in_pin;
+static rc_servo_proto proto;
+static rc_servo_profile relay_profile;
+static rc_servo relay_servo;
+// from the mode arena
+static uint8_t *stdin_buf;
+
+// conditioning, written by the task with interrupts disabled
+static struct
+{
+    uint32_t rc_min_us;// valid input window
+    uint32_t rc_max_us;
+    int32_t center2_us;// servo range, doubled to keep the half microsecond
+    int32_t span_us;
+    int32_t center_ns;
+    int32_t half_ns;
+    int32_t rate;
+    int32_t expo;
+    int32_t lim_min_ns;// limits on the servo range scale
+    int32_t lim_max_ns;
+    int32_t out_min_ns;// servo range mapped onto the profile
+    uint32_t out_scale;// Q16
+    uint32_t failsafe_us;
+    uint32_t timeout_us;
+} par;
+
+// written in the gpio interrupt, read by the task and rpc on the same core
+static struct
+{
+    volatile bool output;// pulses go out
+    volatile bool signal;
+    volatile uint32_t last_us;// trailing edge of the last valid pulse
+    uint32_t in_us;
+    uint32_t out_ns;
+    uint32_t frames;
+    uint32_t glitches;
+    uint32_t failsafes;
+    uint32_t lat_min;
+    uint32_t lat_max;
+    uint64_t lat_sum;
+} relay;
+
+static void relay_load(void)
+{
+    int32_t smin = cfg_get(CFG_SERVO_MIN_US);
+    int32_t smax = cfg_get(CFG_SERVO_MAX_US);
+    int32_t out_min = relay_profile.min_pulse_ns;
+    int32_t out_span = relay_profile.max_pulse_ns - relay_profile.min_pulse_ns;
+    uint32_t irq;
+
+    if (smax <= smin)
+        smax = smin + 1;
+    // the pwm profiles run on the servo range itself
+    if (proto == RC_PROTO_PWM || proto == RC_PROTO_PWM_FAST)
+    {
+        out_min = smin * 1000;
+        out_span = (smax - smin) * 1000;
+    }
+    irq = save_and_disable_interrupts();
+    par.rc_min_us = cfg_get(CFG_RC_MIN_US);
+    par.rc_max_us = cfg_get(CFG_RC_MAX_US);
+    par.center2_us = smin + smax;
+    par.span_us = smax - smin;
+    par.center_ns = (smin + smax) * 500;
+    par.half_ns = (smax - smin) * 500;
+    par.rate = cfg_get(CFG_RELAY_RATE);
+    par.expo = cfg_get(CFG_RELAY_EXPO);
+    par.lim_min_ns = cfg_get(CFG_RELAY_MIN_US) * 1000;
+    par.lim_max_ns = cfg_get(CFG_RELAY_MAX_US) * 1000;
+    par.out_min_ns = out_min;
+    par.out_scale = ((uint64_t)out_span << 16) / ((smax - smin) * 1000);
+    par.failsafe_us = cfg_get(CFG_RELAY_FAILSAFE_US);
+    par.timeout_us = cfg_get(CFG_RELAY_TIMEOUT_MS) * 1000;
+    restore_interrupts(irq);
+}
+
+// pulse on the servo range scale to the output, within the limits and the profile
+static uint32_t relay_out_ns(int32_t ns)
+{
+    int64_t out;
+
+    if (ns < par.lim_min_ns)
+        ns = par.lim_min_ns;
+    if (ns > par.lim_max_ns)
+        ns = par.lim_max_ns;
+    out = par.out_min_ns + (((int64_t)(ns - (par.center_ns - par.half_ns)) * par.out_scale) >> 16);
+    if (out < relay_profile.min_pulse_ns)
+        out = relay_profile.min_pulse_ns;
+    if (out > relay_profile.max_pulse_ns)
+        out = relay_profile.max_pulse_ns;
+    return out;
+}
+
+// input width to the output, all 32 bit but one multiply
+static uint32_t relay_map(uint32_t width_us)
+{
+    int32_t x = ((int32_t)(2 * width_us) - par.center2_us) * RELAY_ONE / par.span_us;
+    int32_t f;
+
+    if (x > RELAY_ONE)
+        x = RELAY_ONE;
+    if (x < -RELAY_ONE)
+        x = -RELAY_ONE;
+    // expo: y = x * ((1 - e) + e * x^2)
+    f = ((100 - par.expo) * RELAY_ONE + par.expo * ((x * x) >> 14)) / 100;
+    x = ((x * f) >> 14) * par.rate / 100;
+    return relay_out_ns(par.center_ns + (int32_t)(((int64_t)x * par.half_ns) >> 14));
+}
+
+// without signal: the failsafe pulse or none, called with interrupts disabled
+static void relay_failsafe(void)
+{
+    if (par.failsafe_us)
+    {
+        relay.out_ns = relay_out_ns(par.failsafe_us * 1000);
+        rc_servo_set_nanos(&relay_servo, relay.out_ns);
+    }
+    else
+    {
+        relay.out_ns = 0;
+        rc_servo_stop(&relay_servo, false);
+    }
+}
+
+// gpio interrupt, trailing edge of a receiver pulse
+static void relay_pulse(uint pin, uint64_t start_us, uint32_t width_us)
+{
+    uint32_t end_us = (uint32_t)(start_us + width_us);
+    uint32_t lat;
+
+    if (width_us < par.rc_min_us || width_us > par.rc_max_us)
+    {
+        relay.glitches++;
+        return;
+    }
+    relay.in_us = width_us;
+    relay.last_us = end_us;
+    relay.signal = true;
+    if (!relay.output)
+        return;
+    relay.out_ns = relay_map(width_us);
+    rc_servo_set_nanos(&relay_servo, relay.out_ns);
+    lat = time_us_32() - end_us;
+    if (lat < relay.lat_min)
+        relay.lat_min = lat;
+    if (lat > relay.lat_max)
+        relay.lat_max = lat;
+    relay.lat_sum += lat;
+    relay.frames++;
+}
+
+static void relay_clear(void)
+{
+    relay.frames = 0;
+    relay.glitches = 0;
+    relay.failsafes = 0;
+    relay.lat_min = UINT32_MAX;
+    relay.lat_max = 0;
+    relay.lat_sum = 0;
+}
+
+// state u8, signal u8, input pin u8, profile u8, frames, glitches, failsafes,
+// last input us, last output ns, latency min, mean, max us (u32)
+static uint8_t rpc_relay_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+    uint32_t irq;
+
+    if (arg_len > 1)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 36))
+        return RPC_ERR_NOSPACE;
+    irq = save_and_disable_interrupts();
+    *p++ = state;
+    *p++ = relay.signal;
+    *p++ = in_pin;
+    *p++ = proto;
+    p = rpc_put_u32(p, relay.frames);
+    p = rpc_put_u32(p, relay.glitches);
+    p = rpc_put_u32(p, relay.failsafes);
+    p = rpc_put_u32(p, relay.in_us);
+    p = rpc_put_u32(p, relay.out_ns);
+    p = rpc_put_u32(p, relay.frames ? relay.lat_min : 0);
+    p = rpc_put_u32(p, relay.frames ? (uint32_t)(relay.lat_sum / relay.frames) : 0);
+    rpc_put_u32(p, relay.lat_max);
+    if (arg_len && arg[0])
+        relay_clear();
+    restore_interrupts(irq);
+    return RPC_OK;
+}
+
+static const rpc_cmd_t rpc_relay_cmds[] = {
+    {RPC_OP_RELAY_STATUS, rpc_relay_status},
+};
+
+// signal relay, started by rpc or as boot mode
+static void relay_start(void)
+{
+    msgupdatetime = cfg_get(CFG_MSG_UPDATE_MS) * 1000 / MODE_LOOPTIME;
+    rpc_register(rpc_relay_cmds, count_of(rpc_relay_cmds));
+    stdin_buf = mem_alloc(BUFFER_SIZE);
+    // drop what was typed for another mode
+    dbg_read_usb(stdin_buf);
+
+    // synchronized, the input sets the frames
+    proto = cfg_get(CFG_RELAY_PROFILE);
+    relay_profile = *rc_servo_get_profile(proto);
+    relay_profile.frame_hz = relay_profile.frame_hz * RELAY_REPEAT_PCT / 100;
+    relay_profile.sync = true;
+    if (proto == RC_PROTO_PWM || proto == RC_PROTO_PWM_FAST)
+    {
+        relay_profile.min_pulse_ns = MIN(cfg_get(CFG_SERVO_MIN_US), cfg_get(CFG_RELAY_MIN_US)) * 1000;
+        relay_profile.max_pulse_ns = MAX(cfg_get(CFG_SERVO_MAX_US), cfg_get(CFG_RELAY_MAX_US)) * 1000;
+    }
+    memset(&relay, 0, sizeof(relay));
+    relay_clear();
+    relay_load();
+
+    in_pin = cfg_get(CFG_RELAY_IN_PIN);
+    if (RELAY_PINS_USED & (1u << in_pin))
+    {
+        TLOG(relay_pin, in_pin, RELAY_IN_PIN);
+        in_pin = RELAY_IN_PIN;
+    }
+    // the receiver drives the pin directly, the rc input expects the inverted
+    // signal of the one-wire buffer
+    rc_init_input(in_pin, false);
+    gpio_set_inover(in_pin, GPIO_OVERRIDE_INVERT);
+    gpio_pull_down(in_pin);
+    rc_set_input_callback(in_pin, relay_pulse);
+    rc_set_input_enabled(in_pin, true);
+    TLOG(relay_start, in_pin, proto);
+    escpower_cnt = 0;
+    msg_cnt = 0;
+    lost_us = time_us_32();
+    signal_shown = false;
+    state = relay_st_off;
+}
+
+static void relay_task(uint8_t button)
+{
+    bool signal;
+    bool escpower;
+    uint32_t irq;
+
+    dbg_read_usb(stdin_buf);
+    escpower = ceck_escpwr();
+
+    // signal loss, the interrupt can not see a missing pulse
+    irq = save_and_disable_interrupts();
+    if (relay.signal && time_us_32() - relay.last_us > par.timeout_us)
+    {
+        relay.signal = false;
+        relay.failsafes++;
+        if (relay.output)
+            relay_failsafe();
+    }
+    signal = relay.signal;
+    restore_interrupts(irq);
+    if (signal != signal_shown)
+    {
+        signal_shown = signal;
+        set_blue_led(signal);
+        if (signal)
+        {
+            TLOG(relay_signal, (time_us_32() - lost_us) / 1000);
+        }
+        else
+        {
+            lost_us = time_us_32();
+            TLOG(relay_failsafe, par.failsafe_us);
+        }
+    }
+
+    switch (state)
+    {
+        case relay_st_off:// the output pin is a plain input
+            if (escpower)
+            {
+                relay_servo = rc_servo_init_profile(SERV_CH1_PIN, &relay_profile);
+                TLOG(relay_pwm, rc_servo_get_period_ns(&relay_servo), rc_servo_get_resolution_ps(&relay_servo));
+                escpower_cnt = 0;
+                state = relay_st_delay;
+            }
+            break;
+        case relay_st_delay:
+            if (!escpower)
+            {
+                rc_servo_deinit(&relay_servo);
+                dbg_print_usb("Power is off\n");
+                state = relay_st_off;
+            }
+            else if (++escpower_cnt > pwrupdlytime)
+            {
+                // no pulse until the first input or the failsafe
+                rc_servo_stop(&relay_servo, false);
+                pwm_set_enabled(relay_servo.slice_num, true);
+                irq = save_and_disable_interrupts();
+                relay.output = true;
+                if (!relay.signal)
+                    relay_failsafe();
+                restore_interrupts(irq);
+                dbg_print_usb("Start relay\n");
+                state = relay_st_run;
+            }
+            break;
+        case relay_st_run:
+            if (!escpower)
+            {
+                relay.output = false;
+                rc_servo_deinit(&relay_servo);
+                dbg_print_usb("Power is off\n");
+                state = relay_st_off;
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (++msg_cnt > msgupdatetime)
+    {
+        msg_cnt = 0;
+        // conditioning changes by cfg set take effect here
+        relay_load();
+        if (signal)
+            TLOG(relay_status, relay.in_us, relay.out_ns, relay.lat_max);
+        else
+            TLOG(relay_no_signal);
+    }
+}
+
+static void relay_stop(void)
+{
+    rpc_unregister(rpc_relay_cmds);
+    rc_deinit_input(in_pin);
+    // back to a plain input without override
+    gpio_init(in_pin);
+    relay.output = false;
+    if (state != relay_st_off)
+        rc_servo_deinit(&relay_servo);
+    set_blue_led(0);
+}
+
+const opmode_ops_t mode_relay_ops = {
+    .name = "signal relay",
+    .start = relay_start,
+    .task = relay_task,
+    .stop = relay_stop,
+};
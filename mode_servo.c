@@ -0,0 +1,741 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#include "cfg.h"
+#include "mem.h"
+#include "modes.h"
+#include "rc.h"
+#include "rc_latency.h"
+#include "tlog.h"
+#include "uart_bridge.h"
+#include "user_gpio.h"
+
+// pins of the board, not available for a servo group; this also keeps the group
+// off the slice of the servo output (gpio 12 and 13)
+#define GROUP_PINS_USED ((1u << ESC_PWR_PIN) | (1u << SW_PIN) | (1u << LED_PIN_BLUE) | (1u << LED_PIN_RED) | \
+                         (1u << RECV_CH1_PIN) | (1u << SERV_CH1_PIN))
+// the gpios above belong to the wireless chip
+#define GROUP_PIN_MAX 22
+
+static const uint32_t pwrupdlytime = 3 * 1000 / MODE_LOOPTIME;
+static const uint32_t playframes = 256;
+
+static uint32_t pwmupdatetime;
+static uint32_t msgupdatetime;
+static rc_servo_profile servo_profile;
+
+// state shared between the mode task and the rpc handlers
+static uint32_t state;
+static uint32_t escpower_cnt;
+static uint32_t angle;
+static bool update_angle;
+static bool update_print_angle;
+static rc_servo_proto proto;
+static bool update_proto;
+static bool upload;
+static bool upload_rep;
+static bool upload_err;
+static uint32_t upload_us;
+static uint32_t upload_frames;
+static bool measure;
+static rc_servo Servo1;
+static rc_lat_result lat_result;
+static bool group_on;
+// from the mode arena
+static rc_servo_group *group;
+static uint8_t *print_buf;
+static uint8_t *stdin_buf;
+
+// profile with the configured pulse range for the pwm profiles
+static const rc_servo_profile* get_servo_profile(rc_servo_proto p)
+{
+    servo_profile = *rc_servo_get_profile(p);
+    if (p == RC_PROTO_PWM || p == RC_PROTO_PWM_FAST)
+    {
+        servo_profile.min_pulse_ns = cfg_get(CFG_SERVO_MIN_US) * 1000;
+        servo_profile.max_pulse_ns = cfg_get(CFG_SERVO_MAX_US) * 1000;
+    }
+    return &servo_profile;
+}
+
+// stop the servo group and give its pins back
+static void group_release(void)
+{
+    if (!group_on)
+        return;
+    group_on = 0;
+    rc_group_stop(group);
+    for (uint32_t i = 0; i < group->count; i++)
+    {
+        rc_servo_deinit(&group->ch[i]);
+    }
+}
+
+//
+// rpc handlers, called from rpc_task() in the main loop
+//
+
+static uint8_t rpc_servo_get_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    bool init = (state == 2 || state == 3 || state == 4);
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 13))
+        return RPC_ERR_NOSPACE;
+    rsp[0] = state;
+    rsp[1] = angle;
+    rsp[2] = proto;
+    rsp[3] = rc_play_is_running();
+    rsp[4] = measure;
+    rpc_put_u32(&rsp[5], init ? rc_servo_get_period_ns(&Servo1) : 0);
+    rpc_put_u32(&rsp[9], init ? rc_servo_get_resolution_ps(&Servo1) : 0);
+    return RPC_OK;
+}
+
+static uint8_t rpc_servo_set_angle(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 1)
+        return RPC_ERR_ARGS;
+    if (arg[0] > 180)
+        return RPC_ERR_RANGE;
+    angle = arg[0];
+    update_angle = 1;
+    // no need to wait for the keyboard update interval
+    if (state == 3 && !rc_play_is_running() && !measure)
+    {
+        update_angle = 0;
+        rc_servo_set_angle(&Servo1, angle);
+    }
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_servo_set_nanos(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint32_t nanos;
+
+    if (arg_len != 4)
+        return RPC_ERR_ARGS;
+    if (state != 3 || rc_play_is_running() || measure)
+        return RPC_ERR_STATE;
+    nanos = rpc_get_u32(arg);
+    if (nanos < Servo1.min_pulse_ns || nanos > Servo1.max_pulse_ns)
+        return RPC_ERR_RANGE;
+    rc_servo_set_nanos(&Servo1, nanos);
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_servo_set_profile(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 1)
+        return RPC_ERR_ARGS;
+    if (arg[0] >= RC_PROTO_COUNT)
+        return RPC_ERR_RANGE;
+    proto = arg[0];
+    update_proto = 1;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// pins u8 ..., the channels of the group in this order, with the profile of the servo output;
+// all channels start without pulse
+static uint8_t rpc_group_start(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint pins[RC_GROUP_MAX_CHANNELS];
+
+    if (arg_len == 0 || arg_len > RC_GROUP_MAX_CHANNELS)
+        return RPC_ERR_ARGS;
+    if (state != 3 || update_proto || group_on)
+        return RPC_ERR_STATE;
+    for (uint32_t i = 0; i < arg_len; i++)
+    {
+        if (arg[i] > GROUP_PIN_MAX || (GROUP_PINS_USED & (1u << arg[i])))
+            return RPC_ERR_RANGE;
+        pins[i] = arg[i];
+    }
+    // two pins on the same slice channel
+    if (!rc_group_init(group, pins, arg_len, get_servo_profile(proto)))
+        return RPC_ERR_RANGE;
+    rc_group_start(group);
+    group_on = 1;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// (channel u8, ns u32) ..., latched together in one frame; late u8 is 1 when a
+// synchronized profile could not restart the frame and the levels go out at its end
+static uint8_t rpc_group_set(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len == 0 || arg_len % 5)
+        return RPC_ERR_ARGS;
+    if (!group_on)
+        return RPC_ERR_STATE;
+    // all values are checked before the first one goes into the shadow registers
+    for (uint32_t i = 0; i < arg_len; i += 5)
+    {
+        uint32_t nanos = rpc_get_u32(&arg[i + 1]);
+
+        if (arg[i] >= group->count || nanos < group->ch[arg[i]].min_pulse_ns || nanos > group->ch[arg[i]].max_pulse_ns)
+            return RPC_ERR_RANGE;
+    }
+    if (!rpc_room(rsp_len, 1))
+        return RPC_ERR_NOSPACE;
+    for (uint32_t i = 0; i < arg_len; i += 5)
+    {
+        rc_group_set_nanos(group, arg[i], rpc_get_u32(&arg[i + 1]));
+    }
+    rsp[0] = !rc_group_commit(group);
+    return RPC_OK;
+}
+
+static uint8_t rpc_group_stop(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    group_release();
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_play_clear(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    rc_play_clear();
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// points as (nanos u32, frames u16), as many as fit in one command
+static uint8_t rpc_play_add(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len == 0 || arg_len % 6)
+        return RPC_ERR_ARGS;
+    if (rc_play_is_running())
+        return RPC_ERR_STATE;
+    for (uint32_t i = 0; i < arg_len; i += 6)
+    {
+        if (!rc_play_add(rpc_get_u32(&arg[i]), rpc_get_u16(&arg[i + 4])))
+            return RPC_ERR_FULL;
+    }
+    if (!rpc_room(rsp_len, 2))
+        return RPC_ERR_NOSPACE;
+    rpc_put_u16(rsp, rc_play_get_count());
+    return RPC_OK;
+}
+
+static uint8_t rpc_play_ramp(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 10)
+        return RPC_ERR_ARGS;
+    if (rc_play_is_running())
+        return RPC_ERR_STATE;
+    if (!rc_play_add_ramp(rpc_get_u32(&arg[0]), rpc_get_u32(&arg[4]), rpc_get_u16(&arg[8])))
+        return RPC_ERR_FULL;
+    if (!rpc_room(rsp_len, 2))
+        return RPC_ERR_NOSPACE;
+    rpc_put_u16(rsp, rc_play_get_count());
+    return RPC_OK;
+}
+
+static uint8_t rpc_play_sine(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 12)
+        return RPC_ERR_ARGS;
+    if (rc_play_is_running())
+        return RPC_ERR_STATE;
+    if (rpc_get_u16(&arg[8]) == 0)
+        return RPC_ERR_RANGE;
+    if (!rc_play_add_sine(rpc_get_u32(&arg[0]), rpc_get_u32(&arg[4]), rpc_get_u16(&arg[8]), rpc_get_u16(&arg[10])))
+        return RPC_ERR_FULL;
+    if (!rpc_room(rsp_len, 2))
+        return RPC_ERR_NOSPACE;
+    rpc_put_u16(rsp, rc_play_get_count());
+    return RPC_OK;
+}
+
+static uint8_t rpc_play_start(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 2)
+        return RPC_ERR_ARGS;
+    if (state != 3 || measure || !rc_play_start(&Servo1, rpc_get_u16(arg)))
+        return RPC_ERR_STATE;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_play_stop(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    rc_play_stop();
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_play_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 5))
+        return RPC_ERR_NOSPACE;
+    rsp[0] = rc_play_is_running();
+    rpc_put_u16(&rsp[1], rc_play_get_count());
+    rpc_put_u16(&rsp[3], rc_play_get_position());
+    return RPC_OK;
+}
+
+static uint8_t rpc_lat_start(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 3)
+        return RPC_ERR_ARGS;
+    if (rpc_get_u16(arg) == 0)
+        return RPC_ERR_RANGE;
+    if (state != 3 || measure)
+        return RPC_ERR_STATE;
+    rc_play_stop();
+    if (!rc_lat_start(&Servo1, RECV_CH1_PIN, rpc_get_u16(arg), arg[2]))
+        return RPC_ERR_STATE;
+    measure = 1;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t *rpc_put_stat(uint8_t *p, const rc_lat_stat *stat)
+{
+    p = rpc_put_u32(p, stat->min);
+    p = rpc_put_u32(p, stat->mean);
+    p = rpc_put_u32(p, stat->max);
+    return rpc_put_u32(p, stat->stddev);
+}
+
+static uint8_t rpc_lat_result(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 61))
+        return RPC_ERR_NOSPACE;
+    rc_lat_get_result(&lat_result);
+    *p++ = rc_lat_is_running();
+    p = rpc_put_u32(p, lat_result.frames);
+    p = rpc_put_u32(p, lat_result.matched);
+    p = rpc_put_u32(p, lat_result.missed);
+    p = rpc_put_u32(p, lat_result.extra);
+    p = rpc_put_stat(p, &lat_result.latency);
+    p = rpc_put_stat(p, &lat_result.width_error);
+    p = rpc_put_u32(p, lat_result.p50_us);
+    p = rpc_put_u32(p, lat_result.p90_us);
+    rpc_put_u32(p, lat_result.p99_us);
+    return RPC_OK;
+}
+
+// histogram bins (first u8, count u8), count is clipped to the available bins
+static uint8_t rpc_lat_hist(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint32_t first;
+    uint32_t count;
+
+    if (arg_len != 2)
+        return RPC_ERR_ARGS;
+    first = arg[0];
+    count = arg[1];
+    if (first > RC_LAT_HIST_BINS)
+        return RPC_ERR_RANGE;
+    if (count > RC_LAT_HIST_BINS + 1 - first)
+        count = RC_LAT_HIST_BINS + 1 - first;
+    if (*rsp_len < 2)
+        return RPC_ERR_NOSPACE;
+    if (count > (*rsp_len - 2) / 4)
+        count = (*rsp_len - 2) / 4;
+    if (!rpc_room(rsp_len, 2 + 4 * count))
+        return RPC_ERR_NOSPACE;
+    rc_lat_get_result(&lat_result);
+    rsp[0] = first;
+    rsp[1] = count;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        rpc_put_u32(&rsp[2 + 4 * i], lat_result.hist[first + i]);
+    }
+    return RPC_OK;
+}
+
+static const rpc_cmd_t rpc_servo_cmds[] = {
+    {RPC_OP_SERVO_GET_STATUS, rpc_servo_get_status},
+    {RPC_OP_SERVO_SET_ANGLE, rpc_servo_set_angle},
+    {RPC_OP_SERVO_SET_NANOS, rpc_servo_set_nanos},
+    {RPC_OP_SERVO_SET_PROFILE, rpc_servo_set_profile},
+    {RPC_OP_SERVO_GROUP_START, rpc_group_start},
+    {RPC_OP_SERVO_GROUP_SET, rpc_group_set},
+    {RPC_OP_SERVO_GROUP_STOP, rpc_group_stop},
+    {RPC_OP_PLAY_CLEAR, rpc_play_clear},
+    {RPC_OP_PLAY_ADD, rpc_play_add},
+    {RPC_OP_PLAY_RAMP, rpc_play_ramp},
+    {RPC_OP_PLAY_SINE, rpc_play_sine},
+    {RPC_OP_PLAY_START, rpc_play_start},
+    {RPC_OP_PLAY_STOP, rpc_play_stop},
+    {RPC_OP_PLAY_STATUS, rpc_play_status},
+    {RPC_OP_LAT_START, rpc_lat_start},
+    {RPC_OP_LAT_RESULT, rpc_lat_result},
+    {RPC_OP_LAT_HIST, rpc_lat_hist},
+};
+
+// servo tester
+static void servo_start(void)
+{
+    pwmupdatetime = cfg_get(CFG_SERVO_UPDATE_MS) * 1000 / MODE_LOOPTIME;
+    msgupdatetime = cfg_get(CFG_MSG_UPDATE_MS) * 1000 / MODE_LOOPTIME;
+    rc_set_input_limits(cfg_get(CFG_RC_MIN_US), cfg_get(CFG_RC_MAX_US));
+    rpc_register(rpc_recv_cmds, rpc_recv_cmds_count);
+    rpc_register(rpc_servo_cmds, count_of(rpc_servo_cmds));
+    print_buf = mem_alloc(BUFFER_SIZE);
+    stdin_buf = mem_alloc(BUFFER_SIZE);
+    rc_play_set_table(mem_alloc(RC_PLAY_MAX_POINTS * 4), mem_alloc(RC_PLAY_MAX_POINTS * 4), RC_PLAY_MAX_POINTS);
+    group = mem_alloc(sizeof(rc_servo_group));
+    group_on = 0;
+    // drop what was typed for another mode
+    dbg_read_usb(stdin_buf);
+    memset(stdin_buf, 0, BUFFER_SIZE);
+    angle = 90;
+    update_angle = 0;
+    update_print_angle = 0;
+    proto = cfg_get(CFG_SERVO_PROFILE);
+    update_proto = 0;
+    upload = 0;
+    measure = 0;
+    escpower_cnt = 0;
+    state = 0;
+}
+
+static void servo_task(uint8_t button)
+{
+    const rc_servo_profile* profile;
+    uint32_t print_buf_pos;
+    uint32_t stdin_buf_pos;
+    uint32_t pulse;
+    bool escpower;
+    uint32_t x;
+    uint8_t c;
+
+    dbg_read_usb(stdin_buf);
+    escpower = ceck_escpwr();
+
+    stdin_buf_pos = 0;
+    while (stdin_buf[stdin_buf_pos] && stdin_buf_pos < BUFFER_SIZE)
+    {
+        c = stdin_buf[stdin_buf_pos];
+        if (upload)
+        {
+            // playback table upload: u<us>[*<frames>],<us>[*<frames>],...;
+            if (c >= '0' && c <= '9')
+            {
+                if (upload_rep)
+                    upload_frames = upload_frames * 10 + (c - '0');
+                else
+                    upload_us = upload_us * 10 + (c - '0');
+            }
+            else if (c == '*')
+            {
+                upload_rep = 1;
+                upload_frames = 0;
+            }
+            else if (c == ',' || c == ';' || c == '\n' || c == '\r')
+            {
+                // a '*' without a count is an error, not a point of 0 frames
+                if (upload_us && ((upload_rep && upload_frames == 0) ||
+                                  !rc_play_add(upload_us * 1000, upload_rep ? upload_frames : 1)))
+                {
+                    upload_err = 1;
+                }
+                upload_us = 0;
+                upload_rep = 0;
+                if (c != ',')
+                {
+                    upload = 0;
+                    sprintf(print_buf, "%s %u frames\n", upload_err ? "Bad entry or table full, loaded" : "Loaded", rc_play_get_count());
+                    dbg_print_usb(print_buf);
+                }
+            }
+        }
+        else if (c == 'u')
+        {
+            rc_play_clear();
+            upload = 1;
+            upload_rep = 0;
+            upload_err = 0;
+            upload_us = 0;
+        }
+        else if (c == 'r' || c == 'w' || c == 'e')
+        {
+            // built-in patterns over the pulse range of the profile
+            profile = get_servo_profile(proto);
+            rc_play_clear();
+            if (c == 'r')
+            {
+                rc_play_add_ramp(profile->min_pulse_ns, profile->max_pulse_ns, playframes);
+                rc_play_add_ramp(profile->max_pulse_ns, profile->min_pulse_ns, playframes);
+            }
+            else if (c == 'w')
+            {
+                rc_play_add_sine((profile->min_pulse_ns + profile->max_pulse_ns) / 2,
+                                 (profile->max_pulse_ns - profile->min_pulse_ns) / 2, 2 * playframes, 2 * playframes);
+            }
+            else
+            {
+                rc_play_add(profile->min_pulse_ns, playframes);
+                rc_play_add(profile->max_pulse_ns, playframes);
+            }
+            sprintf(print_buf, "Loaded %u frames\n", rc_play_get_count());
+            dbg_print_usb(print_buf);
+        }
+        else if (c == 'g')
+        {
+            if (state == 3 && rc_play_start(&Servo1, 0))
+            {
+                sprintf(print_buf, "Start playback %u frames at %lu Hz\n", rc_play_get_count(), rc_servo_get_frame_hz(&Servo1));
+                dbg_print_usb(print_buf);
+            }
+            else
+            {
+                dbg_print_usb("Playback needs table and running output\n");
+            }
+        }
+        else if (c == 's')
+        {
+            rc_play_stop();
+            dbg_print_usb("Stop playback\n");
+        }
+        else if (c == 'l')
+        {
+            // loopback measurement: sweep the output and match the captured pulses
+            rc_play_stop();
+            if (state == 3 && rc_lat_start(&Servo1, RECV_CH1_PIN, 1000, 11))
+            {
+                measure = 1;
+                dbg_print_usb("Start loopback measurement\n");
+            }
+            else
+            {
+                dbg_print_usb("Measurement needs running output\n");
+            }
+        }
+        else if (stdin_buf[stdin_buf_pos] == '+')
+        {
+            if (angle < 180)
+            {
+                angle++;
+                update_angle = 1;
+            }
+            update_print_angle = 1;
+        }
+        else if (stdin_buf[stdin_buf_pos] == '-')
+        {
+            if (angle > 0)
+            {
+                angle--;
+                update_angle = 1;
+            }
+            update_print_angle = 1;
+        }
+        else if (stdin_buf[stdin_buf_pos] == 'o')
+        {
+            angle = 180;
+            update_angle = 1;
+            update_print_angle = 1;
+        }
+        else if (stdin_buf[stdin_buf_pos] == 'k')
+        {
+            angle = 90;
+            update_angle = 1;
+            update_print_angle = 1;
+        }
+        else if (stdin_buf[stdin_buf_pos] == 'm')
+        {
+            angle = 0;
+            update_angle = 1;
+            update_print_angle = 1;
+        }
+        else if (stdin_buf[stdin_buf_pos] == 'p')
+        {
+            proto = (proto + 1) % RC_PROTO_COUNT;
+            update_proto = 1;
+            sprintf(print_buf, "Set profile %s\n", rc_servo_get_profile(proto)->name);
+            dbg_print_usb(print_buf);
+        }
+        stdin_buf[stdin_buf_pos] = 0;
+        stdin_buf_pos++;
+    }
+
+    if (measure && !rc_lat_is_running())
+    {
+        measure = 0;
+        rc_lat_get_result(&lat_result);
+        sprintf(print_buf, "Loopback %lu frames, %lu matched, %lu missed, %lu extra\n",
+                lat_result.frames, lat_result.matched, lat_result.missed, lat_result.extra);
+        dbg_print_usb(print_buf);
+        sprintf(print_buf, "Latency ns: min %ld mean %ld max %ld jitter %lu\n",
+                lat_result.latency.min, lat_result.latency.mean, lat_result.latency.max, lat_result.latency.stddev);
+        dbg_print_usb(print_buf);
+        sprintf(print_buf, "Latency us: p50 %lu p90 %lu p99 %lu\n", lat_result.p50_us, lat_result.p90_us, lat_result.p99_us);
+        dbg_print_usb(print_buf);
+        sprintf(print_buf, "Width error ns: min %ld mean %ld max %ld stddev %lu\n",
+                lat_result.width_error.min, lat_result.width_error.mean, lat_result.width_error.max, lat_result.width_error.stddev);
+        dbg_print_usb(print_buf);
+        print_buf_pos = sprintf(print_buf, "Histogram us:");
+        for (x = 0; x <= RC_LAT_HIST_BINS; x++)
+        {
+            if (lat_result.hist[x])
+                print_buf_pos += sprintf(&print_buf[print_buf_pos], " %lu:%lu", x, lat_result.hist[x]);
+        }
+        sprintf(&print_buf[print_buf_pos], "\n");
+        dbg_print_usb(print_buf);
+        // back to the set angle
+        rc_servo_set_angle(&Servo1, angle);
+    }
+
+    if (update_print_angle)
+    {
+        update_print_angle = 0;
+        TLOG(servo_set, angle);
+    }
+
+    switch (state)
+    {
+        case 0:
+            if (escpower)
+            {
+                escpower_cnt++;
+                if (escpower_cnt > msgupdatetime)
+                {
+                    TLOG(power_off_wait);
+                    escpower_cnt = 0;
+                }
+            }
+            else
+            {
+                state = 1;
+            }
+            break;
+        case 1:// init wait for power up
+            if (escpower)
+            {
+                dbg_print_usb("Init PWM\n");
+                Servo1 = rc_servo_init_profile(SERV_CH1_PIN, get_servo_profile(proto));
+                update_proto = 0;
+                TLOG(servo_pwm, proto, rc_servo_get_period_ns(&Servo1), rc_servo_get_resolution_ps(&Servo1));
+                rc_init_input(RECV_CH1_PIN, true);
+                escpower_cnt = 0;
+                state = 2;
+            }
+            break;
+        case 2:// power up delay
+            if (escpower)
+            {
+                escpower_cnt++;
+                if (escpower_cnt > pwrupdlytime)
+                {
+                    rc_servo_start(&Servo1, angle);// set servo1 start degrees
+                    TLOG(servo_start, angle);
+                    escpower_cnt = 0;
+                    state = 3;
+                }
+            }
+            else
+            {
+                dbg_print_usb("Power is off\n");
+                escpower_cnt = 0;
+                state = 4;
+            }
+            break;
+        case 3:
+            if (escpower)
+            {
+                escpower_cnt++;
+                if (escpower_cnt == pwmupdatetime / 2)
+                {
+                    // Read input from RC receiver - that is pulse width on input pin.
+                    pulse = rc_get_input_pulse_width(RECV_CH1_PIN);
+                    TLOG(servo_pulse, pulse);
+                }
+
+                if (update_proto)
+                {
+                    // switch output profile while running, a group is started again by the host
+                    update_proto = 0;
+                    group_release();
+                    rc_play_stop();
+                    rc_lat_stop();
+                    rc_servo_stop(&Servo1, true);
+                    Servo1 = rc_servo_init_profile(SERV_CH1_PIN, get_servo_profile(proto));
+                    rc_servo_start(&Servo1, angle);
+                    TLOG(servo_pwm, proto, rc_servo_get_period_ns(&Servo1), rc_servo_get_resolution_ps(&Servo1));
+                }
+
+                if (escpower_cnt > pwmupdatetime)
+                {
+                    escpower_cnt = 0;
+                    if (update_angle && !rc_play_is_running() && !measure)
+                    {
+                        update_angle = 0;
+                        rc_servo_set_angle(&Servo1, angle);
+                        TLOG(servo_write, angle);
+                    }
+                }
+            }
+            else
+            {
+                group_release();
+                rc_play_stop();
+                rc_lat_stop();
+                rc_servo_stop(&Servo1, true);
+                dbg_print_usb("Power is off\n");
+                escpower_cnt = 0;
+                state = 4;
+            }
+            break;
+        case 4:
+            if (escpower)
+            {
+                dbg_print_usb("Restart without init PWM\n");
+                escpower_cnt = 0;
+                state = 2;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void servo_stop(void)
+{
+    rpc_unregister(rpc_servo_cmds);
+    rpc_unregister(rpc_recv_cmds);
+    rc_play_set_table(NULL, NULL, 0);
+    rc_lat_stop();
+    measure = 0;
+    group_release();
+    // the output is initialized from state 2 on
+    if (state == 2 || state == 3 || state == 4)
+    {
+        rc_servo_deinit(&Servo1);
+    }
+    // the input from state 1 on
+    rc_deinit_input(RECV_CH1_PIN);
+}
+
+const opmode_ops_t mode_servo_ops = {
+    .name = "servo test",
+    .start = servo_start,
+    .task = servo_task,
+    .stop = servo_stop,
+};
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_MODES_H_)
+#define _MODES_H_
+
+#include <tusb.h>
+
+#include "rpc.h"
+
+// main loop time in us, the mode timings are counted in loops
+#define MODE_LOOPTIME 10
+
+/*
+ * Operating mode as start/stop-able subsystem. start() claims the pins and
+ * peripherals of the mode, task() runs once per main loop with the last button
+ * event, stop() releases everything again so that another mode can be started
+ * without a reset. A long button press is handled by the main loop. ESC power
+ * events are taken from the input queue together with the button event and
+ * counted, get_escpwr_changes() tells a mode that data read from the ESC is
+ * outdated, ceck_escpwr() is the debounced level.
+ */
+typedef struct
+{
+    const char *name;
+    void (*start)(void);
+    void (*task)(uint8_t button);
+    void (*stop)(void);
+} opmode_ops_t;
+
+extern const opmode_ops_t mode_esc_ops;
+extern const opmode_ops_t mode_rec_ops;
+extern const opmode_ops_t mode_servo_ops;
+extern const opmode_ops_t mode_bench_ops;
+extern const opmode_ops_t mode_relay_ops;
+
+// receiver commands, shared by receiver and servo mode
+extern const rpc_cmd_t rpc_recv_cmds[];
+extern const uint32_t rpc_recv_cmds_count;
+
+// esc image store and flashing, available in all modes
+extern const rpc_cmd_t rpc_esc_cmds[];
+extern const uint32_t rpc_esc_cmds_count;
+
+#endif /* _MODES_H_ */
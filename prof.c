@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/irq.h>
+#include <hardware/timer.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "prof.h"
+
+#define PROF_MASK (PROF_SLOTS - 1)
+// slots tried after the hash slot before a sample is dropped
+#define PROF_PROBES 8
+
+typedef struct
+{
+    uint32_t pc;
+    uint32_t count;
+} prof_slot_t;
+
+typedef struct
+{
+    prof_slot_t slots[PROF_SLOTS];
+    uint32_t samples;
+    uint32_t dropped;
+} prof_table_t;
+
+static prof_table_t prof_tables[2];
+
+static struct
+{
+    volatile bool running;
+    uint32_t period_us;
+    int alarm[2];
+} prof = {.alarm = {-1, -1}};
+
+void prof_sample(uint32_t *frame);
+
+// exception frame r0-r3, r12, lr, pc, xpsr on the stack that was active,
+// bit 2 of the exc_return value in lr selects psp
+static void __attribute__((naked)) prof_irq(void)
+{
+    __asm volatile(
+        "movs r0, #4\n"
+        "mov r1, lr\n"
+        "tst r0, r1\n"
+        "beq 1f\n"
+        "mrs r0, psp\n"
+        "b 2f\n"
+        "1:\n"
+        "mrs r0, msp\n"
+        "2:\n"
+        "ldr r1, =prof_sample\n"
+        "bx r1\n"
+        ".ltorg\n");
+}
+
+// called with the exc_return value still in lr, returns from the interrupt
+void __attribute__((used)) prof_sample(uint32_t *frame)
+{
+    uint core = get_core_num();
+    uint alarm = prof.alarm[core];
+    prof_table_t *t = &prof_tables[core];
+    uint32_t pc = frame[6];
+    uint32_t h = (((pc >> 1) * 2654435761u) >> 16) & PROF_MASK;
+
+    timer_hw->intr = 1u << alarm;
+    if (!prof.running)
+        return;
+    timer_hw->alarm[alarm] = timer_hw->timerawl + prof.period_us;
+
+    t->samples++;
+    for (uint32_t i = 0; i < PROF_PROBES; i++)
+    {
+        prof_slot_t *s = &t->slots[(h + i) & PROF_MASK];
+
+        if (s->pc == pc)
+        {
+            s->count++;
+            return;
+        }
+        if (s->count == 0)
+        {
+            s->pc = pc;
+            s->count = 1;
+            return;
+        }
+    }
+    t->dropped++;
+}
+
+// on each core once, the alarm interrupt is enabled for the calling core only
+void prof_init_core(void)
+{
+    uint core = get_core_num();
+    uint irq;
+
+    prof.alarm[core] = hardware_alarm_claim_unused(false);
+    if (prof.alarm[core] < 0)
+        return;
+    irq = TIMER_IRQ_0 + prof.alarm[core];
+    irq_set_exclusive_handler(irq, prof_irq);
+    irq_set_priority(irq, PICO_HIGHEST_IRQ_PRIORITY);
+    hw_set_bits(&timer_hw->inte, 1u << prof.alarm[core]);
+    irq_set_enabled(irq, true);
+}
+
+bool prof_start(uint32_t period_us)
+{
+    if (period_us < PROF_MIN_PERIOD_US)
+        return false;
+
+    prof_stop();
+    memset(prof_tables, 0, sizeof(prof_tables));
+    prof.period_us = period_us;
+    prof.running = true;
+    for (uint32_t core = 0; core < 2; core++)
+    {
+        if (prof.alarm[core] >= 0)
+            timer_hw->alarm[prof.alarm[core]] = timer_hw->timerawl + period_us;
+    }
+    return true;
+}
+
+// the counts stay readable
+void prof_stop(void)
+{
+    prof.running = false;
+    for (uint32_t core = 0; core < 2; core++)
+    {
+        if (prof.alarm[core] >= 0)
+            timer_hw->armed = 1u << prof.alarm[core];
+    }
+}
+
+static uint8_t rpc_prof_start(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 2)
+        return RPC_ERR_ARGS;
+    if (!prof_start(rpc_get_u16(arg)))
+        return RPC_ERR_RANGE;
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_prof_stop(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    prof_stop();
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_prof_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 19))
+        return RPC_ERR_NOSPACE;
+    *p++ = prof.running;
+    p = rpc_put_u16(p, prof.period_us);
+    for (uint32_t core = 0; core < 2; core++)
+    {
+        p = rpc_put_u32(p, prof_tables[core].samples);
+        p = rpc_put_u32(p, prof_tables[core].dropped);
+    }
+    return RPC_OK;
+}
+
+// used slots from first on as (pc u32, count u32), preceded by the slot to continue with
+static uint8_t rpc_prof_read(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    const prof_table_t *t;
+    uint32_t slot;
+    uint32_t pos = 2;
+
+    if (arg_len != 3)
+        return RPC_ERR_ARGS;
+    if (arg[0] > 1)
+        return RPC_ERR_RANGE;
+    if (*rsp_len < 2)
+        return RPC_ERR_NOSPACE;
+    t = &prof_tables[arg[0]];
+    for (slot = rpc_get_u16(&arg[1]); slot < PROF_SLOTS; slot++)
+    {
+        if (t->slots[slot].count == 0)
+            continue;
+        if (pos + 8 > *rsp_len)
+            break;
+        rpc_put_u32(&rsp[pos], t->slots[slot].pc);
+        rpc_put_u32(&rsp[pos + 4], t->slots[slot].count);
+        pos += 8;
+    }
+    rpc_put_u16(rsp, slot);
+    *rsp_len = pos;
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_prof_cmds[] = {
+    {RPC_OP_PROF_START, rpc_prof_start},
+    {RPC_OP_PROF_STOP, rpc_prof_stop},
+    {RPC_OP_PROF_STATUS, rpc_prof_status},
+    {RPC_OP_PROF_READ, rpc_prof_read},
+};
+const uint32_t rpc_prof_cmds_count = count_of(rpc_prof_cmds);
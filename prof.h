@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_PROF_H_)
+#define _PROF_H_
+
+#include <tusb.h>
+
+#include "rpc.h"
+
+/*
+ * Sampling profiler. Each core has a timer alarm with the highest interrupt
+ * priority, its handler takes the interrupted pc from the exception frame and
+ * counts it in a hash table of that core. The host reads the tables and maps
+ * the pcs to symbols of the elf file (usblink_rpc.py profile).
+ * When stopped the alarms are not armed and cost nothing. Code running with
+ * interrupts disabled is sampled when it enables them again.
+ */
+
+/*! @brief Distinct pcs counted per core, power of 2
+ */
+#ifndef PROF_SLOTS
+#define PROF_SLOTS 512
+#endif
+
+/*! @brief Shortest sample period in micro seconds
+ */
+#ifndef PROF_MIN_PERIOD_US
+#define PROF_MIN_PERIOD_US 20
+#endif
+
+void prof_init_core(void);
+bool prof_start(uint32_t period_us);
+void prof_stop(void);
+
+extern const rpc_cmd_t rpc_prof_cmds[];
+extern const uint32_t rpc_prof_cmds_count;
+
+#endif /* _PROF_H_ */
@@ -7,8 +7,12 @@
 
 #include "rc.h"
 #include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
 #include "hardware/pwm.h"
 #include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include <math.h>
 
 /** Pico SDK style param checking:
  PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_RC, Enable/disable assertions
@@ -40,9 +44,10 @@
 /* Define the boundaries for valid pulse width for servo.
 PULSES in micro seconds; angles in degrees.
 These are checked in functions which set servo position.
-Note that angle to us is converted using these values, see servo_angle_to_micros().
+Note that angle to us is converted using these values, see servo_angle_to_nanos().
 For example, if you limit the MIN_PULSE=1100 and MAX_PULSE=1900, the output pulse
 width for angle 0 will be 1100 us and for 180 degrees it will be 1900 us.
+These limits apply to the PWM profiles, the oneshot profiles have their own ranges.
  */
 #ifndef RC_SERVO_MIN_PULSE
 #define RC_SERVO_MIN_PULSE (1000)
@@ -60,6 +65,18 @@ width for angle 0 will be 1100 us and for 180 degrees it will be 1900 us.
 #define RC_SERVO_MAX_ANGLE (180)
 #endif
 
+/*! @brief Minimal low time between two output pulses. In nano seconds
+ */
+#ifndef RC_SERVO_MIN_FRAME_GAP_NS
+#define RC_SERVO_MIN_FRAME_GAP_NS (2000)
+#endif
+
+/*! @brief Safety margin before a wrap for latching a group commit. In nano seconds
+ */
+#ifndef RC_GROUP_COMMIT_MARGIN_NS
+#define RC_GROUP_COMMIT_MARGIN_NS (5000)
+#endif
+
 // Internal definitions
 // Events we monitor on gpio pins
 #define EVENT_EDGE_RISE (1 << 3)
@@ -72,6 +89,7 @@ struct rc_channel_info
     uint gpio_pin;
     uint32_t pulse_us;
     uint64_t pulse_start;
+    rc_input_callback_t callback;
 };
 
 // Allocate the structs for supported number of pins;
@@ -81,11 +99,26 @@ struct rc_channel_info gRcInputChannels[RC_MAX_CHANNELS];
 // Index to gRcInputChannels array - also the number of initialized inputs.
 static uint gRcLastPulsesIndex = 0;
 
+// Valid input pulse window, see rc_set_input_limits()
+static uint32_t gRcMinPulseWidth = RC_MIN_PULSE_WIDTH;
+static uint32_t gRcMaxPulseWidth = RC_MAX_PULSE_WIDTH;
+
+// Playback table in ns and the compare register words written by DMA,
+// provided by the user with rc_play_set_table()
+static uint32_t* gPlayNanos = NULL;
+static uint32_t* gPlayCC = NULL;
+static uint gPlayMax = 0;
+static uint gPlayCount = 0;
+static volatile uint gPlayLoops = 0;
+static volatile bool gPlayRunning = false;
+static int gPlayDmaChan = -1;
+
 // prototypes for internal functions
 static int get_pin_index(uint pin);
 static void rc_isr_internal(uint pin_index, uint32_t events);
 static void rc_gpio_irq_raw_handler(void);
-static uint servo_angle_to_micros(uint angle);
+static uint32_t servo_angle_to_nanos(const rc_servo* servo, uint angle);
+static void rc_play_dma_handler(void);
 
 //
 // Public functions
@@ -93,6 +126,9 @@ static uint servo_angle_to_micros(uint angle);
 
 bool rc_init_input(uint gpio_pin, bool start_monitoring)
 {
+    // a pin initialized again keeps its slot
+    if (get_pin_index(gpio_pin) >= 0)
+        rc_deinit_input(gpio_pin);
 
     assert(gRcLastPulsesIndex < RC_MAX_CHANNELS);// cannot enable more channels, increase RC_MAX_CHANNELS
     if (!(gRcLastPulsesIndex < RC_MAX_CHANNELS))
@@ -102,6 +138,7 @@ bool rc_init_input(uint gpio_pin, bool start_monitoring)
     gRcInputChannels[gRcLastPulsesIndex].gpio_pin = gpio_pin;
     gRcInputChannels[gRcLastPulsesIndex].pulse_us = 0;
     gRcInputChannels[gRcLastPulsesIndex].pulse_start = 0;
+    gRcInputChannels[gRcLastPulsesIndex].callback = NULL;
     gRcLastPulsesIndex++;
 
     gpio_init(gpio_pin);
@@ -117,6 +154,22 @@ bool rc_init_input(uint gpio_pin, bool start_monitoring)
     return true;
 }
 
+void rc_deinit_input(uint gpio_pin)
+{
+    int index = get_pin_index(gpio_pin);
+    if (index < 0)
+        return;
+
+    gpio_set_irq_enabled(gpio_pin, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, false);
+    gpio_remove_raw_irq_handler(gpio_pin, rc_gpio_irq_raw_handler);
+
+    // move the last channel into the free slot
+    uint32_t irq_status = save_and_disable_interrupts();
+    gRcLastPulsesIndex--;
+    gRcInputChannels[index] = gRcInputChannels[gRcLastPulsesIndex];
+    restore_interrupts(irq_status);
+}
+
 void rc_set_input_enabled(uint gpio_pin, bool enable)
 {
     // enable/disable irq for given pin
@@ -148,16 +201,55 @@ void rc_reset_input_pulse_width(uint gpio_pin)
     gRcInputChannels[index].pulse_us = 0;
 }
 
+void rc_set_input_limits(uint32_t min_us, uint32_t max_us)
+{
+    gRcMinPulseWidth = min_us;
+    gRcMaxPulseWidth = max_us;
+}
+
+void rc_set_input_callback(uint gpio_pin, rc_input_callback_t callback)
+{
+    int index = get_pin_index(gpio_pin);
+    if (index < 0)
+        return;
+    gRcInputChannels[index].callback = callback;
+}
+
 
 // channel within slice is A for even pins (0,2,4,..) and B for odd pins (1,3,...)
 #define SERVO_PIN2CHANNEL(pin) pwm_gpio_to_channel(pin)
 //((pin) & 1) ? PWM_CHAN_B : PWM_CHAN_A)
 
+// predefined output profiles, indexed by rc_servo_proto
+static const rc_servo_profile gRcServoProfiles[RC_PROTO_COUNT] = {
+    [RC_PROTO_PWM] = { "pwm", 50, RC_SERVO_MIN_PULSE * 1000, RC_SERVO_MAX_PULSE * 1000, false },
+    [RC_PROTO_PWM_FAST] = { "pwm400", 400, RC_SERVO_MIN_PULSE * 1000, RC_SERVO_MAX_PULSE * 1000, false },
+    [RC_PROTO_ONESHOT125] = { "oneshot125", 2000, 125000, 250000, true },
+    [RC_PROTO_ONESHOT42] = { "oneshot42", 4000, 41667, 83333, true },
+    [RC_PROTO_MULTISHOT] = { "multishot", 8000, 5000, 25000, true },
+};
+
+const rc_servo_profile* rc_servo_get_profile(rc_servo_proto proto)
+{
+    if (proto >= RC_PROTO_COUNT)
+        return NULL;
+    return &gRcServoProfiles[proto];
+}
+
 /* create servo "object" */
 rc_servo rc_servo_init(uint pin)
 {
-    rc_servo s = { 0, 0 };
+    return rc_servo_init_profile(pin, &gRcServoProfiles[RC_PROTO_PWM]);
+}
+
+/* create servo "object" for given output profile */
+rc_servo rc_servo_init_profile(uint pin, const rc_servo_profile* profile)
+{
+    rc_servo s = { 0 };
     s.pin = pin;
+    s.min_pulse_ns = profile->min_pulse_ns;
+    s.max_pulse_ns = profile->max_pulse_ns;
+    s.sync = profile->sync;
 
     // Tell the GPIO pin it is allocated to the PWM
     gpio_set_function(pin, GPIO_FUNC_PWM);
@@ -165,24 +257,41 @@ rc_servo rc_servo_init(uint pin)
     // Find out which PWM slice is connected to GPIO 0 (it's slice 0)
     s.slice_num = pwm_gpio_to_slice_num(pin);
 
+    // the longest pulse plus a minimal gap must fit into one frame
+    uint32_t frame_hz = profile->frame_hz;
+    uint32_t max_hz = 1000000000u / (s.max_pulse_ns + RC_SERVO_MIN_FRAME_GAP_NS);
+    if (frame_hz > max_hz)
+        frame_hz = max_hz;
+    if (frame_hz < 1)
+        frame_hz = 1;
+
     // Support for various system clock settings, e.g. if user
     // sets 48 MHz using set_sys_clock_48mhz()
     uint32_t clk = clock_get_hz(clk_sys);// clk_sys
-    // aim at 50 Hz with counter running to 20 000
-    uint32_t div = clk / (20000 * 50);
-    // div must be between 1 and 255
-    // which is true for clock from 1 MHz to 255 MHz, so it
-    // should be safe to assume the div is within range
-    if (div < 1)
-        div = 1;
-    if (div > 255)
-        div = 255;
+    // use the smallest 8.4 divider which still lets one frame fit into the
+    // 16 bit counter, this gives the finest pulse resolution for the frame rate
+    uint64_t clk16 = (uint64_t)clk * 16;
+    uint64_t frame_counts = (uint64_t)frame_hz * 65536;
+    uint32_t div16 = (uint32_t)((clk16 + frame_counts - 1) / frame_counts);
+    // div must be between 1.0 and 255.9375
+    if (div16 < 16)
+        div16 = 16;
+    if (div16 > 4095)
+        div16 = 4095;
+    // round the wrap to the nearest count, the fraction keeps the period error small
+    uint64_t counts_div = (uint64_t)div16 * frame_hz;
+    uint32_t wrap = (uint32_t)((clk16 + counts_div / 2) / counts_div) - 1;
+    if (wrap > 65535)
+        wrap = 65535;
+    s.clkdiv16 = div16;
+    s.wrap = wrap;
+    // counter ticks per ns, Q32 - below 1 for any clock up to 1 GHz; 1e9 / 16 = 62500000
+    s.ns_scale = (uint32_t)(((uint64_t)clk << 32) / ((uint64_t)div16 * 62500000u));
+    s.period_ns = (uint32_t)((uint64_t)(wrap + 1) * div16 * 62500000u / clk);
 
     pwm_config config = pwm_get_default_config();
-    // Set divider to get 50 Hz
-    pwm_config_set_clkdiv(&config, (float)div);
-    // Set wrap to count to 20000, so the period is 20 ms
-    pwm_config_set_wrap(&config, 20000);
+    pwm_config_set_clkdiv_int_frac(&config, div16 >> 4, div16 & 0xf);
+    pwm_config_set_wrap(&config, wrap);
     // Load the configuration into our PWM slice, and set it running.
     pwm_init(s.slice_num, &config, false);
     // invert pwm on pin
@@ -192,6 +301,35 @@ rc_servo rc_servo_init(uint pin)
     return s;
 }
 
+/* convert pulse length in ns to counter level */
+static inline uint servo_nanos_to_level(const rc_servo* servo, uint32_t nanos)
+{
+    return (uint)(((uint64_t)nanos * servo->ns_scale + (1u << 31)) >> 32);
+}
+
+/* write new level, in synchronized mode restart the frame so it goes out right away */
+static void servo_write_level(const rc_servo* servo, uint level)
+{
+    const uint channel = SERVO_PIN2CHANNEL(servo->pin);
+
+    if (!servo->sync)
+    {
+        pwm_set_chan_level(servo->slice_num, channel, level);
+        return;
+    }
+
+    uint32_t irq_status = save_and_disable_interrupts();
+    // level of the pulse currently running; pending and latched value are
+    // the same here as a synchronized write wraps the counter right away
+    uint32_t cc = pwm_hw->slice[servo->slice_num].cc;
+    uint old_level = (channel == PWM_CHAN_A) ? (cc & 0xffff) : (cc >> 16);
+    pwm_set_chan_level(servo->slice_num, channel, level);
+    // never cut a running pulse short, it would be a valid but wrong value for the ESC
+    if (pwm_get_counter(servo->slice_num) >= old_level)
+        pwm_set_counter(servo->slice_num, servo->wrap);
+    restore_interrupts(irq_status);
+}
+
 /* Start generating pwm*/
 void rc_servo_start(const rc_servo* servo, uint angle)
 {
@@ -201,7 +339,7 @@ void rc_servo_start(const rc_servo* servo, uint angle)
         return;
 
     const uint channel = SERVO_PIN2CHANNEL(servo->pin);
-    uint pulse = servo_angle_to_micros(angle);
+    uint pulse = servo_nanos_to_level(servo, servo_angle_to_nanos(servo, angle));
     pwm_set_chan_level(servo->slice_num, channel, pulse);
     pwm_set_enabled(servo->slice_num, true);
 }
@@ -221,6 +359,14 @@ void rc_servo_stop(const rc_servo* servo, bool stop_slice)
     }
 }
 
+void rc_servo_deinit(const rc_servo* servo)
+{
+    pwm_set_enabled(servo->slice_num, false);
+    pwm_set_chan_level(servo->slice_num, SERVO_PIN2CHANNEL(servo->pin), 0);
+    // back to a plain input, the output buffer sees its idle level
+    gpio_init(servo->pin);
+}
+
 /* set angle for servo. */
 void rc_servo_set_angle(const rc_servo* servo, uint angle)
 {
@@ -229,21 +375,333 @@ void rc_servo_set_angle(const rc_servo* servo, uint angle)
     if (angle < RC_SERVO_MIN_ANGLE || angle > RC_SERVO_MAX_ANGLE)
         return;
 
-    const uint channel = SERVO_PIN2CHANNEL(servo->pin);
-    uint pulse = servo_angle_to_micros(angle);
-    pwm_set_chan_level(servo->slice_num, channel, pulse);
+    servo_write_level(servo, servo_nanos_to_level(servo, servo_angle_to_nanos(servo, angle)));
 }
 
-/* Set pulse width in microseconds (1000 to 2000)*/
+/* Set pulse width in microseconds (within range of the profile)*/
 void rc_servo_set_micros(const rc_servo* servo, uint micros)
 {
-    valid_params_if(RC, (micros >= RC_SERVO_MIN_PULSE && micros <= RC_SERVO_MAX_PULSE));
+    rc_servo_set_nanos(servo, micros * 1000);
+}
+
+/* Set pulse width in nanoseconds (within range of the profile)*/
+void rc_servo_set_nanos(const rc_servo* servo, uint32_t nanos)
+{
+    valid_params_if(RC, (nanos >= servo->min_pulse_ns && nanos <= servo->max_pulse_ns));
     // normal runtime check of params
-    if (micros < RC_SERVO_MIN_PULSE || micros > RC_SERVO_MAX_PULSE)
+    if (nanos < servo->min_pulse_ns || nanos > servo->max_pulse_ns)
         return;// do nothing
 
+    servo_write_level(servo, servo_nanos_to_level(servo, nanos));
+}
+
+//
+// Multi channel servo output
+//
+
+bool rc_group_init(rc_servo_group* group, const uint* pins, uint count, const rc_servo_profile* profile)
+{
+    uint32_t chan_mask = 0;
+
+    valid_params_if(RC, (count >= 1 && count <= RC_GROUP_MAX_CHANNELS));
+    if (count < 1 || count > RC_GROUP_MAX_CHANNELS)
+        return false;
+
+    // every pin needs its own slice channel
+    for (uint i = 0; i < count; i++)
+    {
+        uint bit = 1u << (pwm_gpio_to_slice_num(pins[i]) * 2 + SERVO_PIN2CHANNEL(pins[i]));
+        if (chan_mask & bit)
+            return false;
+        chan_mask |= bit;
+    }
+
+    group->count = count;
+    group->slice_mask = 0;
+    for (uint i = 0; i < count; i++)
+    {
+        group->ch[i] = rc_servo_init_profile(pins[i], profile);
+        group->slice_mask |= 1u << group->ch[i].slice_num;
+    }
+    // pwm_init() cleared the compare registers, all channels start without pulse
+    for (uint s = 0; s < NUM_PWM_SLICES; s++)
+        group->cc[s] = 0;
+
+    return true;
+}
+
+void rc_group_start(rc_servo_group* group)
+{
+    // stop, preload and reset all slices, then enable them with one register write
+    pwm_set_mask_enabled(pwm_hw->en & ~group->slice_mask);
+    for (uint s = 0; s < NUM_PWM_SLICES; s++)
+    {
+        if (group->slice_mask & (1u << s))
+        {
+            pwm_hw->slice[s].cc = group->cc[s];
+            pwm_set_counter(s, 0);
+        }
+    }
+    pwm_set_mask_enabled(pwm_hw->en | group->slice_mask);
+}
+
+void rc_group_stop(rc_servo_group* group)
+{
+    pwm_set_mask_enabled(pwm_hw->en & ~group->slice_mask);
+}
+
+bool rc_group_set_nanos(rc_servo_group* group, uint index, uint32_t nanos)
+{
+    if (index >= group->count)
+        return false;
+
+    const rc_servo* servo = &group->ch[index];
+    valid_params_if(RC, (nanos >= servo->min_pulse_ns && nanos <= servo->max_pulse_ns));
+    if (nanos < servo->min_pulse_ns || nanos > servo->max_pulse_ns)
+        return false;
+
+    uint32_t level = servo_nanos_to_level(servo, nanos);
+    if (SERVO_PIN2CHANNEL(servo->pin) == PWM_CHAN_A)
+        group->cc[servo->slice_num] = (group->cc[servo->slice_num] & 0xffff0000) | level;
+    else
+        group->cc[servo->slice_num] = (group->cc[servo->slice_num] & 0x0000ffff) | (level << 16);
+    return true;
+}
+
+bool rc_group_set_angle(rc_servo_group* group, uint index, uint angle)
+{
+    valid_params_if(RC, (angle >= RC_SERVO_MIN_ANGLE && angle <= RC_SERVO_MAX_ANGLE));
+    if (index >= group->count || angle < RC_SERVO_MIN_ANGLE || angle > RC_SERVO_MAX_ANGLE)
+        return false;
+
+    return rc_group_set_nanos(group, index, servo_angle_to_nanos(&group->ch[index], angle));
+}
+
+// counter of the reference slice outside the last margin before the wrap and
+// behind the end of the running pulses
+static inline bool group_commit_window(const rc_servo* ref, uint margin, uint pulse_end)
+{
+    uint ctr = pwm_get_counter(ref->slice_num);
+
+    return ctr + margin <= ref->wrap && ctr >= pulse_end;
+}
+
+bool rc_group_commit(rc_servo_group* group)
+{
+    // all slices share divider and wrap and were started in phase,
+    // so the first channel's slice is the time reference for all of them
+    const rc_servo* ref = &group->ch[0];
+    uint margin = servo_nanos_to_level(ref, RC_GROUP_COMMIT_MARGIN_NS) + 1;
+    uint pulse_end = 0;
+    bool pulses_done = ref->sync;
+    uint32_t irq_status;
+
+    // a synchronized restart waits for the end of the longest running pulse
+    if (ref->sync)
+    {
+        for (uint s = 0; s < NUM_PWM_SLICES; s++)
+        {
+            if (group->slice_mask & (1u << s))
+            {
+                uint32_t cc = pwm_hw->slice[s].cc;
+                if ((cc & 0xffff) > pulse_end)
+                    pulse_end = cc & 0xffff;
+                if ((cc >> 16) > pulse_end)
+                    pulse_end = cc >> 16;
+            }
+        }
+        if (pulse_end + margin > ref->wrap)
+            pulse_end = 0;
+    }
+
+    // the compare registers are double buffered and latched on wrap; the writes
+    // must not straddle a wrap or some channels would latch one frame later.
+    // Waited for with interrupts enabled, checked again with them disabled
+    while (1)
+    {
+        while (!group_commit_window(ref, margin, pulse_end))
+            tight_loop_contents();
+        irq_status = save_and_disable_interrupts();
+        if (group_commit_window(ref, margin, pulse_end))
+            break;
+        restore_interrupts(irq_status);
+    }
+
+    for (uint s = 0; s < NUM_PWM_SLICES; s++)
+    {
+        if (group->slice_mask & (1u << s))
+        {
+            uint32_t cc = pwm_hw->slice[s].cc;
+            uint16_t ctr = pwm_get_counter(s);
+            if (ctr < (cc & 0xffff) || ctr < (cc >> 16))
+                pulses_done = false;
+            pwm_hw->slice[s].cc = group->cc[s];
+        }
+    }
+
+    if (pulses_done)
+    {
+        // synchronized profile: restart every slice of the group together
+        pwm_set_mask_enabled(pwm_hw->en & ~group->slice_mask);
+        for (uint s = 0; s < NUM_PWM_SLICES; s++)
+        {
+            if (group->slice_mask & (1u << s))
+                pwm_set_counter(s, ref->wrap);
+        }
+        pwm_set_mask_enabled(pwm_hw->en | group->slice_mask);
+    }
+
+    restore_interrupts(irq_status);
+    return !ref->sync || pulses_done;
+}
+
+uint32_t rc_servo_get_frame_hz(const rc_servo* servo)
+{
+    return (uint32_t)((uint64_t)clock_get_hz(clk_sys) * 16 / servo->clkdiv16 / (servo->wrap + 1u));
+}
+
+uint32_t rc_servo_get_period_ns(const rc_servo* servo)
+{
+    return servo->period_ns;
+}
+
+uint32_t rc_servo_get_resolution_ps(const rc_servo* servo)
+{
+    // one tick is div16 / 16 / clk seconds
+    return (uint32_t)((uint64_t)servo->clkdiv16 * 62500000000ull / clock_get_hz(clk_sys));
+}
+
+//
+// Trajectory playback
+//
+
+void rc_play_set_table(uint32_t* nanos, uint32_t* cc, uint max_points)
+{
+    rc_play_stop();
+    gPlayNanos = nanos;
+    gPlayCC = cc;
+    gPlayMax = max_points;
+    gPlayCount = 0;
+}
+
+void rc_play_clear(void)
+{
+    rc_play_stop();
+    gPlayCount = 0;
+}
+
+bool rc_play_add(uint32_t nanos, uint frames)
+{
+    if (gPlayRunning || frames > gPlayMax - gPlayCount)
+        return false;
+
+    while (frames--)
+        gPlayNanos[gPlayCount++] = nanos;
+    return true;
+}
+
+bool rc_play_add_ramp(uint32_t from_ns, uint32_t to_ns, uint frames)
+{
+    if (gPlayRunning || frames > gPlayMax - gPlayCount)
+        return false;
+
+    int32_t span = (int32_t)(to_ns - from_ns);
+    for (uint i = 0; i < frames; i++)
+    {
+        // last frame hits to_ns exactly
+        int32_t step = (frames > 1) ? (int32_t)((int64_t)span * i / (frames - 1)) : span;
+        gPlayNanos[gPlayCount++] = (uint32_t)((int32_t)from_ns + step);
+    }
+    return true;
+}
+
+bool rc_play_add_sine(uint32_t center_ns, uint32_t amplitude_ns, uint period_frames, uint frames)
+{
+    if (gPlayRunning || period_frames == 0 || frames > gPlayMax - gPlayCount)
+        return false;
+
+    const float w = 2.0f * (float)M_PI / (float)period_frames;
+    for (uint i = 0; i < frames; i++)
+    {
+        int32_t dev = (int32_t)lroundf((float)amplitude_ns * sinf(w * (float)i));
+        gPlayNanos[gPlayCount++] = (uint32_t)((int32_t)center_ns + dev);
+    }
+    return true;
+}
+
+uint rc_play_get_count(void)
+{
+    return gPlayCount;
+}
+
+bool rc_play_start(const rc_servo* servo, uint loops)
+{
+    if (gPlayCount == 0)
+        return false;
+    rc_play_stop();
+
     const uint channel = SERVO_PIN2CHANNEL(servo->pin);
-    pwm_set_chan_level(servo->slice_num, channel, micros);
+    // a 16 bit write would be replicated to both channels of the slice,
+    // so build full register words that keep the other channel's level
+    uint32_t cc = pwm_hw->slice[servo->slice_num].cc;
+    uint32_t keep = (channel == PWM_CHAN_A) ? (cc & 0xffff0000) : (cc & 0x0000ffff);
+    uint shift = (channel == PWM_CHAN_A) ? 0 : 16;
+    for (uint i = 0; i < gPlayCount; i++)
+    {
+        uint32_t ns = gPlayNanos[i];
+        if (ns < servo->min_pulse_ns)
+            ns = servo->min_pulse_ns;
+        if (ns > servo->max_pulse_ns)
+            ns = servo->max_pulse_ns;
+        gPlayCC[i] = keep | (servo_nanos_to_level(servo, ns) << shift);
+    }
+
+    if (gPlayDmaChan < 0)
+    {
+        gPlayDmaChan = dma_claim_unused_channel(true);
+        irq_add_shared_handler(DMA_IRQ_0, rc_play_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+    }
+
+    // one transfer per PWM wrap straight into the compare register
+    dma_channel_config c = dma_channel_get_default_config(gPlayDmaChan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, DREQ_PWM_WRAP0 + servo->slice_num);
+
+    gPlayLoops = loops;
+    gPlayRunning = true;
+    dma_channel_acknowledge_irq0(gPlayDmaChan);
+    dma_channel_set_irq0_enabled(gPlayDmaChan, true);
+    dma_channel_configure(gPlayDmaChan, &c, &pwm_hw->slice[servo->slice_num].cc, gPlayCC, gPlayCount, true);
+    return true;
+}
+
+void rc_play_stop(void)
+{
+    if (gPlayDmaChan < 0)
+        return;
+
+    gPlayRunning = false;
+    // disable the irq first, abort can raise a spurious completion
+    dma_channel_set_irq0_enabled(gPlayDmaChan, false);
+    dma_channel_abort(gPlayDmaChan);
+    dma_channel_acknowledge_irq0(gPlayDmaChan);
+}
+
+bool rc_play_is_running(void)
+{
+    return gPlayRunning;
+}
+
+uint rc_play_get_position(void)
+{
+    if (!gPlayRunning)
+        return 0;
+    // transfer_count reads back the number of transfers left
+    uint left = dma_hw->ch[gPlayDmaChan].transfer_count;
+    return (left < gPlayCount) ? gPlayCount - left - 1 : 0;
 }
 
 /* internal helper, Arduino-style map() function. */
@@ -252,16 +710,16 @@ static inline uint map(uint x, uint in_min, uint in_max, uint out_min, uint out_
     return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
-/* Convert angle to microseconds = pulse length
- With default ranges it maps 0-180 deg to 1000-2000 us
+/* Convert angle to nanoseconds = pulse length
+ With the PWM profile it maps 0-180 deg to 1000-2000 us
  0 deg = 1000 us
  180 deg = 2000 us
  */
-static uint servo_angle_to_micros(uint angle)
+static uint32_t servo_angle_to_nanos(const rc_servo* servo, uint angle)
 {
     // we don't check if angle is valid; the caller must do so.
-    uint us = map(angle, RC_SERVO_MIN_ANGLE, RC_SERVO_MAX_ANGLE, RC_SERVO_MIN_PULSE, RC_SERVO_MAX_PULSE);
-    return us;
+    uint32_t ns = map(angle, RC_SERVO_MIN_ANGLE, RC_SERVO_MAX_ANGLE, servo->min_pulse_ns, servo->max_pulse_ns);
+    return ns;
 }
 
 //
@@ -282,8 +740,11 @@ static void rc_isr_internal(uint pin_index, uint32_t events)
         if (gRcInputChannels[pin_index].pulse_start > 0)
         {
             uint32_t diff = (uint32_t)(now - gRcInputChannels[pin_index].pulse_start);
+            if (gRcInputChannels[pin_index].callback)
+                gRcInputChannels[pin_index].callback(gRcInputChannels[pin_index].gpio_pin,
+                                                     gRcInputChannels[pin_index].pulse_start, diff);
             gRcInputChannels[pin_index].pulse_start = 0;
-            if (diff >= RC_MIN_PULSE_WIDTH && diff <= RC_MAX_PULSE_WIDTH)
+            if (diff >= gRcMinPulseWidth && diff <= gRcMaxPulseWidth)
                 gRcInputChannels[pin_index].pulse_us = (uint32_t)diff;
             else
                 gRcInputChannels[pin_index].pulse_us = 0;
@@ -310,6 +771,26 @@ static void rc_gpio_irq_raw_handler(void)
     }
 }
 
+// DMA completion: restart the table for the next loop. The last entry was
+// just written after a wrap, so there is a full frame left to re-trigger.
+static void rc_play_dma_handler(void)
+{
+    if (gPlayDmaChan < 0 || !dma_channel_get_irq0_status(gPlayDmaChan))
+        return;
+    dma_channel_acknowledge_irq0(gPlayDmaChan);
+
+    if (gPlayLoops != 1)
+    {
+        if (gPlayLoops)
+            gPlayLoops--;
+        dma_channel_set_read_addr(gPlayDmaChan, gPlayCC, true);
+    }
+    else
+    {
+        gPlayRunning = false;
+    }
+}
+
 // Helper to find struct with pin info
 // Returns index to gRcInputChannels array.
 static int get_pin_index(uint pin)
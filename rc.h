@@ -22,6 +22,12 @@ extern "C"
     */
     bool rc_init_input(uint gpio_pin, bool start_monitoring);
 
+    /*! \brief Stop measuring on given pin and release its channel and interrupt.
+     * The pin itself is left as input.
+     *   \param gpio_pin
+     */
+    void rc_deinit_input(uint gpio_pin);
+
     /*! \brief enable or disable monitoring of given pin
      *   \param gpio_pin
      *   \param enabled ture to enable channel; pulse with can be read by pulseio_get_rc_input_pulse
@@ -46,27 +52,104 @@ extern "C"
      */
     void rc_reset_input_pulse_width(uint gpio_pin);
 
+    /*! \brief Set the window of valid input pulse widths for all pins,
+     * the default is RC_MIN_PULSE_WIDTH to RC_MAX_PULSE_WIDTH.
+     *   \param min_us
+     *   \param max_us
+     */
+    void rc_set_input_limits(uint32_t min_us, uint32_t max_us);
+
+    /*! \brief Callback for every captured pulse, called from the gpio interrupt.
+     *   \param gpio_pin
+     *   \param start_us time of the leading edge in micro seconds since boot
+     *   \param width_us pulse width in micro seconds, not limited to the valid range
+     */
+    typedef void (*rc_input_callback_t)(uint gpio_pin, uint64_t start_us, uint32_t width_us);
+
+    /*! \brief Set or clear (NULL) the capture callback of an input pin.
+     * Pin must be initialized by rc_init_input() first.
+     *   \param gpio_pin
+     *   \param callback
+     */
+    void rc_set_input_callback(uint gpio_pin, rc_input_callback_t callback);
+
     /*
     **** Servo motor control
     */
 
+    /*! \brief Output protocols with a predefined profile, see rc_servo_get_profile()
+     */
+    typedef enum
+    {
+        RC_PROTO_PWM = 0,    // standard servo PWM, 50 Hz, 1000-2000 us
+        RC_PROTO_PWM_FAST,   // fast ESC PWM, 400 Hz, 1000-2000 us
+        RC_PROTO_ONESHOT125, // 125-250 us, 2 kHz, synchronized
+        RC_PROTO_ONESHOT42,  // 42-84 us, 4 kHz, synchronized
+        RC_PROTO_MULTISHOT,  // 5-25 us, 8 kHz, synchronized
+        RC_PROTO_COUNT
+    } rc_servo_proto;
+
+    /*! \brief Output profile: frame rate, valid pulse range and update behaviour.
+     * In free-running mode a new value is latched at the end of the running frame.
+     * In synchronized mode the frame is restarted as soon as a new value is written
+     * (once the running pulse is complete), so frame_hz is only the idle repeat rate.
+     */
+    typedef struct
+    {
+        const char* name;
+        uint32_t frame_hz;
+        uint32_t min_pulse_ns;
+        uint32_t max_pulse_ns;
+        bool sync;
+    } rc_servo_profile;
+
     /*! \brief Servo data returned when servo is initialized
      */
     typedef struct
     {
         uint pin;
         uint slice_num;
-
+        uint16_t wrap;      // counter top, one frame is wrap + 1 counts
+        uint16_t clkdiv16;  // 8.4 fractional clock divider of the slice, in 1/16
+        uint32_t ns_scale;  // counter ticks per ns as Q32 fixed point
+        uint32_t period_ns; // frame period actually achieved
+        uint32_t min_pulse_ns;
+        uint32_t max_pulse_ns;
+        bool sync;
     } rc_servo;
 
+    /**
+     * \brief Get the predefined profile of an output protocol.
+     * \ingroup servo
+     *
+     * \param proto protocol, see rc_servo_proto
+     * \return the profile or NULL if proto is invalid
+     */
+    const rc_servo_profile* rc_servo_get_profile(rc_servo_proto proto);
+
     /**
      * \brief Creates servo object attached to given pin. This is then passed to servo functions.
+     * Same as rc_servo_init_profile() with the RC_PROTO_PWM profile (50 Hz).
      * \ingroup servo
      *
      * \param pin GPIO pin to be used for this servo.
      */
     rc_servo rc_servo_init(uint pin);
 
+    /**
+     * \brief Creates servo object attached to given pin using the given output profile.
+     * Divider and wrap are chosen so that one frame uses as much of the 16 bit counter
+     * as possible, the 8.4 fractional divider keeps the period close to 1 / frame_hz for
+     * any system clock. The fractional divider dithers the counter clock, so single counts
+     * jitter by one system clock period. frame_hz is limited so that the longest pulse
+     * still fits into a frame.
+     * \ingroup servo
+     *
+     * \param pin GPIO pin to be used for this servo.
+     * \param profile output profile, predefined or custom
+     */
+    rc_servo rc_servo_init_profile(uint pin, const rc_servo_profile* profile);
+
     /**
      * \brief Start generating pwm.
      * \ingroup servo
@@ -87,8 +170,18 @@ extern "C"
      */
     void rc_servo_stop(const rc_servo* servo, bool stop_slice);
 
+    /**
+     * \brief Stop the slice and give the servo pin back to SIO as input.
+     * \ingroup servo
+     *
+     * Stop a running playback or measurement on this servo first.
+     * \param servo
+     */
+    void rc_servo_deinit(const rc_servo* servo);
+
     /**
      * \brief Set the angle of servo lever.
+     * The angle is mapped onto the pulse range of the servo profile.
      * \param servo
      * \param angle The angle to set, 0 to 180.
      */
@@ -97,10 +190,191 @@ extern "C"
     /**
      * \brief Set the pulse width for the servo directly in microseconds.
      * \param servo
-     * \param angle Pulse length to set, 1000 to 2000.
+     * \param angle Pulse length to set, within the pulse range of the profile (1000 to 2000 for PWM).
      */
     void rc_servo_set_micros(const rc_servo* servo, uint micros);
 
+    /**
+     * \brief Set the pulse width for the servo directly in nanoseconds.
+     * The value is rounded to the counter resolution, see rc_servo_get_resolution_ps().
+     * \param servo
+     * \param nanos Pulse length to set, within the pulse range of the profile.
+     */
+    void rc_servo_set_nanos(const rc_servo* servo, uint32_t nanos);
+
+    /**
+     * \brief Get the frame rate the servo output is running at.
+     * \param servo
+     * \return frame rate in Hz
+     */
+    uint32_t rc_servo_get_frame_hz(const rc_servo* servo);
+
+    /**
+     * \brief Get the frame period actually achieved with divider and wrap.
+     * \param servo
+     * \return frame period in ns
+     */
+    uint32_t rc_servo_get_period_ns(const rc_servo* servo);
+
+    /**
+     * \brief Get the pulse width resolution, i.e. the length of one counter tick.
+     * \param servo
+     * \return tick length in ps
+     */
+    uint32_t rc_servo_get_resolution_ps(const rc_servo* servo);
+
+    /*
+    **** Multi channel servo output
+    */
+
+#ifndef RC_GROUP_MAX_CHANNELS
+#define RC_GROUP_MAX_CHANNELS 16
+#endif
+
+    /*! \brief Group of servo outputs sharing one profile. All slices of a group run
+     * phase aligned and new levels are collected in shadow registers, so that
+     * rc_group_commit() latches all channels at the same frame boundary.
+     */
+    typedef struct
+    {
+        rc_servo ch[RC_GROUP_MAX_CHANNELS];
+        uint count;
+        uint32_t slice_mask;
+        uint32_t cc[NUM_PWM_SLICES]; // shadow compare registers, both channels of a slice
+    } rc_servo_group;
+
+    /**
+     * \brief Init a group of servo outputs. Every pin must use its own slice channel
+     * (e.g. GPIO0 and GPIO16 both are slice 0 channel A and cannot be combined).
+     * All outputs start with level 0 (no pulse).
+     * \ingroup servo
+     *
+     * \param group group to init
+     * \param pins GPIO pins, index in this array is the channel index of the group
+     * \param count number of pins, up to RC_GROUP_MAX_CHANNELS
+     * \param profile output profile used for all channels
+     * \return false if count is invalid or two pins share a slice channel
+     */
+    bool rc_group_init(rc_servo_group* group, const uint* pins, uint count, const rc_servo_profile* profile);
+
+    /**
+     * \brief Load the shadow levels and start all slices of the group in phase.
+     * Slices not in the group keep running.
+     * \ingroup servo
+     */
+    void rc_group_start(rc_servo_group* group);
+
+    /**
+     * \brief Stop all slices of the group.
+     * \ingroup servo
+     */
+    void rc_group_stop(rc_servo_group* group);
+
+    /**
+     * \brief Set the pulse width of one channel in the shadow registers.
+     * Takes effect with the next rc_group_commit().
+     * \param group
+     * \param index channel index in the group
+     * \param nanos pulse width in ns, within the range of the profile
+     * \return false if index or pulse width is invalid
+     */
+    bool rc_group_set_nanos(rc_servo_group* group, uint index, uint32_t nanos);
+
+    /**
+     * \brief Set the angle of one channel in the shadow registers.
+     * Takes effect with the next rc_group_commit().
+     * \param group
+     * \param index channel index in the group
+     * \param angle The angle to set, 0 to 180.
+     * \return false if index or angle is invalid
+     */
+    bool rc_group_set_angle(rc_servo_group* group, uint index, uint angle);
+
+    /**
+     * \brief Latch the shadow levels of all channels at the same frame boundary.
+     * With a synchronized profile all slices are restarted together once the
+     * running pulses are complete. The wait for the frame position is done with
+     * interrupts enabled, only the register writes run with them disabled.
+     * \param group
+     * \return false if a synchronized group could not be restarted because a pulse
+     * was still running, the levels are then latched at the end of the running frame
+     * like a free-running profile
+     */
+    bool rc_group_commit(rc_servo_group* group);
+
+    /*
+    **** Trajectory playback
+    */
+
+/*! \brief Size of the playback table in frames, the servo tester takes it from the mode arena
+ */
+#ifndef RC_PLAY_MAX_POINTS
+#define RC_PLAY_MAX_POINTS 1024
+#endif
+
+    /*! \brief Set the memory of the playback table. A running playback is stopped
+     * and the table is cleared. The memory must stay valid until the table is
+     * set again, pass NULL and 0 to release it.
+     *   \param nanos pulse widths in ns, max_points entries
+     *   \param cc compare register words written by DMA, max_points entries
+     *   \param max_points size of the table in frames
+     */
+    void rc_play_set_table(uint32_t* nanos, uint32_t* cc, uint max_points);
+
+    /*! \brief Clear the playback table. A running playback is stopped.
+     */
+    void rc_play_clear(void);
+
+    /*! \brief Append a constant pulse width to the playback table.
+     *   \param nanos pulse width in ns
+     *   \param frames number of output frames to hold the value
+     *   \return false if the table is full or playback is running
+     */
+    bool rc_play_add(uint32_t nanos, uint frames);
+
+    /*! \brief Append a linear ramp to the playback table.
+     *   \param from_ns pulse width of the first frame
+     *   \param to_ns pulse width of the last frame
+     *   \param frames length of the ramp in output frames
+     *   \return false if the table is full or playback is running
+     */
+    bool rc_play_add_ramp(uint32_t from_ns, uint32_t to_ns, uint frames);
+
+    /*! \brief Append a sine to the playback table.
+     *   \param center_ns pulse width at phase 0
+     *   \param amplitude_ns peak deviation from center_ns
+     *   \param period_frames length of one sine period in output frames
+     *   \param frames total length in output frames
+     *   \return false if the table is full or playback is running
+     */
+    bool rc_play_add_sine(uint32_t center_ns, uint32_t amplitude_ns, uint period_frames, uint frames);
+
+    /*! \brief Number of frames in the playback table.
+     */
+    uint rc_play_get_count(void);
+
+    /*! \brief Start playback of the table on a running servo output.
+     * Each table entry is written to the compare register by DMA on a PWM wrap
+     * and goes out in the following frame, so every frame gets exactly one entry.
+     * Pulse widths outside the range of the servo profile are clamped.
+     *   \param servo initialized and started servo
+     *   \param loops number of times the table is played, 0 to repeat until stopped
+     *   \return false if the table is empty
+     */
+    bool rc_play_start(const rc_servo* servo, uint loops);
+
+    /*! \brief Stop playback. The output keeps the last value written.
+     */
+    void rc_play_stop(void);
+
+    /*! \brief Check if playback is running.
+     */
+    bool rc_play_is_running(void);
+
+    /*! \brief Index of the table entry written last, 0 if not running.
+     */
+    uint rc_play_get_position(void);
+
 
 
 #ifdef __cplusplus
@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+
+#include "rc_latency.h"
+#include "hardware/irq.h"
+#include "hardware/pwm.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include <math.h>
+#include <string.h>
+
+/*! @brief Number of generated frames kept for matching, must be a power of 2
+ */
+#ifndef RC_LAT_RING
+#define RC_LAT_RING 8
+#endif
+
+/*! @brief A captured edge may be timestamped this much before the generated one,
+ * the capture side only has micro second resolution. In nano seconds
+ */
+#ifndef RC_LAT_TOLERANCE_NS
+#define RC_LAT_TOLERANCE_NS 2000
+#endif
+
+// Internal struct for one generated frame
+struct rc_lat_frame
+{
+    int64_t start_ns;
+    uint32_t width_ns;
+    bool valid;
+    bool matched;
+};
+
+// Internal struct for accumulating one quantity
+struct rc_lat_acc
+{
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint64_t sumsq;// of values / 8 to stay in range for long runs
+};
+
+static struct
+{
+    rc_servo servo;
+    uint in_pin;
+    uint frames;
+    uint steps;
+    uint generated;
+    uint wraps;
+    uint32_t pending_ns;
+    uint32_t tick_ps;
+    struct rc_lat_frame ring[RC_LAT_RING];
+    uint head;
+    struct rc_lat_acc latency;
+    struct rc_lat_acc width_error;
+    uint32_t hist[RC_LAT_HIST_BINS + 1];
+    uint32_t matched;
+    uint32_t missed;
+    uint32_t extra;
+    volatile bool running;
+} gLat;
+
+static bool gLatIrqAdded = false;
+
+// prototypes for internal functions
+static void rc_lat_pwm_irq_handler(void);
+static void rc_lat_capture(uint gpio_pin, uint64_t start_us, uint32_t width_us);
+static void rc_lat_finish(void);
+
+//
+// Public functions
+//
+
+bool rc_lat_start(const rc_servo* servo, uint in_pin, uint frames, uint steps)
+{
+    if (gLat.running)
+        return false;
+
+    memset(&gLat, 0, sizeof(gLat));
+    // frames are written free-running, the measurement times the wrap
+    gLat.servo = *servo;
+    gLat.servo.sync = false;
+    gLat.in_pin = in_pin;
+    gLat.frames = frames;
+    gLat.steps = steps ? steps : 1;
+    gLat.tick_ps = rc_servo_get_resolution_ps(servo);
+    gLat.latency.min = gLat.width_error.min = INT32_MAX;
+    gLat.latency.max = gLat.width_error.max = INT32_MIN;
+
+    if (!gLatIrqAdded)
+    {
+        irq_add_shared_handler(PWM_IRQ_WRAP, rc_lat_pwm_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(PWM_IRQ_WRAP, true);
+        gLatIrqAdded = true;
+    }
+    rc_set_input_callback(in_pin, rc_lat_capture);
+
+    uint32_t irq_status = save_and_disable_interrupts();
+    // the first value is latched at the next wrap, which is the first measured frame
+    gLat.pending_ns = (gLat.steps > 1) ? servo->min_pulse_ns : (servo->min_pulse_ns + servo->max_pulse_ns) / 2;
+    rc_servo_set_nanos(&gLat.servo, gLat.pending_ns);
+    gLat.running = true;
+    pwm_clear_irq(servo->slice_num);
+    pwm_set_irq_enabled(servo->slice_num, true);
+    restore_interrupts(irq_status);
+
+    return true;
+}
+
+void rc_lat_stop(void)
+{
+    uint32_t irq_status = save_and_disable_interrupts();
+    if (gLat.running)
+        rc_lat_finish();
+    restore_interrupts(irq_status);
+}
+
+bool rc_lat_is_running(void)
+{
+    return gLat.running;
+}
+
+/* internal helper, statistics of an accumulator */
+static void rc_lat_acc_result(const struct rc_lat_acc* acc, uint32_t n, rc_lat_stat* stat)
+{
+    if (n == 0)
+    {
+        memset(stat, 0, sizeof(*stat));
+        return;
+    }
+    float mean = (float)acc->sum / (float)n;
+    float var = (float)acc->sumsq * 64.0f / (float)n - mean * mean;
+    stat->min = acc->min;
+    stat->max = acc->max;
+    stat->mean = (int32_t)lroundf(mean);
+    stat->stddev = (var > 0.0f) ? (uint32_t)lroundf(sqrtf(var)) : 0;
+}
+
+/* internal helper, latency percentile from histogram */
+static uint32_t rc_lat_percentile(const uint32_t* hist, uint32_t n, uint32_t percent)
+{
+    uint32_t target = (n * percent + 99) / 100;
+    uint32_t sum = 0;
+
+    for (uint32_t i = 0; i <= RC_LAT_HIST_BINS; i++)
+    {
+        sum += hist[i];
+        if (sum >= target)
+            return i;
+    }
+    return RC_LAT_HIST_BINS;
+}
+
+void rc_lat_get_result(rc_lat_result* result)
+{
+    uint32_t irq_status = save_and_disable_interrupts();
+
+    result->frames = gLat.generated;
+    result->matched = gLat.matched;
+    result->missed = gLat.missed;
+    result->extra = gLat.extra;
+    rc_lat_acc_result(&gLat.latency, gLat.matched, &result->latency);
+    rc_lat_acc_result(&gLat.width_error, gLat.matched, &result->width_error);
+    memcpy(result->hist, gLat.hist, sizeof(result->hist));
+
+    restore_interrupts(irq_status);
+
+    result->p50_us = rc_lat_percentile(result->hist, result->matched, 50);
+    result->p90_us = rc_lat_percentile(result->hist, result->matched, 90);
+    result->p99_us = rc_lat_percentile(result->hist, result->matched, 99);
+}
+
+//
+// Internal functions
+//
+static void rc_lat_acc_add(struct rc_lat_acc* acc, int32_t value)
+{
+    int32_t v8 = value / 8;
+
+    if (value < acc->min)
+        acc->min = value;
+    if (value > acc->max)
+        acc->max = value;
+    acc->sum += value;
+    acc->sumsq += (uint64_t)((int64_t)v8 * v8);
+}
+
+// end of measurement, called with interrupts disabled or from the pwm interrupt
+static void rc_lat_finish(void)
+{
+    pwm_set_irq_enabled(gLat.servo.slice_num, false);
+    rc_set_input_callback(gLat.in_pin, NULL);
+
+    for (uint i = 0; i < RC_LAT_RING; i++)
+    {
+        if (gLat.ring[i].valid && !gLat.ring[i].matched)
+            gLat.missed++;
+        gLat.ring[i].valid = false;
+    }
+    gLat.running = false;
+}
+
+// PWM wrap: a new frame starts with the value written in the previous interrupt
+static void rc_lat_pwm_irq_handler(void)
+{
+    const uint slice = gLat.servo.slice_num;
+
+    if (!gLat.running || !(pwm_get_irq_status_mask() & (1u << slice)))
+        return;
+
+    // back-calculate the wrap from the counter, irq latency does not count
+    uint16_t ctr = pwm_get_counter(slice);
+    int64_t now_ns = (int64_t)time_us_64() * 1000;
+    pwm_clear_irq(slice);
+
+    gLat.wraps++;
+    if (gLat.generated < gLat.frames)
+    {
+        struct rc_lat_frame* f = &gLat.ring[gLat.head];
+        if (f->valid && !f->matched)
+            gLat.missed++;
+        f->start_ns = now_ns - (int64_t)((uint64_t)ctr * gLat.tick_ps / 1000);
+        f->width_ns = gLat.pending_ns;
+        f->valid = true;
+        f->matched = false;
+        gLat.head = (gLat.head + 1) & (RC_LAT_RING - 1);
+        gLat.generated++;
+
+        // next value of the sweep, latched at the following wrap
+        if (gLat.steps > 1)
+        {
+            uint32_t step = gLat.generated % gLat.steps;
+            uint32_t span = gLat.servo.max_pulse_ns - gLat.servo.min_pulse_ns;
+            gLat.pending_ns = gLat.servo.min_pulse_ns + (uint32_t)((uint64_t)span * step / (gLat.steps - 1));
+            rc_servo_set_nanos(&gLat.servo, gLat.pending_ns);
+        }
+    }
+    else if (gLat.wraps > gLat.frames + 1)
+    {
+        // one more frame for the capture of the last pulse to complete
+        rc_lat_finish();
+    }
+}
+
+// Capture of a complete pulse on the input pin
+static void rc_lat_capture(uint gpio_pin, uint64_t start_us, uint32_t width_us)
+{
+    if (!gLat.running || gpio_pin != gLat.in_pin || gLat.generated == 0)
+        return;
+
+    int64_t cap_ns = (int64_t)start_us * 1000;
+
+    // the newest generated frame that started before the captured edge
+    for (uint k = 0; k < RC_LAT_RING; k++)
+    {
+        struct rc_lat_frame* f = &gLat.ring[(gLat.head - 1 - k) & (RC_LAT_RING - 1)];
+        if (!f->valid)
+            break;
+
+        int64_t latency = cap_ns - f->start_ns;
+        if (latency < -RC_LAT_TOLERANCE_NS)
+            continue;
+
+        if (f->matched)
+            break;
+        f->matched = true;
+        gLat.matched++;
+
+        rc_lat_acc_add(&gLat.latency, (int32_t)latency);
+        rc_lat_acc_add(&gLat.width_error, (int32_t)((int64_t)width_us * 1000 - f->width_ns));
+
+        uint32_t bin = (latency > 0) ? (uint32_t)(latency / 1000) : 0;
+        if (bin > RC_LAT_HIST_BINS)
+            bin = RC_LAT_HIST_BINS;
+        gLat.hist[bin]++;
+        return;
+    }
+    gLat.extra++;
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#ifndef _PICO_RC_LATENCY_H
+#define _PICO_RC_LATENCY_H
+
+#include "pico.h"
+#include "rc.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*! \brief number of 1 us bins of the latency histogram
+ */
+#ifndef RC_LAT_HIST_BINS
+#define RC_LAT_HIST_BINS 128
+#endif
+
+    /*! \brief Statistics of one measured quantity, all values in ns
+     */
+    typedef struct
+    {
+        int32_t min;
+        int32_t max;
+        int32_t mean;
+        uint32_t stddev;
+    } rc_lat_stat;
+
+    /*! \brief Result of a loopback measurement
+     */
+    typedef struct
+    {
+        uint32_t frames;   // generated frames
+        uint32_t matched;  // frames with a captured pulse
+        uint32_t missed;   // frames without a captured pulse
+        uint32_t extra;    // captured pulses without a generated frame
+        rc_lat_stat latency;     // leading edge generated -> captured
+        rc_lat_stat width_error; // captured - generated pulse width
+        uint32_t p50_us;   // latency percentiles from the histogram
+        uint32_t p90_us;
+        uint32_t p99_us;
+        uint32_t hist[RC_LAT_HIST_BINS + 1]; // latency in 1 us bins, last bin is overflow
+    } rc_lat_result;
+
+    /*! \brief Start a loopback measurement.
+     * The servo output is swept over the pulse range of its profile in free-running
+     * mode. Each generated leading edge is timestamped in the PWM wrap interrupt and
+     * matched with the next pulse captured on the input pin. Pulses captured later
+     * than one frame after their generated edge can not be matched.
+     * Without a device under test the one-wire buffer loops SERV_CH1_PIN back to
+     * RECV_CH1_PIN, which gives the baseline of the tester itself.
+     *   \param servo initialized and started servo
+     *   \param in_pin input pin, must be initialized by rc_init_input()
+     *   \param frames number of frames to generate
+     *   \param steps number of pulse widths in the sweep, 1 keeps the current center value
+     *   \return false if a measurement is already running
+     */
+    bool rc_lat_start(const rc_servo* servo, uint in_pin, uint frames, uint steps);
+
+    /*! \brief Abort a running measurement.
+     */
+    void rc_lat_stop(void);
+
+    /*! \brief Check if a measurement is running.
+     */
+    bool rc_lat_is_running(void);
+
+    /*! \brief Get the result of the last or running measurement.
+     *   \param result
+     */
+    void rc_lat_get_result(rc_lat_result* result);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif// _PICO_RC_LATENCY_H
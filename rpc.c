@@ -0,0 +1,322 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <string.h>
+#include <tusb.h>
+
+#include "rpc.h"
+#include "tlog.h"
+
+#if !defined(MIN)
+#define MIN(a, b) ((a > b) ? b : a)
+#endif /* MIN */
+
+/*! @brief Number of command tables that can be registered at the same time
+ */
+#ifndef RPC_MAX_TABLES
+#define RPC_MAX_TABLES 16
+#endif
+
+/*! @brief A partial frame is dropped if no more bytes arrive within this time, in micro seconds
+ */
+#ifndef RPC_RX_TIMEOUT_US
+#define RPC_RX_TIMEOUT_US 200000
+#endif
+
+rpc_data_t RPC_DATA;
+
+static struct
+{
+    const rpc_cmd_t *cmds;
+    uint32_t count;
+} rpc_tables[RPC_MAX_TABLES];
+
+// one frame in, one frame out, only used on core 0
+static uint8_t rpc_frame[RPC_MAX_FRAME + 5];
+static uint8_t rpc_resp[RPC_MAX_FRAME + 5];
+
+// prototypes
+static uint8_t rpc_ping(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len);
+
+static const rpc_cmd_t rpc_builtin[] = {
+    {RPC_OP_PING, rpc_ping},
+};
+
+// CRC-16/CCITT-FALSE
+static uint16_t rpc_crc16(const uint8_t *data, uint32_t len)
+{
+    uint16_t crc = 0xffff;
+
+    while (len--)
+    {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint8_t rpc_ping(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len > *rsp_len)
+    {
+        *rsp_len = 0;
+        return RPC_ERR_NOSPACE;
+    }
+    memcpy(rsp, arg, arg_len);
+    *rsp_len = arg_len;
+    return RPC_OK;
+}
+
+void rpc_init(void)
+{
+    rpc_data_t *rd = &RPC_DATA;
+
+    mutex_init(&rd->rx_mtx);
+    mutex_init(&rd->tx_mtx);
+    rd->rx_pos = 0;
+    rd->tx_pos = 0;
+    rd->rx_stall_time = 0;
+
+    memset(rpc_tables, 0, sizeof(rpc_tables));
+    rpc_register(rpc_builtin, count_of(rpc_builtin));
+}
+
+bool rpc_register(const rpc_cmd_t *cmds, uint32_t count)
+{
+    for (uint32_t i = 0; i < RPC_MAX_TABLES; i++)
+    {
+        if (rpc_tables[i].cmds == cmds)
+        {
+            return true;
+        }
+    }
+    for (uint32_t i = 0; i < RPC_MAX_TABLES; i++)
+    {
+        if (rpc_tables[i].cmds == NULL)
+        {
+            rpc_tables[i].count = count;
+            rpc_tables[i].cmds = cmds;
+            return true;
+        }
+    }
+    return false;
+}
+
+void rpc_unregister(const rpc_cmd_t *cmds)
+{
+    for (uint32_t i = 0; i < RPC_MAX_TABLES; i++)
+    {
+        if (rpc_tables[i].cmds == cmds)
+        {
+            rpc_tables[i].cmds = NULL;
+            rpc_tables[i].count = 0;
+        }
+    }
+}
+
+static rpc_handler_t rpc_find(uint8_t opcode)
+{
+    for (uint32_t i = 0; i < RPC_MAX_TABLES; i++)
+    {
+        for (uint32_t k = 0; k < rpc_tables[i].count; k++)
+        {
+            if (rpc_tables[i].cmds[k].opcode == opcode)
+            {
+                return rpc_tables[i].cmds[k].fn;
+            }
+        }
+    }
+    return NULL;
+}
+
+// called on core 1, moves bytes between cdc interface and buffers
+void rpc_usb_process(void)
+{
+    rpc_data_t *rd = &RPC_DATA;
+    uint32_t len;
+
+    len = tud_cdc_n_available(RPC_ITF);
+
+    if (len && mutex_try_enter(&rd->rx_mtx, NULL))
+    {
+        len = MIN(len, RPC_BUFFER_SIZE - rd->rx_pos);
+        if (len)
+        {
+            rd->rx_pos += tud_cdc_n_read(RPC_ITF, &rd->rx_buffer[rd->rx_pos], len);
+        }
+
+        mutex_exit(&rd->rx_mtx);
+    }
+
+    if (rd->tx_pos && mutex_try_enter(&rd->tx_mtx, NULL))
+    {
+        uint32_t count;
+
+        count = tud_cdc_n_write(RPC_ITF, rd->tx_buffer, rd->tx_pos);
+        if (count < rd->tx_pos)
+        {
+            memmove(rd->tx_buffer, &rd->tx_buffer[count], rd->tx_pos - count);
+        }
+        rd->tx_pos -= count;
+
+        mutex_exit(&rd->tx_mtx);
+
+        if (count)
+        {
+            tud_cdc_n_write_flush(RPC_ITF);
+        }
+    }
+}
+
+// drop bytes from the head of the receive buffer, rx_mtx must be held
+static void rpc_rx_consume(rpc_data_t *rd, uint32_t count)
+{
+    if (count < rd->rx_pos)
+    {
+        memmove(rd->rx_buffer, &rd->rx_buffer[count], rd->rx_pos - count);
+    }
+    rd->rx_pos -= count;
+    rd->rx_stall_time = 0;
+}
+
+// execute the commands of the frame in rpc_frame and queue the response
+static void rpc_process_frame(void)
+{
+    rpc_data_t *rd = &RPC_DATA;
+    uint16_t len = rpc_get_u16(&rpc_frame[1]);
+    const uint8_t *cmd = &rpc_frame[4];
+    const uint8_t *cmd_end = &rpc_frame[3 + len];
+    uint8_t *out = &rpc_resp[4];
+    uint8_t *out_end = &rpc_resp[4 + RPC_MAX_FRAME - 1];
+    uint16_t resp_len;
+
+    if (rpc_crc16(&rpc_frame[1], len + 2) != rpc_get_u16(cmd_end))
+    {
+        TLOG(rpc_crc, rpc_frame[3]);
+        out[0] = 0;
+        out[1] = RPC_ERR_CRC;
+        out[2] = 0;
+        out += 3;
+    }
+    else
+    {
+        while (cmd < cmd_end && out_end - out >= 3)
+        {
+            uint8_t opcode = cmd[0];
+            uint8_t arg_len;
+            uint8_t data_len;
+            uint8_t status;
+            rpc_handler_t fn;
+
+            if (cmd_end - cmd < 2 || cmd_end - cmd - 2 < cmd[1])
+            {
+                // truncated command, the rest of the frame is not executed
+                out[0] = opcode;
+                out[1] = RPC_ERR_ARGS;
+                out[2] = 0;
+                out += 3;
+                break;
+            }
+            arg_len = cmd[1];
+
+            data_len = MIN(out_end - out - 3, 255);
+            fn = rpc_find(opcode);
+            if (fn)
+            {
+                status = fn(&cmd[2], arg_len, &out[3], &data_len);
+                if (status != RPC_OK)
+                {
+                    data_len = 0;
+                }
+            }
+            else
+            {
+                status = RPC_ERR_OPCODE;
+                data_len = 0;
+            }
+            out[0] = opcode;
+            out[1] = status;
+            out[2] = data_len;
+            out += 3 + data_len;
+            cmd += 2 + arg_len;
+        }
+    }
+
+    resp_len = out - &rpc_resp[3];
+    rpc_resp[0] = RPC_SYNC;
+    rpc_put_u16(&rpc_resp[1], resp_len);
+    rpc_resp[3] = rpc_frame[3];
+    rpc_put_u16(out, rpc_crc16(&rpc_resp[1], resp_len + 2));
+
+    mutex_enter_blocking(&rd->tx_mtx);
+    memcpy(&rd->tx_buffer[rd->tx_pos], rpc_resp, resp_len + 5);
+    rd->tx_pos += resp_len + 5;
+    mutex_exit(&rd->tx_mtx);
+}
+
+// called on core 0, parses and executes at most one frame per call
+void rpc_task(void)
+{
+    rpc_data_t *rd = &RPC_DATA;
+    bool frame = false;
+    uint32_t skip;
+    uint16_t len;
+
+    // a response must fit before a request is taken, tx_pos only shrinks on core 1
+    if (!rd->rx_pos || RPC_BUFFER_SIZE - rd->tx_pos < RPC_MAX_FRAME + 5)
+    {
+        return;
+    }
+
+    if (!mutex_try_enter(&rd->rx_mtx, NULL))
+    {
+        return;
+    }
+
+    // resync on the next start byte
+    for (skip = 0; skip < rd->rx_pos && rd->rx_buffer[skip] != RPC_SYNC; skip++)
+        ;
+    if (skip)
+    {
+        rpc_rx_consume(rd, skip);
+    }
+
+    if (rd->rx_pos >= 3)
+    {
+        len = rpc_get_u16(&rd->rx_buffer[1]);
+        if (len < 1 || len > RPC_MAX_FRAME)
+        {
+            // not a frame start
+            rpc_rx_consume(rd, 1);
+        }
+        else if (rd->rx_pos >= len + 5u)
+        {
+            memcpy(rpc_frame, rd->rx_buffer, len + 5);
+            rpc_rx_consume(rd, len + 5);
+            frame = true;
+        }
+        else if (rd->rx_stall_time == 0)
+        {
+            rd->rx_stall_time = time_us_32() | 1;
+        }
+        else if (time_us_32() - rd->rx_stall_time > RPC_RX_TIMEOUT_US)
+        {
+            // the rest of the frame never came
+            rpc_rx_consume(rd, 1);
+        }
+    }
+
+    mutex_exit(&rd->rx_mtx);
+
+    if (frame)
+    {
+        rpc_process_frame();
+    }
+}
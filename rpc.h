@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_RPC_H_)
+#define _RPC_H_
+
+#include <tusb.h>
+
+/*
+ * Framed request/response protocol on the second CDC interface (itf 1).
+ *
+ * request:  0xA5 | len (u16) | seq (u8) | command... | crc (u16)
+ * command:  opcode (u8) | arg_len (u8) | args
+ * response: 0xA5 | len (u16) | seq (u8) | result... | crc (u16)
+ * result:   opcode (u8) | status (u8) | data_len (u8) | data
+ *
+ * len counts seq plus all commands/results. crc is CRC-16/CCITT-FALSE over
+ * len, seq and commands/results. All values are little endian. The commands
+ * of one frame are executed in order and answered in one response frame.
+ */
+
+#define RPC_ITF 1
+#define RPC_SYNC 0xA5
+#define RPC_MAX_FRAME 1024
+#define RPC_BUFFER_SIZE (2 * (RPC_MAX_FRAME + 5))
+#define RPC_VERSION 1
+
+// status codes
+#define RPC_OK 0x00
+#define RPC_ERR_OPCODE 0x01
+#define RPC_ERR_ARGS 0x02
+#define RPC_ERR_STATE 0x03
+#define RPC_ERR_RANGE 0x04
+#define RPC_ERR_FULL 0x05
+#define RPC_ERR_CRC 0x06
+#define RPC_ERR_NOSPACE 0x07
+
+// common commands
+#define RPC_OP_PING 0x01
+#define RPC_OP_INFO 0x02
+#define RPC_OP_MODE_SET 0x03
+#define RPC_OP_BOOT_TRACE 0x04
+// persistent configuration
+#define RPC_OP_CFG_GET 0x05
+#define RPC_OP_CFG_SET 0x06
+#define RPC_OP_CFG_COMMIT 0x07
+#define RPC_OP_CFG_RESET 0x08
+// receiver input
+#define RPC_OP_RECV_GET_PULSE 0x10
+// servo output
+#define RPC_OP_SERVO_GET_STATUS 0x20
+#define RPC_OP_SERVO_SET_ANGLE 0x21
+#define RPC_OP_SERVO_SET_NANOS 0x22
+#define RPC_OP_SERVO_SET_PROFILE 0x23
+#define RPC_OP_SERVO_GROUP_START 0x24
+#define RPC_OP_SERVO_GROUP_SET 0x25
+#define RPC_OP_SERVO_GROUP_STOP 0x26
+// trajectory playback
+#define RPC_OP_PLAY_CLEAR 0x30
+#define RPC_OP_PLAY_ADD 0x31
+#define RPC_OP_PLAY_RAMP 0x32
+#define RPC_OP_PLAY_SINE 0x33
+#define RPC_OP_PLAY_START 0x34
+#define RPC_OP_PLAY_STOP 0x35
+#define RPC_OP_PLAY_STATUS 0x36
+// loopback measurement
+#define RPC_OP_LAT_START 0x40
+#define RPC_OP_LAT_RESULT 0x41
+#define RPC_OP_LAT_HIST 0x42
+// esc image store and on-device flashing
+#define RPC_OP_IMG_BEGIN 0x50
+#define RPC_OP_IMG_WRITE 0x51
+#define RPC_OP_IMG_END 0x52
+#define RPC_OP_IMG_INFO 0x53
+#define RPC_OP_ESC_FLASH 0x54
+#define RPC_OP_ESC_FLASH_STATUS 0x55
+// esc settings cache
+#define RPC_OP_ESC_SET_LOAD 0x56
+#define RPC_OP_ESC_SET_GET 0x57
+#define RPC_OP_ESC_SET_APPLY 0x58
+#define RPC_OP_ESC_SET_STATUS 0x59
+// logic analyser
+#define RPC_OP_LA_START 0x60
+#define RPC_OP_LA_STOP 0x61
+#define RPC_OP_LA_STATUS 0x62
+#define RPC_OP_LA_READ 0x63
+// bridge traffic capture
+#define RPC_OP_SNIFF_START 0x64
+#define RPC_OP_SNIFF_STOP 0x65
+#define RPC_OP_SNIFF_STATUS 0x66
+#define RPC_OP_SNIFF_READ 0x67
+// tokenized log
+#define RPC_OP_TLOG_LEVEL 0x68
+#define RPC_OP_TLOG_STATUS 0x69
+#define RPC_OP_TLOG_READ 0x6A
+// sampling profiler
+#define RPC_OP_PROF_START 0x6B
+#define RPC_OP_PROF_STOP 0x6C
+#define RPC_OP_PROF_STATUS 0x6D
+#define RPC_OP_PROF_READ 0x6E
+// ram budget
+#define RPC_OP_MEM_STATUS 0x6F
+// one-wire uart
+#define RPC_OP_BRIDGE_ERRORS 0x70
+#define RPC_OP_ESC_LINE 0x71
+// loop monitor
+#define RPC_OP_WATCH_STATUS 0x72
+#define RPC_OP_WATCH_LAST 0x73
+// firmware update (USBLINK_AB_UPDATE)
+#define RPC_OP_AB_STATUS 0x74
+#define RPC_OP_AB_BEGIN 0x75
+#define RPC_OP_AB_WRITE 0x76
+#define RPC_OP_AB_END 0x77
+#define RPC_OP_AB_SWITCH 0x78
+// signal relay
+#define RPC_OP_RELAY_STATUS 0x79
+
+/* handler: args in, response data out; *rsp_len holds the capacity on entry */
+typedef uint8_t (*rpc_handler_t)(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len);
+
+typedef struct
+{
+    uint8_t opcode;
+    rpc_handler_t fn;
+} rpc_cmd_t;
+
+typedef struct
+{
+    uint8_t rx_buffer[RPC_BUFFER_SIZE];
+    uint32_t rx_pos;
+    mutex_t rx_mtx;
+    uint8_t tx_buffer[RPC_BUFFER_SIZE];
+    uint32_t tx_pos;
+    mutex_t tx_mtx;
+    uint32_t rx_stall_time;
+} rpc_data_t;
+
+void rpc_init(void);
+bool rpc_register(const rpc_cmd_t *cmds, uint32_t count);
+void rpc_unregister(const rpc_cmd_t *cmds);
+void rpc_usb_process(void);
+void rpc_task(void);
+
+/* reserve n bytes of response data, false if the capacity is too small */
+static inline bool rpc_room(uint8_t *rsp_len, uint32_t n)
+{
+    if (*rsp_len < n)
+    {
+        *rsp_len = 0;
+        return false;
+    }
+    *rsp_len = n;
+    return true;
+}
+
+static inline uint16_t rpc_get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t rpc_get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint8_t *rpc_put_u16(uint8_t *p, uint16_t v)
+{
+    *p++ = v & 0xff;
+    *p++ = v >> 8;
+    return p;
+}
+
+static inline uint8_t *rpc_put_u32(uint8_t *p, uint32_t v)
+{
+    *p++ = v & 0xff;
+    *p++ = (v >> 8) & 0xff;
+    *p++ = (v >> 16) & 0xff;
+    *p++ = v >> 24;
+    return p;
+}
+
+#endif /* _RPC_H_ */
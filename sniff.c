@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <pico/sync.h>
+#include <string.h>
+
+#include "sniff.h"
+
+#if !defined(MIN)
+#define MIN(a, b) ((a > b) ? b : a)
+#endif /* MIN */
+
+#define SNIFF_MASK (SNIFF_BUF_SIZE - 1)
+
+volatile bool sniff_on;
+
+static critical_section_t sniff_cs;
+
+static struct
+{
+    uint8_t buf[SNIFF_BUF_SIZE];
+    uint32_t head;     // next byte written
+    uint32_t tail;     // next byte for the host
+    uint32_t last;     // header of the last record, merge candidate
+    bool last_valid;
+    uint8_t last_dir;
+    uint32_t last_us;  // time of the last byte of the last record
+    uint32_t lost;
+    bool lost_flag;
+} sniff;
+
+static void sniff_put(const uint8_t *data, uint32_t len)
+{
+    uint32_t pos = sniff.head & SNIFF_MASK;
+    uint32_t n = MIN(len, SNIFF_BUF_SIZE - pos);
+
+    memcpy(&sniff.buf[pos], data, n);
+    memcpy(sniff.buf, &data[n], len - n);
+    sniff.head += len;
+}
+
+void sniff_init(void)
+{
+    critical_section_init(&sniff_cs);
+}
+
+void sniff_start(void)
+{
+    critical_section_enter_blocking(&sniff_cs);
+    sniff.head = 0;
+    sniff.tail = 0;
+    sniff.last_valid = false;
+    sniff.lost = 0;
+    sniff.lost_flag = false;
+    sniff_on = true;
+    critical_section_exit(&sniff_cs);
+}
+
+// unread records stay readable
+void sniff_stop(void)
+{
+    sniff_on = false;
+}
+
+void sniff_record(uint8_t dir, const uint8_t *data, uint32_t len, uint8_t flags)
+{
+    uint32_t now = time_us_32();
+    uint32_t free;
+    uint32_t pos;
+    uint16_t n;
+    uint8_t hdr[SNIFF_HDR_SIZE];
+
+    critical_section_enter_blocking(&sniff_cs);
+    free = SNIFF_BUF_SIZE - (sniff.head - sniff.tail);
+
+    // append to the last record if it is still unread and the flags are clean
+    if (sniff.last_valid && sniff.last_dir == dir && flags == 0 && !sniff.lost_flag &&
+        now - sniff.last_us < SNIFF_MERGE_US && (int32_t)(sniff.last - sniff.tail) >= 0 && len <= free)
+    {
+        pos = sniff.last + 6;
+        n = sniff.buf[pos & SNIFF_MASK] | (sniff.buf[(pos + 1) & SNIFF_MASK] << 8);
+        if (n + len <= 0xffff)
+        {
+            n += len;
+            sniff.buf[pos & SNIFF_MASK] = n & 0xff;
+            sniff.buf[(pos + 1) & SNIFF_MASK] = n >> 8;
+            sniff_put(data, len);
+            sniff.last_us = now;
+            critical_section_exit(&sniff_cs);
+            return;
+        }
+    }
+
+    if (len > 0xffff || SNIFF_HDR_SIZE + len > free)
+    {
+        sniff.lost++;
+        sniff.lost_flag = true;
+        sniff.last_valid = false;
+        critical_section_exit(&sniff_cs);
+        return;
+    }
+
+    rpc_put_u32(hdr, now);
+    hdr[4] = dir;
+    hdr[5] = flags | (sniff.lost_flag ? SNIFF_FLAG_LOST : 0);
+    rpc_put_u16(&hdr[6], len);
+    sniff.last = sniff.head;
+    sniff.last_valid = (flags == 0);
+    sniff.last_dir = dir;
+    sniff.last_us = now;
+    sniff.lost_flag = false;
+    sniff_put(hdr, SNIFF_HDR_SIZE);
+    sniff_put(data, len);
+    critical_section_exit(&sniff_cs);
+}
+
+static uint8_t rpc_sniff_start(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    sniff_start();
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_sniff_stop(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    sniff_stop();
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+// the device time lets the host map the record times onto its own clock
+static uint8_t rpc_sniff_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 13))
+        return RPC_ERR_NOSPACE;
+    critical_section_enter_blocking(&sniff_cs);
+    *p++ = sniff_on;
+    p = rpc_put_u32(p, sniff.head - sniff.tail);
+    p = rpc_put_u32(p, sniff.lost);
+    rpc_put_u32(p, time_us_32());
+    critical_section_exit(&sniff_cs);
+    return RPC_OK;
+}
+
+// raw stream bytes, records may be split between reads
+static uint8_t rpc_sniff_read(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint32_t n;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    critical_section_enter_blocking(&sniff_cs);
+    n = MIN(*rsp_len, sniff.head - sniff.tail);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        rsp[i] = sniff.buf[(sniff.tail + i) & SNIFF_MASK];
+    }
+    sniff.tail += n;
+    critical_section_exit(&sniff_cs);
+    *rsp_len = n;
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_sniff_cmds[] = {
+    {RPC_OP_SNIFF_START, rpc_sniff_start},
+    {RPC_OP_SNIFF_STOP, rpc_sniff_stop},
+    {RPC_OP_SNIFF_STATUS, rpc_sniff_status},
+    {RPC_OP_SNIFF_READ, rpc_sniff_read},
+};
+const uint32_t rpc_sniff_cmds_count = count_of(rpc_sniff_cmds);
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_SNIFF_H_)
+#define _SNIFF_H_
+
+#include <tusb.h>
+
+#include "rpc.h"
+
+/*
+ * Capture of the bridge traffic. Every chunk passed between the console CDC
+ * interface and the one-wire uart is stored as a record in a byte ring:
+ *
+ *   time us (u32) | direction (u8) | flags (u8) | len (u16) | data
+ *
+ * Chunks of the same direction arriving within SNIFF_MERGE_US of the last
+ * byte are appended to the last record while it is not read yet, the single
+ * byte uart rx interrupts would cost a header per byte otherwise.
+ */
+
+/*! @brief Capture ring size in bytes, power of 2
+ */
+#ifndef SNIFF_BUF_SIZE
+#define SNIFF_BUF_SIZE 8192
+#endif
+
+/*! @brief Chunks closer than this to the last record of the same direction are merged, in micro seconds
+ */
+#ifndef SNIFF_MERGE_US
+#define SNIFF_MERGE_US 200
+#endif
+
+#define SNIFF_HDR_SIZE 8
+
+// directions
+#define SNIFF_USB_OUT 0 // host to device
+#define SNIFF_UART_TX 1 // device to one-wire
+#define SNIFF_UART_RX 2 // one-wire to device, includes the echo of tx
+#define SNIFF_USB_IN 3  // device to host
+
+// flags, uart errors as in the data register bits 8-11
+#define SNIFF_FLAG_FE 0x01
+#define SNIFF_FLAG_PE 0x02
+#define SNIFF_FLAG_BE 0x04
+#define SNIFF_FLAG_OE 0x08
+#define SNIFF_FLAG_LOST 0x80 // records were dropped before this one
+
+extern volatile bool sniff_on;
+
+void sniff_init(void);
+void sniff_start(void);
+void sniff_stop(void);
+void sniff_record(uint8_t dir, const uint8_t *data, uint32_t len, uint8_t flags);
+
+// cheap when the capture is off, called from both cores and the uart interrupt
+static inline void sniff_chunk(uint8_t dir, const uint8_t *data, uint32_t len, uint8_t flags)
+{
+    if (sniff_on && len)
+        sniff_record(dir, data, len, flags);
+}
+
+extern const rpc_cmd_t rpc_sniff_cmds[];
+extern const uint32_t rpc_sniff_cmds_count;
+
+#endif /* _SNIFF_H_ */
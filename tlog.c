@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <pico/stdlib.h>
+#include <pico/sync.h>
+
+#include "tlog.h"
+
+#define TLOG_MASK (TLOG_RING_WORDS - 1)
+
+typedef struct
+{
+    uint32_t buf[TLOG_RING_WORDS];
+    volatile uint32_t head;// written by the core of the ring
+    volatile uint32_t tail;// written by the reader on core 0
+    uint32_t lost;         // records dropped since the last stored one
+    uint32_t lost_total;
+} tlog_ring_t;
+
+volatile uint8_t tlog_level = TLOG_DEFAULT_LEVEL;
+
+static tlog_ring_t tlog_rings[2];
+
+static inline uint32_t tlog_hdr(uint8_t level, uint16_t id, uint32_t n)
+{
+    return id | (level << 16) | (n << 24);
+}
+
+void tlog_put(uint8_t level, uint16_t id, uint32_t n, const uint32_t *args)
+{
+    tlog_ring_t *r = &tlog_rings[get_core_num()];
+    uint32_t now = time_us_32();
+    uint32_t irq;
+    uint32_t head;
+    uint32_t need = 2 + n;
+
+    // interrupt handlers of this core log into the same ring
+    irq = save_and_disable_interrupts();
+    head = r->head;
+    if (r->lost)
+        need += 3;
+    if (TLOG_RING_WORDS - (head - r->tail) < need)
+    {
+        r->lost++;
+        r->lost_total++;
+        restore_interrupts(irq);
+        return;
+    }
+    if (r->lost)
+    {
+        r->buf[head++ & TLOG_MASK] = now;
+        r->buf[head++ & TLOG_MASK] = tlog_hdr(TLOG_WARN, tlog_lost, 1);
+        r->buf[head++ & TLOG_MASK] = r->lost;
+        r->lost = 0;
+    }
+    r->buf[head++ & TLOG_MASK] = now;
+    r->buf[head++ & TLOG_MASK] = tlog_hdr(level, id, n);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        r->buf[head++ & TLOG_MASK] = args[i];
+    }
+    // the words before the index
+    __mem_fence_release();
+    r->head = head;
+    restore_interrupts(irq);
+}
+
+static uint8_t rpc_tlog_level(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    if (arg_len != 1)
+        return RPC_ERR_ARGS;
+    if (arg[0] > TLOG_OFF)
+        return RPC_ERR_RANGE;
+    tlog_level = arg[0];
+    *rsp_len = 0;
+    return RPC_OK;
+}
+
+static uint8_t rpc_tlog_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 11))
+        return RPC_ERR_NOSPACE;
+    *p++ = tlog_level;
+    p = rpc_put_u16(p, tlog_rings[0].head - tlog_rings[0].tail);
+    p = rpc_put_u16(p, tlog_rings[1].head - tlog_rings[1].tail);
+    p = rpc_put_u32(p, tlog_rings[0].lost_total + tlog_rings[1].lost_total);
+    rpc_put_u16(p, tlog_count);
+    return RPC_OK;
+}
+
+// whole records of core 0, then core 1, the host sorts by time
+static uint8_t rpc_tlog_read(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint32_t pos = 0;
+    uint32_t tail;
+    uint32_t head;
+    uint32_t hdr;
+    uint32_t n;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    for (uint32_t core = 0; core < 2; core++)
+    {
+        tlog_ring_t *r = &tlog_rings[core];
+
+        tail = r->tail;
+        head = r->head;
+        __mem_fence_acquire();
+        while (tail != head)
+        {
+            hdr = r->buf[(tail + 1) & TLOG_MASK];
+            n = 2 + (hdr >> 24);
+            if (pos + 4 * n > *rsp_len)
+                break;
+            if (core)
+                hdr |= TLOG_CORE1 << 16;
+            rpc_put_u32(&rsp[pos], r->buf[tail & TLOG_MASK]);
+            rpc_put_u32(&rsp[pos + 4], hdr);
+            for (uint32_t i = 2; i < n; i++)
+            {
+                rpc_put_u32(&rsp[pos + 4 * i], r->buf[(tail + i) & TLOG_MASK]);
+            }
+            pos += 4 * n;
+            tail += n;
+        }
+        r->tail = tail;
+    }
+    *rsp_len = pos;
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_tlog_cmds[] = {
+    {RPC_OP_TLOG_LEVEL, rpc_tlog_level},
+    {RPC_OP_TLOG_STATUS, rpc_tlog_status},
+    {RPC_OP_TLOG_READ, rpc_tlog_read},
+};
+const uint32_t rpc_tlog_cmds_count = count_of(rpc_tlog_cmds);
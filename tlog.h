@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_TLOG_H_)
+#define _TLOG_H_
+
+#include <tusb.h>
+
+#include "rpc.h"
+
+/*
+ * Tokenized log. A call site stores the id of its message and up to four
+ * u32 arguments with the time into the ring of its core, nothing is
+ * formatted and no lock is taken. The texts are in tlog_msgs.h only, the
+ * host reads the records over rpc and formats them (usblink_rpc.py log).
+ *
+ * record: time us (u32) | id (u16) level (u8) args (u8) | args (u32) ...
+ *
+ * Each ring has one producer, its core (interrupts of that core are held off
+ * for the few words of a record), and one consumer, the rpc task on core 0.
+ */
+
+/*! @brief Ring size per core in words, power of 2
+ */
+#ifndef TLOG_RING_WORDS
+#define TLOG_RING_WORDS 1024
+#endif
+
+/*! @brief Lowest level stored after boot, changed at runtime with the rpc log level command
+ */
+#ifndef TLOG_DEFAULT_LEVEL
+#define TLOG_DEFAULT_LEVEL TLOG_DEBUG
+#endif
+
+#define TLOG_MAX_ARGS 4
+
+// levels
+#define TLOG_TRACE 0
+#define TLOG_DEBUG 1
+#define TLOG_INFO 2
+#define TLOG_WARN 3
+#define TLOG_ERROR 4
+#define TLOG_OFF 5
+
+// the core that wrote a record, set in the level byte sent to the host
+#define TLOG_CORE1 0x80
+
+// message ids and levels
+#define TLOG_MSG(name, level, fmt) tlog_##name,
+enum
+{
+#include "tlog_msgs.h"
+    tlog_count
+};
+#undef TLOG_MSG
+#define TLOG_MSG(name, level, fmt) tlog_level_##name = level,
+enum
+{
+#include "tlog_msgs.h"
+};
+#undef TLOG_MSG
+
+extern volatile uint8_t tlog_level;
+
+void tlog_put(uint8_t level, uint16_t id, uint32_t n, const uint32_t *args);
+
+// TLOG(mode_switch, from, to): the level test is all that runs below the level
+#define TLOG(name, ...)                                                              \
+    do                                                                               \
+    {                                                                                \
+        if (tlog_level_##name >= tlog_level)                                         \
+        {                                                                            \
+            const uint32_t tlog_args_[] = {0, ##__VA_ARGS__};                        \
+            tlog_put(tlog_level_##name, tlog_##name, count_of(tlog_args_) - 1, &tlog_args_[1]); \
+        }                                                                            \
+    } while (0)
+
+extern const rpc_cmd_t rpc_tlog_cmds[];
+extern const uint32_t rpc_tlog_cmds_count;
+
+#endif /* _TLOG_H_ */
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+/*
+ * Message table of the tokenized log, included by tlog.h with different
+ * definitions of TLOG_MSG. The id of a message is its position, new messages
+ * are added at the end. usblink_rpc.py reads this file to format the records,
+ * arguments are u32 and printf conversions without strings.
+ *
+ * TLOG_MSG(name, level, format)
+ */
+
+TLOG_MSG(lost, TLOG_WARN, "%u records lost")
+TLOG_MSG(mode_switch, TLOG_INFO, "switch mode %u to %u")
+TLOG_MSG(mode_reset, TLOG_INFO, "going down from mode %u")
+TLOG_MSG(select_enter, TLOG_DEBUG, "mode select")
+TLOG_MSG(select_mode, TLOG_DEBUG, "mode %u selected")
+TLOG_MSG(select_done, TLOG_DEBUG, "mode select done")
+TLOG_MSG(esc_power_off, TLOG_INFO, "esc power off, switch power on")
+TLOG_MSG(esc_flash_start, TLOG_INFO, "flash image %u")
+TLOG_MSG(esc_flash_ok, TLOG_INFO, "flash ok, %u bytes written")
+TLOG_MSG(esc_flash_fail, TLOG_ERROR, "flash failed (%u)")
+TLOG_MSG(escb_begin, TLOG_DEBUG, "bootloader job %u at 0x%04x, %u bytes")
+TLOG_MSG(escb_chunk, TLOG_TRACE, "bootloader chunk 0x%04x, %u bytes written")
+TLOG_MSG(escb_finish, TLOG_DEBUG, "bootloader job done, error %u")
+TLOG_MSG(bridge_suspend, TLOG_DEBUG, "bridge suspended, %u baud")
+TLOG_MSG(bridge_resume, TLOG_DEBUG, "bridge resumed")
+TLOG_MSG(rpc_crc, TLOG_WARN, "rpc frame crc error, seq %u")
+TLOG_MSG(line_hold, TLOG_DEBUG, "one-wire line hold %u, armed %u")
+TLOG_MSG(line_break, TLOG_DEBUG, "one-wire line break %u ms")
+TLOG_MSG(line_power_up, TLOG_INFO, "esc power up, one-wire line released")
+TLOG_MSG(esc_power_up, TLOG_INFO, "esc power on at %u us")
+TLOG_MSG(esc_power_down, TLOG_INFO, "esc power off after %u ms")
+TLOG_MSG(watch_reset, TLOG_WARN, "watchdog reset, step %u / %u, core 0 stalled %u, up %u ms")
+TLOG_MSG(ab_image, TLOG_INFO, "firmware image for slot %u, %u bytes")
+TLOG_MSG(ab_switch, TLOG_INFO, "firmware switch to slot %u")
+TLOG_MSG(ab_trial, TLOG_INFO, "firmware trial in slot %u")
+TLOG_MSG(ab_confirm, TLOG_INFO, "firmware in slot %u confirmed")
+TLOG_MSG(ab_rollback, TLOG_WARN, "firmware trial in slot %u failed, back in slot %u")
+TLOG_MSG(relay_pin, TLOG_WARN, "relay input pin %u is in use, taking %u")
+TLOG_MSG(relay_failsafe, TLOG_WARN, "relay signal lost, failsafe %u us")
+TLOG_MSG(relay_signal, TLOG_INFO, "relay signal back after %u ms")
+TLOG_MSG(power_on_wait, TLOG_INFO, "waiting for esc power on")
+TLOG_MSG(power_off_wait, TLOG_INFO, "waiting for esc power off")
+TLOG_MSG(rec_pulse, TLOG_DEBUG, "receiver ch1 pulse %u")
+TLOG_MSG(relay_start, TLOG_INFO, "relay GPIO%u to ch1, profile %u")
+TLOG_MSG(relay_pwm, TLOG_INFO, "relay pwm period %u ns, step %u ps")
+TLOG_MSG(relay_status, TLOG_DEBUG, "relay in %u us, out %u ns, latency max %u us")
+TLOG_MSG(relay_no_signal, TLOG_DEBUG, "relay no signal")
+TLOG_MSG(servo_pwm, TLOG_INFO, "servo pwm profile %u, period %u ns, step %u ps")
+TLOG_MSG(servo_start, TLOG_INFO, "servo ch1 start %u deg")
+TLOG_MSG(servo_set, TLOG_DEBUG, "servo ch1 set %u deg")
+TLOG_MSG(servo_write, TLOG_DEBUG, "servo ch1 write %u deg")
+TLOG_MSG(servo_pulse, TLOG_DEBUG, "servo input ch1 pulse %u")
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+#
+# Bridge benchmark. Switches the device into the benchmark mode (uart in
+# internal loopback) over the RPC channel and measures round trips
+# host -> usb -> uart -> usb -> host on the console interface, no ESC needed.
+#
+#   bench.py /dev/ttyACM0 /dev/ttyACM1
+#   bench.py /dev/ttyACM0 /dev/ttyACM1 --baud 19200,115200 --chunk 1,64,256 --load echo --flush 0,500 --csv bench.csv
+#
+# Host load:
+#   echo    one chunk in flight, the next one is written when the last byte came back (latency)
+#   stream  up to --window chunks in flight (throughput)
+# Device flush policy (config bridge_flush_us, restored at the end):
+#   0       the usb data is flushed after every write
+#   n       full packets go out at once, a partial packet waits up to n us for more data
+# Each point reports MB/s of looped data, the share of the wire rate (8N1) and
+# the percentiles of the chunk round trip, from write to the last byte read.
+
+import argparse
+import os
+import sys
+import time
+
+import serial
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from usblink_rpc import UsbLink  # noqa: E402
+
+MODE_ESC = 1
+MODE_BENCH = 4
+FLUSH_KEY = "bridge_flush_us"
+# no byte back for this long ends a point
+STALL_S = 1.0
+
+
+def percentile(v, p):
+    if not v:
+        return 0.0
+    v = sorted(v)
+    return v[min(len(v) - 1, int(p / 100.0 * len(v)))]
+
+
+def pattern(offset, n):
+    return bytes((offset + i) & 0xFF for i in range(n))
+
+
+def run_point(ser, chunk, window, seconds):
+    """returns (bytes looped, seconds, round trips in s, bad bytes, stalled)"""
+    ser.reset_input_buffer()
+    sent = 0
+    received = 0
+    bad = 0
+    ends = []   # (end offset, write time) of the chunks in flight
+    rtt = []
+    start = time.perf_counter()
+    last_rx = start
+    stop_at = start + seconds
+    while True:
+        now = time.perf_counter()
+        if now < stop_at and len(ends) < window:
+            ser.write(pattern(sent, chunk))
+            ser.flush()
+            sent += chunk
+            ends.append((sent, time.perf_counter()))
+            continue
+        if not ends:
+            break
+        data = ser.read(max(1, ser.in_waiting))
+        now = time.perf_counter()
+        if data:
+            expect = pattern(received, len(data))
+            bad += sum(a != b for a, b in zip(data, expect))
+            received += len(data)
+            last_rx = now
+            while ends and received >= ends[0][0]:
+                rtt.append(now - ends.pop(0)[1])
+        elif now - last_rx > STALL_S:
+            return received, last_rx - start, rtt, bad, True
+    return received, time.perf_counter() - start, rtt, bad, False
+
+
+def main():
+    ap = argparse.ArgumentParser(description="USBLink bridge loopback benchmark")
+    ap.add_argument("data_port", help="console interface (CDC 0)")
+    ap.add_argument("rpc_port", help="rpc interface (CDC 1)")
+    ap.add_argument("--baud", default="19200,115200,250000,500000,1000000")
+    ap.add_argument("--chunk", default="1,16,64,256,1024")
+    ap.add_argument("--load", default="echo,stream")
+    ap.add_argument("--flush", default="0,250,1000", help="bridge_flush_us values")
+    ap.add_argument("--window", type=int, default=4, help="chunks in flight for stream")
+    ap.add_argument("--seconds", type=float, default=2.0, help="per point")
+    ap.add_argument("--csv", help="write the results to this file")
+    args = ap.parse_args()
+
+    link = UsbLink(args.rpc_port)
+    flush_saved = link.cfg_get(FLUSH_KEY)
+    ser = serial.Serial(args.data_port, timeout=0.05)
+
+    rows = []
+    print("%6s %8s %6s %-6s %10s %6s %10s %10s %10s %6s" %
+          ("flush", "baud", "chunk", "load", "MB/s", "wire%", "p50 ms", "p99 ms", "p999 ms", "bad"))
+    try:
+        for flush in [int(f) for f in args.flush.split(",")]:
+            # the bridge takes the policy when the mode starts
+            link.cfg_set(FLUSH_KEY, flush)
+            link.mode(MODE_ESC)
+            time.sleep(0.2)
+            link.mode(MODE_BENCH)
+            time.sleep(0.2)
+            if link.info()["opmode"] != MODE_BENCH:
+                print("device did not enter the benchmark mode")
+                return 1
+            for baud in [int(b) for b in args.baud.split(",")]:
+                # the line coding of the console sets the uart of the bridge
+                ser.baudrate = baud
+                time.sleep(0.1)
+                for chunk in [int(c) for c in args.chunk.split(",")]:
+                    for load in args.load.split(","):
+                        window = 1 if load == "echo" else args.window
+                        n, t, rtt, bad, stalled = run_point(ser, chunk, window, args.seconds)
+                        mbs = n / t / 1e6 if t > 0 else 0.0
+                        row = (flush, baud, chunk, load, mbs, 100.0 * mbs * 1e6 / (baud / 10.0),
+                               1e3 * percentile(rtt, 50), 1e3 * percentile(rtt, 99), 1e3 * percentile(rtt, 99.9),
+                               bad, stalled)
+                        rows.append(row)
+                        print("%6d %8d %6d %-6s %10.4f %6.1f %10.3f %10.3f %10.3f %6d%s" %
+                              (row[:10] + (" stalled" if stalled else "",)))
+    finally:
+        ser.close()
+        link.cfg_set(FLUSH_KEY, flush_saved)
+        link.mode(MODE_ESC)
+        link.close()
+
+    if args.csv:
+        with open(args.csv, "w") as f:
+            f.write("flush_us,baud,chunk,load,mb_s,wire_pct,p50_ms,p99_ms,p999_ms,bad,stalled\n")
+            for r in rows:
+                f.write("%d,%d,%d,%s,%.6f,%.2f,%.4f,%.4f,%.4f,%d,%d\n" % (r[:10] + (int(r[10]),)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
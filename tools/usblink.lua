@@ -0,0 +1,181 @@
+-- SPDX-License-Identifier: MIT
+--
+-- Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+--
+-- Wireshark dissector for the bridge captures of usblink_rpc.py sniff
+-- (pcapng, link type USER0). Packet: direction u8, flags u8, chunk.
+-- Chunks towards the ESC are shown as BLHeli/AM32 bootloader commands,
+-- chunks from the ESC as answers. uart rx includes the echo of uart tx.
+--
+--   wireshark -X lua_script:tools/usblink.lua flash.pcapng
+
+local usblink = Proto("usblink", "USBLink bridge capture")
+
+local directions = { [0] = "usb out", [1] = "uart tx", [2] = "uart rx", [3] = "usb in" }
+local sources = { [0] = "host", [1] = "usblink", [2] = "esc", [3] = "usblink" }
+local destinations = { [0] = "usblink", [1] = "esc", [2] = "usblink", [3] = "host" }
+local commands = {
+    [0x00] = "run", [0x01] = "program flash", [0x03] = "read flash",
+    [0xfe] = "set buffer", [0xff] = "set address",
+}
+local results = { [0x30] = "ack", [0xc0] = "verify error", [0xc1] = "command error", [0xc2] = "crc error" }
+
+local f_dir = ProtoField.uint8("usblink.dir", "Direction", base.DEC, directions)
+local f_flags = ProtoField.uint8("usblink.flags", "Flags", base.HEX)
+local f_fe = ProtoField.bool("usblink.flags.fe", "Framing error", 8, nil, 0x01)
+local f_pe = ProtoField.bool("usblink.flags.pe", "Parity error", 8, nil, 0x02)
+local f_be = ProtoField.bool("usblink.flags.be", "Break", 8, nil, 0x04)
+local f_oe = ProtoField.bool("usblink.flags.oe", "Overrun", 8, nil, 0x08)
+local f_lost = ProtoField.bool("usblink.flags.lost", "Records lost before", 8, nil, 0x80)
+local f_cmd = ProtoField.uint8("usblink.boot.cmd", "Command", base.HEX, commands)
+local f_addr = ProtoField.uint16("usblink.boot.address", "Address", base.HEX)
+local f_len = ProtoField.uint16("usblink.boot.len", "Length", base.DEC)
+local f_data = ProtoField.bytes("usblink.boot.data", "Data")
+local f_crc = ProtoField.uint16("usblink.boot.crc", "CRC", base.HEX)
+local f_crc_ok = ProtoField.bool("usblink.boot.crc_ok", "CRC ok")
+local f_result = ProtoField.uint8("usblink.boot.result", "Result", base.HEX, results)
+local f_info = ProtoField.bytes("usblink.boot.info", "Bootloader info")
+
+usblink.fields = { f_dir, f_flags, f_fe, f_pe, f_be, f_oe, f_lost, f_cmd, f_addr, f_len, f_data, f_crc, f_crc_ok,
+                   f_result, f_info }
+
+local function xor(a, b)
+    local r, bit = 0, 1
+    while a > 0 or b > 0 do
+        if a % 2 ~= b % 2 then
+            r = r + bit
+        end
+        a, b, bit = math.floor(a / 2), math.floor(b / 2), bit * 2
+    end
+    return r
+end
+
+-- CRC-16 poly 0xA001 (reflected 0x8005), init 0
+local function crc16(tvb, offset, len)
+    local crc = 0
+    for i = offset, offset + len - 1 do
+        crc = xor(crc, tvb(i, 1):uint())
+        for _ = 1, 8 do
+            if crc % 2 == 1 then
+                crc = xor(math.floor(crc / 2), 0xa001)
+            else
+                crc = math.floor(crc / 2)
+            end
+        end
+    end
+    return crc
+end
+
+-- payload of len bytes at offset followed by its crc, little endian
+local function add_crc(tree, tvb, offset, len)
+    if tvb:len() < offset + len + 2 then
+        return
+    end
+    local crc = tvb(offset + len, 2):le_uint()
+    tree:add_le(f_crc, tvb(offset + len, 2))
+    tree:add(f_crc_ok, crc == crc16(tvb, offset, len))
+end
+
+local function dissect_command(tvb, pinfo, tree)
+    local n = tvb:len()
+    local s = tvb:raw()
+
+    if s:find("BLHeli", 1, true) then
+        pinfo.cols.info:set("init")
+        return
+    end
+    local cmd = tvb(0, 1):uint()
+    if n == 4 or n == 6 then
+        if cmd == 0xff or cmd == 0xfe then
+            tree:add(f_cmd, tvb(0, 1))
+            if cmd == 0xff then
+                tree:add(f_addr, tvb(2, 2))
+                pinfo.cols.info:set(string.format("set address 0x%04x", tvb(2, 2):uint()))
+            else
+                local len = tvb(2, 2):uint()
+                tree:add(f_len, tvb(2, 2))
+                pinfo.cols.info:set(string.format("set buffer %d", len == 0 and 256 or len))
+            end
+            add_crc(tree, tvb, 0, 4)
+            return
+        end
+        if commands[cmd] then
+            tree:add(f_cmd, tvb(0, 1))
+            local text = commands[cmd]
+            if cmd == 0x03 then
+                local len = tvb(1, 1):uint()
+                tree:add(f_len, tvb(1, 1))
+                text = string.format("read flash %d", len == 0 and 256 or len)
+            end
+            pinfo.cols.info:set(text)
+            add_crc(tree, tvb, 0, 2)
+            return
+        end
+    end
+    if n > 2 then
+        tree:add(f_data, tvb(0, n - 2))
+        add_crc(tree, tvb, 0, n - 2)
+        pinfo.cols.info:set(string.format("buffer data %d", n - 2))
+    end
+end
+
+local function dissect_answer(tvb, pinfo, tree)
+    local n = tvb:len()
+    local last = tvb(n - 1, 1):uint()
+
+    if n >= 3 and tvb(0, 3):string() == "471" then
+        tree:add(f_info, tvb(0, math.min(n, 8)))
+        if n > 8 then
+            tree:add(f_result, tvb(n - 1, 1))
+        end
+        pinfo.cols.info:set("init answer")
+        return
+    end
+    if n == 1 and results[last] then
+        tree:add(f_result, tvb(0, 1))
+        pinfo.cols.info:set(results[last])
+        return
+    end
+    if n > 3 and results[last] then
+        tree:add(f_data, tvb(0, n - 3))
+        add_crc(tree, tvb, 0, n - 3)
+        tree:add(f_result, tvb(n - 1, 1))
+        pinfo.cols.info:set(string.format("read data %d, %s", n - 3, results[last]))
+    end
+end
+
+function usblink.dissector(tvb, pinfo, root)
+    if tvb:len() < 2 then
+        return 0
+    end
+    local dir = tvb(0, 1):uint()
+    local flags = tvb(1, 1):uint()
+    local tree = root:add(usblink, tvb(), "USBLink " .. (directions[dir] or "?"))
+
+    pinfo.cols.protocol:set("USBLink")
+    pinfo.cols.src:set(sources[dir] or "?")
+    pinfo.cols.dst:set(destinations[dir] or "?")
+    tree:add(f_dir, tvb(0, 1))
+    local ft = tree:add(f_flags, tvb(1, 1))
+    ft:add(f_fe, tvb(1, 1))
+    ft:add(f_pe, tvb(1, 1))
+    ft:add(f_be, tvb(1, 1))
+    ft:add(f_oe, tvb(1, 1))
+    ft:add(f_lost, tvb(1, 1))
+
+    if tvb:len() > 2 then
+        local chunk = tvb(2):tvb()
+        local boot = tree:add(usblink, chunk(), "Bootloader")
+        if dir == 0 or dir == 1 then
+            dissect_command(chunk, pinfo, boot)
+        else
+            dissect_answer(chunk, pinfo, boot)
+        end
+    end
+    if flags % 16 ~= 0 then
+        pinfo.cols.info:append(" [uart error]")
+    end
+    return tvb:len()
+end
+
+DissectorTable.get("wtap_encap"):add(wtap.USER0, usblink)
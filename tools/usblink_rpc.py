@@ -0,0 +1,881 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+#
+# Host side of the USBLink RPC channel (second CDC interface).
+#
+#   usblink_rpc.py /dev/ttyACM1 info
+#   usblink_rpc.py /dev/ttyACM1 angle 45
+#   usblink_rpc.py /dev/ttyACM1 latency 1000 11
+#   usblink_rpc.py /dev/ttyACM1 upload 0 AM32_G071.hex
+#   usblink_rpc.py /dev/ttyACM1 flash 0
+#   usblink_rpc.py /dev/ttyACM1 capture esc.vcd 5 rx0
+#   usblink_rpc.py /dev/ttyACM1 sniff flash.pcapng 30
+#   usblink_rpc.py /dev/ttyACM1 log 0 debug
+#   usblink_rpc.py /dev/ttyACM1 profile build/USBLink.elf 10
+#   usblink_rpc.py /dev/ttyACM1 update build/USBLink.bin build/USBLink_b.bin
+
+import bisect
+import os
+import re
+import struct
+import subprocess
+import sys
+import time
+import zlib
+
+import serial
+
+SYNC = 0xA5
+MAX_FRAME = 1024
+
+OK, ERR_OPCODE, ERR_ARGS, ERR_STATE, ERR_RANGE, ERR_FULL, ERR_CRC, ERR_NOSPACE = range(8)
+CFG_KEYS = ["boot_mode", "uart_baud", "servo_min_us", "servo_max_us", "servo_profile", "rc_min_us", "rc_max_us",
+            "recv_update_ms", "servo_update_ms", "msg_update_ms", "esc_image",
+            "esc_flash_diff", "esc_line_ctrl", "relay_in_pin", "relay_profile", "relay_rate", "relay_expo",
+            "relay_min_us", "relay_max_us", "relay_failsafe_us", "relay_timeout_ms", "bridge_flush_us"]
+
+STATUS = ["ok", "opcode", "args", "state", "range", "full", "crc", "nospace"]
+FLASH_STATE = ["idle", "busy", "pass", "fail"]
+FLASH_ERROR = ["none", "image", "power", "connect", "write", "verify", "abort"]
+LA_STATE = ["idle", "armed", "triggered", "done", "overrun"]
+# logic analyser pins, bit 0 and 1 of a sample
+LA_PINS = ["tx", "rx"]
+SNIFF_DIR = ["usb out", "uart tx", "uart rx", "usb in"]
+# pcapng link type for the sniffer records, dissected by usblink.lua
+LINKTYPE_USER0 = 147
+TLOG_LEVELS = ["trace", "debug", "info", "warn", "error", "off"]
+RELAY_STATE = ["off", "power up", "run"]
+WATCH_STEPS = ["init", "uart cfg", "rpc", "la", "mode switch", "mode task", "sleep", "reset",
+               "usb", "cdc", "rpc usb"]
+# message table of the firmware log, the id is the position
+TLOG_MSGS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tlog_msgs.h")
+
+OP_PING = 0x01
+OP_INFO = 0x02
+OP_MODE_SET = 0x03
+OP_BOOT_TRACE = 0x04
+OP_CFG_GET = 0x05
+OP_CFG_SET = 0x06
+OP_CFG_COMMIT = 0x07
+OP_CFG_RESET = 0x08
+OP_RECV_GET_PULSE = 0x10
+OP_SERVO_GET_STATUS = 0x20
+OP_SERVO_SET_ANGLE = 0x21
+OP_SERVO_SET_NANOS = 0x22
+OP_SERVO_SET_PROFILE = 0x23
+OP_SERVO_GROUP_START = 0x24
+OP_SERVO_GROUP_SET = 0x25
+OP_SERVO_GROUP_STOP = 0x26
+OP_PLAY_CLEAR = 0x30
+OP_PLAY_ADD = 0x31
+OP_PLAY_RAMP = 0x32
+OP_PLAY_SINE = 0x33
+OP_PLAY_START = 0x34
+OP_PLAY_STOP = 0x35
+OP_PLAY_STATUS = 0x36
+OP_LAT_START = 0x40
+OP_LAT_RESULT = 0x41
+OP_LAT_HIST = 0x42
+OP_IMG_BEGIN = 0x50
+OP_IMG_WRITE = 0x51
+OP_IMG_END = 0x52
+OP_IMG_INFO = 0x53
+OP_ESC_FLASH = 0x54
+OP_ESC_FLASH_STATUS = 0x55
+OP_ESC_SET_LOAD = 0x56
+OP_ESC_SET_GET = 0x57
+OP_ESC_SET_APPLY = 0x58
+OP_ESC_SET_STATUS = 0x59
+OP_LA_START = 0x60
+OP_LA_STOP = 0x61
+OP_LA_STATUS = 0x62
+OP_LA_READ = 0x63
+OP_SNIFF_START = 0x64
+OP_SNIFF_STOP = 0x65
+OP_SNIFF_STATUS = 0x66
+OP_SNIFF_READ = 0x67
+OP_TLOG_LEVEL = 0x68
+OP_TLOG_STATUS = 0x69
+OP_TLOG_READ = 0x6A
+OP_PROF_START = 0x6B
+OP_PROF_STOP = 0x6C
+OP_PROF_STATUS = 0x6D
+OP_PROF_READ = 0x6E
+OP_MEM_STATUS = 0x6F
+OP_BRIDGE_ERRORS = 0x70
+OP_ESC_LINE = 0x71
+OP_WATCH_STATUS = 0x72
+OP_WATCH_LAST = 0x73
+OP_AB_STATUS = 0x74
+OP_AB_BEGIN = 0x75
+OP_AB_WRITE = 0x76
+OP_AB_END = 0x77
+OP_AB_SWITCH = 0x78
+OP_RELAY_STATUS = 0x79
+
+ESC_SETTINGS_SIZE = 256
+
+# image data per write command, a full frame carries four of them
+IMG_CHUNK = 248
+# AM32 bootloader addresses are offsets to the flash base
+ESC_FLASH_BASE = 0x08000000
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+class RpcError(Exception):
+    pass
+
+
+def load_image(path, address=0x1000):
+    """Read an Intel HEX or bin file, return (bootloader address, data)."""
+    if not path.lower().endswith(".hex"):
+        with open(path, "rb") as f:
+            return address, f.read()
+    mem = {}
+    upper = 0
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith(":"):
+                continue
+            rec = bytes.fromhex(line[1:])
+            n, addr, kind = rec[0], (rec[1] << 8) | rec[2], rec[3]
+            if sum(rec) & 0xFF:
+                raise RpcError("hex checksum")
+            if kind == 0:
+                for i, b in enumerate(rec[4:4 + n]):
+                    mem[upper + addr + i] = b
+            elif kind == 2:
+                upper = ((rec[4] << 8) | rec[5]) << 4
+            elif kind == 4:
+                upper = ((rec[4] << 8) | rec[5]) << 16
+            elif kind == 1:
+                break
+    first, last = min(mem), max(mem)
+    data = bytes(mem.get(a, 0xFF) for a in range(first, last + 1))
+    return first - ESC_FLASH_BASE if first >= ESC_FLASH_BASE else first, data
+
+
+class UsbLink:
+    def __init__(self, port, timeout=1.0):
+        self.ser = serial.Serial(port, timeout=timeout)
+        self.seq = 0
+
+    def close(self):
+        self.ser.close()
+
+    def call(self, cmds):
+        """Send a list of (opcode, args) in one frame, return a list of (opcode, status, data)."""
+        body = bytes([self.seq])
+        for op, args in cmds:
+            body += bytes([op, len(args)]) + args
+        if len(body) > MAX_FRAME:
+            raise RpcError("frame too long")
+        hdr = struct.pack("<H", len(body))
+        self.ser.write(bytes([SYNC]) + hdr + body + struct.pack("<H", crc16(hdr + body)))
+        rsp = self._read_frame()
+        if rsp[0] != self.seq:
+            raise RpcError("sequence mismatch")
+        self.seq = (self.seq + 1) & 0xFF
+        results = []
+        pos = 1
+        while pos + 3 <= len(rsp):
+            op, status, n = rsp[pos], rsp[pos + 1], rsp[pos + 2]
+            results.append((op, status, rsp[pos + 3:pos + 3 + n]))
+            pos += 3 + n
+        return results
+
+    def _read_frame(self):
+        deadline = time.monotonic() + self.ser.timeout
+        while time.monotonic() < deadline:
+            b = self.ser.read(1)
+            if not b or b[0] != SYNC:
+                continue
+            hdr = self.ser.read(2)
+            (n,) = struct.unpack("<H", hdr)
+            if n < 1 or n > MAX_FRAME:
+                continue
+            body = self.ser.read(n + 2)
+            if len(body) != n + 2:
+                break
+            if crc16(hdr + body[:n]) != struct.unpack("<H", body[n:])[0]:
+                raise RpcError("response crc")
+            return body[:n]
+        raise RpcError("timeout")
+
+    def cmd(self, op, args=b""):
+        (_, status, data), = self.call([(op, args)])
+        if status != OK:
+            raise RpcError("opcode 0x%02x failed: %s" % (op, STATUS[status] if status < len(STATUS) else status))
+        return data
+
+    # wrappers
+    def ping(self, data=b""):
+        return self.cmd(OP_PING, data)
+
+    def info(self):
+        version, opmode, max_frame = struct.unpack("<BBH", self.cmd(OP_INFO))
+        return {"version": version, "opmode": opmode, "max_frame": max_frame}
+
+    def mode(self, mode):
+        """1 esc programmer, 2 receiver test, 3 servo test, 4 bridge benchmark"""
+        self.cmd(OP_MODE_SET, bytes([mode]))
+
+    def boot_trace(self):
+        data = self.cmd(OP_BOOT_TRACE)
+        trace = []
+        pos = 0
+        while pos + 5 <= len(data):
+            t, n = struct.unpack("<IB", data[pos:pos + 5])
+            trace.append((t, data[pos + 5:pos + 5 + n].decode()))
+            pos += 5 + n
+        return trace
+
+    def cfg_get(self, key):
+        return struct.unpack("<I", self.cmd(OP_CFG_GET, bytes([CFG_KEYS.index(key)])))[0]
+
+    def cfg_set(self, key, value):
+        self.cmd(OP_CFG_SET, struct.pack("<BI", CFG_KEYS.index(key), value))
+
+    def cfg_commit(self):
+        return struct.unpack("<I", self.cmd(OP_CFG_COMMIT))[0]
+
+    def cfg_reset(self):
+        self.cmd(OP_CFG_RESET)
+
+    def pulse(self):
+        return struct.unpack("<I", self.cmd(OP_RECV_GET_PULSE))[0]
+
+    def status(self):
+        f = struct.unpack("<BBBBBII", self.cmd(OP_SERVO_GET_STATUS))
+        return dict(zip(("state", "angle", "profile", "playing", "measuring", "period_ns", "step_ps"), f))
+
+    def angle(self, deg):
+        self.cmd(OP_SERVO_SET_ANGLE, bytes([deg]))
+
+    def nanos(self, ns):
+        self.cmd(OP_SERVO_SET_NANOS, struct.pack("<I", ns))
+
+    def profile(self, index):
+        self.cmd(OP_SERVO_SET_PROFILE, bytes([index]))
+
+    def group_start(self, pins):
+        self.cmd(OP_SERVO_GROUP_START, bytes(pins))
+
+    def group_set(self, nanos):
+        """pulse in ns per channel, True when a synchronized profile latched at the frame end"""
+        return bool(self.cmd(OP_SERVO_GROUP_SET, b"".join(struct.pack("<BI", i, ns) for i, ns in enumerate(nanos)))[0])
+
+    def group_stop(self):
+        self.cmd(OP_SERVO_GROUP_STOP)
+
+    def play_load(self, points):
+        """points: list of (ns, frames), sent 42 points per command and several commands per frame"""
+        cmds = [(OP_PLAY_CLEAR, b"")]
+        for i in range(0, len(points), 42):
+            cmds.append((OP_PLAY_ADD, b"".join(struct.pack("<IH", ns, n) for ns, n in points[i:i + 42])))
+        count = 0
+        for i in range(0, len(cmds), 3):
+            for op, status, data in self.call(cmds[i:i + 3]):
+                if status != OK:
+                    raise RpcError("upload failed: %s" % STATUS[status])
+                if op == OP_PLAY_ADD:
+                    count = struct.unpack("<H", data)[0]
+        return count
+
+    def play_start(self, loops=0):
+        self.cmd(OP_PLAY_START, struct.pack("<H", loops))
+
+    def play_stop(self):
+        self.cmd(OP_PLAY_STOP)
+
+    def latency(self, frames=1000, steps=11):
+        self.cmd(OP_LAT_START, struct.pack("<HB", frames, steps))
+        while True:
+            data = self.cmd(OP_LAT_RESULT)
+            if not data[0]:
+                break
+            time.sleep(0.1)
+        f = struct.unpack("<IIII4i4i3I", data[1:])
+        res = {"frames": f[0], "matched": f[1], "missed": f[2], "extra": f[3],
+               "latency": f[4:8], "width_error": f[8:12], "p50_us": f[12], "p90_us": f[13], "p99_us": f[14]}
+        hist = []
+        while True:
+            data = self.cmd(OP_LAT_HIST, bytes([len(hist), 60]))
+            n = data[1]
+            hist += struct.unpack("<%dI" % n, data[2:])
+            if n < 60:
+                break
+        res["hist"] = hist
+        return res
+
+    def img_upload(self, slot, address, data, name=""):
+        (_, status, _), = self.call([(OP_IMG_BEGIN, struct.pack("<BII", slot, len(data), address) + name.encode()[:31])])
+        if status == STATUS.index("state"):
+            # flash erases would stall the bridge
+            raise RpcError("upload refused: flashing an ESC, or the console is open or the bridge busy")
+        if status != OK:
+            raise RpcError("upload failed: %s" % STATUS[status])
+        cmds = [(OP_IMG_WRITE, struct.pack("<BI", slot, i) + data[i:i + IMG_CHUNK])
+                for i in range(0, len(data), IMG_CHUNK)]
+        for i in range(0, len(cmds), 4):
+            for op, status, _ in self.call(cmds[i:i + 4]):
+                if status != OK:
+                    raise RpcError("upload failed: %s" % STATUS[status])
+        self.cmd(OP_IMG_END, struct.pack("<BI", slot, zlib.crc32(data)))
+
+    def img_info(self, slot):
+        data = self.cmd(OP_IMG_INFO, bytes([slot]))
+        size, address, crc = struct.unpack("<III", data[:12])
+        return {"size": size, "address": address, "crc": crc, "name": data[12:].decode(errors="replace")}
+
+    def esc_flash(self, slot, diff=None):
+        """flash the image of slot into the ESC, diff writes only changed chunks (None: esc_flash_diff)"""
+        self.cmd(OP_ESC_FLASH, bytes([slot]) if diff is None else bytes([slot, int(diff)]))
+        while True:
+            state, error, done, total, written = struct.unpack("<BBIII", self.cmd(OP_ESC_FLASH_STATUS))
+            if state != 1:
+                return {"state": FLASH_STATE[state], "error": FLASH_ERROR[error], "done": done, "total": total,
+                        "written": written}
+            time.sleep(0.2)
+
+    def _settings_wait(self):
+        while True:
+            state, error, cached, written = self.cmd(OP_ESC_SET_STATUS)
+            if state != 1:
+                if state != 2:
+                    raise RpcError("esc settings failed: %s" % FLASH_ERROR[error])
+                return bool(written)
+            time.sleep(0.05)
+
+    def esc_settings(self, force=False):
+        """settings block of the connected ESC, read once per ESC power cycle"""
+        self.cmd(OP_ESC_SET_LOAD, bytes([int(force)]))
+        self._settings_wait()
+        half = ESC_SETTINGS_SIZE // 2
+        return self.cmd(OP_ESC_SET_GET, bytes([0, half])) + self.cmd(OP_ESC_SET_GET, bytes([half, half]))
+
+    def esc_settings_apply(self, changes):
+        """changes: list of (offset, bytes), True if the ESC was written"""
+        self.cmd(OP_ESC_SET_APPLY, b"".join(bytes([off, len(data)]) + data for off, data in changes))
+        return self._settings_wait()
+
+    def la_status(self):
+        f = struct.unpack("<BBHIIH", self.cmd(OP_LA_STATUS))
+        return dict(zip(("state", "level", "available", "trigger", "clk_hz", "div"), f))
+
+    def la_read(self):
+        """records as (flags, pio time), four read commands per frame"""
+        recs = []
+        for op, status, data in self.call([(OP_LA_READ, b"")] * 4):
+            if status != OK:
+                raise RpcError("la read failed: %s" % STATUS[status])
+            recs += struct.iter_unpack("<BI", data)
+        return recs
+
+    def capture(self, seconds=1.0, trigger=None, pre=100, div=1, power=True):
+        """capture the one-wire pins and ESC power for seconds after the trigger ("rx0", "tx1", None: at once),
+        returns (status, line records, power records) with the times unwrapped"""
+        mask = value = 0
+        if trigger:
+            bit = 1 << LA_PINS.index(trigger[:2])
+            mask, value = bit, bit if trigger[2:] == "1" else 0
+        self.cmd(OP_LA_START, struct.pack("<BBBHHH", int(power), mask, value, pre, 0, div))
+        line, pwr = [], []
+        initial = None
+        stopped = False
+        end = time.monotonic() + seconds
+        try:
+            while True:
+                st = self.la_status()
+                if st["state"] == 4:
+                    raise RpcError("capture overrun, raise the clock divider")
+                if st["state"] == 1:
+                    if time.monotonic() > end:
+                        raise RpcError("no trigger")
+                    time.sleep(0.01)
+                    continue
+                if initial is None:
+                    # level before the first record, nothing was read yet
+                    initial = st["level"]
+                    end = time.monotonic() + seconds
+                if not stopped and time.monotonic() > end:
+                    self.cmd(OP_LA_STOP)
+                    stopped = True
+                    continue
+                recs = self.la_read()
+                for flags, t in recs:
+                    (pwr if flags & 0x40 else line).append((flags, t))
+                if st["state"] == 3 and not recs:
+                    break
+                if not recs:
+                    time.sleep(0.01)
+        finally:
+            if not stopped:
+                self.cmd(OP_LA_STOP)
+        st["initial"] = initial
+        # line records are less than 2^32 cycles apart, a counter overflow adds a record
+        out = []
+        base = 0
+        for flags, t in line:
+            if out and base + t < out[-1][1]:
+                base += 1 << 32
+            out.append((flags, base + t))
+        # power changes go to the epoch nearest to the line records
+        ref = out[-1][1] if out else 0
+        pwr_out = []
+        for flags, t in pwr:
+            full = (ref & ~0xFFFFFFFF) + t
+            if full - ref > 1 << 31:
+                full -= 1 << 32
+            elif ref - full > 1 << 31:
+                full += 1 << 32
+            pwr_out.append((flags, max(full, 0)))
+        return st, out, pwr_out
+
+    def sniff(self, seconds):
+        """bridge traffic for seconds as (host time s, direction, flags, data), lost record count"""
+        self.cmd(OP_SNIFF_START)
+        stream = b""
+        # device time to host time, the record times are unwrapped against the last one
+        _, _, _, dev_us = struct.unpack("<BIII", self.cmd(OP_SNIFF_STATUS))
+        offset = time.time() - dev_us / 1e6
+        end = time.monotonic() + seconds
+        try:
+            while time.monotonic() < end:
+                data = b"".join(d for _, _, d in self.call([(OP_SNIFF_READ, b"")] * 4))
+                stream += data
+                if not data:
+                    time.sleep(0.01)
+        finally:
+            self.cmd(OP_SNIFF_STOP)
+        while True:
+            data = b"".join(d for _, _, d in self.call([(OP_SNIFF_READ, b"")] * 4))
+            if not data:
+                break
+            stream += data
+        lost = struct.unpack("<BIII", self.cmd(OP_SNIFF_STATUS))[2]
+        records = []
+        base = 0
+        last = dev_us
+        pos = 0
+        while pos + 8 <= len(stream):
+            t, direction, flags, n = struct.unpack_from("<IBBH", stream, pos)
+            if pos + 8 + n > len(stream):
+                break
+            if t < last and last - t > 1 << 31:
+                base += 1 << 32
+            last = t
+            records.append((offset + (base + t) / 1e6, direction, flags, stream[pos + 8:pos + 8 + n]))
+            pos += 8 + n
+        return records, lost
+
+    def tlog_level(self, level):
+        self.cmd(OP_TLOG_LEVEL, bytes([TLOG_LEVELS.index(level)]))
+
+    def tlog_status(self):
+        f = struct.unpack("<BHHIH", self.cmd(OP_TLOG_STATUS))
+        return dict(zip(("level", "core0", "core1", "lost", "messages"), f))
+
+    def tlog_read(self):
+        """records as (time us, core, level, id, args), four read commands per frame"""
+        recs = []
+        for op, status, data in self.call([(OP_TLOG_READ, b"")] * 4):
+            if status != OK:
+                raise RpcError("log read failed: %s" % STATUS[status])
+            pos = 0
+            while pos + 8 <= len(data):
+                t, msg, level, n = struct.unpack_from("<IHBB", data, pos)
+                args = struct.unpack_from("<%dI" % n, data, pos + 8)
+                recs.append((t, level >> 7, level & 0x7F, msg, args))
+                pos += 8 + 4 * n
+        recs.sort(key=lambda r: r[0])
+        return recs
+
+    def profile(self, seconds, period_us=100):
+        """sample both cores for seconds, returns per core (samples, dropped, {pc: count})"""
+        self.cmd(OP_PROF_START, struct.pack("<H", period_us))
+        time.sleep(seconds)
+        self.cmd(OP_PROF_STOP)
+        f = struct.unpack("<BHIIII", self.cmd(OP_PROF_STATUS))
+        result = []
+        for core in range(2):
+            pcs = {}
+            slot = 0
+            while True:
+                data = self.cmd(OP_PROF_READ, struct.pack("<BH", core, slot))
+                (slot,) = struct.unpack_from("<H", data)
+                for pc, count in struct.iter_unpack("<II", data[2:]):
+                    pcs[pc] = count
+                if len(data) == 2:
+                    break
+            result.append((f[3 + 2 * core], f[4 + 2 * core], pcs))
+        return result
+
+    def uart_errors(self, clear=False):
+        f = struct.unpack("<4I", self.cmd(OP_BRIDGE_ERRORS, bytes([int(clear)])))
+        return dict(zip(("framing", "parity", "break", "overrun"), f))
+
+    def esc_line(self, hold=None, arm=False):
+        """hold the one-wire line low (arm: until esc power up), None only reads the state"""
+        args = b"" if hold is None else bytes([int(hold), int(arm)])
+        f = struct.unpack("<BBBBI", self.cmd(OP_ESC_LINE, args))
+        return dict(zip(("hold", "break", "armed", "power", "power_up_us"), f))
+
+    def mem_status(self):
+        f = struct.unpack("<7I", self.cmd(OP_MEM_STATUS))
+        return dict(zip(("arena", "arena_used", "arena_peak", "stack0", "stack0_used", "stack1", "stack1_used"), f))
+
+    def watch_status(self, clear=False):
+        """[(loops, worst us, overruns)] per core, clear resets worst and overruns after reading"""
+        f = struct.unpack("<6I", self.cmd(OP_WATCH_STATUS, bytes([int(clear)])))
+        return [f[0:3], f[3:6]]
+
+    def ab_status(self):
+        f = struct.unpack("<BBBBI4I", self.cmd(OP_AB_STATUS))
+        return {"running": f[0], "active": f[1], "trial": None if f[2] == 0xFF else f[2],
+                "trial_running": bool(f[3] & 1), "rolled_back": bool(f[3] & 2), "upload": bool(f[3] & 4),
+                "slot_size": f[4], "images": [{"size": f[5], "crc": f[6]}, {"size": f[7], "crc": f[8]}]}
+
+    def ab_update(self, images):
+        """images: firmware linked per slot, the one for the slot that is not running is uploaded and
+        booted as trial, returns the slot; the device restarts"""
+        slot = self.ab_status()["running"] ^ 1
+        data = images[slot]
+        (_, status, _), = self.call([(OP_AB_BEGIN, struct.pack("<I", len(data)))])
+        if status == STATUS.index("state"):
+            # flash erases would stall the bridge
+            raise RpcError("upload refused: trial running, or the console is open or the bridge busy")
+        if status != OK:
+            raise RpcError("upload failed: %s" % STATUS[status])
+        cmds = [(OP_AB_WRITE, struct.pack("<I", i) + data[i:i + IMG_CHUNK]) for i in range(0, len(data), IMG_CHUNK)]
+        for i in range(0, len(cmds), 4):
+            for op, status, _ in self.call(cmds[i:i + 4]):
+                if status != OK:
+                    raise RpcError("upload failed: %s" % STATUS[status])
+        self.cmd(OP_AB_END, struct.pack("<I", zlib.crc32(data)))
+        self.cmd(OP_AB_SWITCH)
+        return slot
+
+    def relay_status(self, clear=False):
+        """signal relay mode only, clear resets the counters after reading"""
+        f = struct.unpack("<4B8I", self.cmd(OP_RELAY_STATUS, bytes([int(clear)])))
+        return {"state": RELAY_STATE[f[0]] if f[0] < len(RELAY_STATE) else f[0], "signal": bool(f[1]),
+                "in_pin": f[2], "profile": f[3], "frames": f[4], "glitches": f[5], "failsafes": f[6],
+                "in_us": f[7], "out_ns": f[8], "latency_us": f[9:12]}
+
+    def watch_last(self):
+        """record of the run before the last watchdog reboot, None if there was none"""
+        f = struct.unpack("<B7I4BIHH", self.cmd(OP_WATCH_LAST))
+        if not f[0]:
+            return None
+        return {"uptime_ms": f[1], "loops": f[2:8:3], "worst_us": f[3:8:3], "overruns": f[4:8:3],
+                "step": [WATCH_STEPS[s] if s < len(WATCH_STEPS) else s for s in f[8:10]],
+                "opmode": f[10], "stalled": f[11], "stall_ms": f[12], "uart_fill": f[13], "usb_fill": f[14]}
+
+def load_symbols(elf):
+    """sorted (address, name) of the functions in elf, NM selects the nm binary"""
+    out = subprocess.run([os.environ.get("NM", "arm-none-eabi-nm"), "-n", "-C", "--defined-only", elf],
+                         capture_output=True, text=True, check=True).stdout
+    syms = []
+    for line in out.splitlines():
+        f = line.split(maxsplit=2)
+        if len(f) == 3 and f[1] in "TtWw":
+            # thumb functions have bit 0 set in some tables
+            syms.append((int(f[0], 16) & ~1, f[2]))
+    return sorted(syms)
+
+
+def map_samples(syms, pcs):
+    """{function: count}, pcs outside of the elf go to bootrom or unknown"""
+    addrs = [a for a, _ in syms]
+    funcs = {}
+    for pc, count in pcs.items():
+        i = bisect.bisect_right(addrs, pc) - 1
+        if pc < 0x10000000:
+            name = "(bootrom)"
+        elif i < 0:
+            name = "(unknown)"
+        else:
+            name = syms[i][1]
+        funcs[name] = funcs.get(name, 0) + count
+    return funcs
+
+
+def load_tlog_msgs(path=TLOG_MSGS):
+    """(name, level, format) per message id from tlog_msgs.h"""
+    with open(path) as f:
+        return re.findall(r'^TLOG_MSG\((\w+),\s*TLOG_(\w+),\s*"(.*)"\)', f.read(), re.M)
+
+
+def format_tlog(msgs, msg, args):
+    """printf conversions of the table with the raw u32 arguments, %d and %i are signed"""
+    if msg >= len(msgs):
+        return "unknown message %d %s" % (msg, " ".join("0x%x" % a for a in args))
+    fmt = msgs[msg][2]
+    conv = [c for c in re.findall(r"%[-+ 0#]*\d*(?:\.\d+)?[hlL]*([diouxXc%])", fmt) if c != "%"]
+    vals = []
+    for c, a in zip(conv, args):
+        vals.append(a - (1 << 32) if c in "di" and a & 0x80000000 else a)
+    try:
+        return fmt % tuple(vals)
+    except (TypeError, ValueError):
+        return "%s %s" % (fmt, args)
+
+
+def write_pcapng(path, records):
+    """records as (host time s, direction, flags, data), packet data is direction u8, flags u8, chunk"""
+    def block(kind, body):
+        body += b"\0" * (-len(body) % 4)
+        n = len(body) + 12
+        return struct.pack("<II", kind, n) + body + struct.pack("<I", n)
+
+    with open(path, "wb") as f:
+        f.write(block(0x0A0D0D0A, struct.pack("<IHHq", 0x1A2B3C4D, 1, 0, -1)))
+        f.write(block(1, struct.pack("<HHI", LINKTYPE_USER0, 0, 0)))
+        for t, direction, flags, data in records:
+            us = int(t * 1e6)
+            pkt = bytes([direction, flags]) + data
+            f.write(block(6, struct.pack("<IIIII", 0, us >> 32, us & 0xFFFFFFFF, len(pkt), len(pkt)) + pkt))
+
+
+def write_vcd(path, st, line, pwr):
+    """value change dump, timescale 1ns, opens in pulseview and gtkwave"""
+    ns = st["div"] * 1e9 / st["clk_hz"]
+    ids = {"tx": "!", "rx": "\"", "power": "#"}
+    changes = []
+    level = st["initial"]
+    for flags, t in line:
+        if flags & 0x80:
+            continue
+        for i, name in enumerate(LA_PINS):
+            if (flags ^ level) & (1 << i):
+                changes.append((t, name, (flags >> i) & 1))
+        level = flags & 3
+    for flags, t in pwr:
+        changes.append((t, "power", flags & 1))
+    changes.sort()
+    with open(path, "w") as f:
+        f.write("$timescale 1ns $end\n$scope module usblink $end\n")
+        for name, code in ids.items():
+            f.write("$var wire 1 %s %s $end\n" % (code, name))
+        f.write("$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n")
+        for i, name in enumerate(LA_PINS):
+            f.write("%d%s\n" % ((st["initial"] >> i) & 1, ids[name]))
+        f.write("x%s\n$end\n" % ids["power"])
+        last = 0
+        for t, name, v in changes:
+            stamp = int(round(t * ns))
+            if stamp != last:
+                f.write("#%d\n" % stamp)
+                last = stamp
+            f.write("%d%s\n" % (v, ids[name]))
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: usblink_rpc.py <port> info|boot|cfg [key [value]]|mode <n>|pulse|status|angle <deg>|nanos <ns>|profile <n>|"
+              "group [pin ...]|gset <us> ...|"
+              "ramp <from_us> <to_us> <frames>|stop|latency [frames] [steps]|upload <slot> <file> [address]|images|"
+              "flash <slot> [diff]|settings [force]|apply <profile>|capture <file.vcd> [seconds] [rx0|rx1|tx0|tx1]|"
+              "sniff <file.pcapng> [seconds]|log [seconds] [level]|profile <elf> [seconds] [period_us]|mem|errors [clear]|line [hold [arm]]|watch [clear]|"
+              "relay [clear]|fw|update <slot0.bin> <slot1.bin>")
+        return 1
+    link = UsbLink(sys.argv[1])
+    what = sys.argv[2]
+    if what == "cfg":
+        # cfg [key [value]] lists, reads or sets and commits a value
+        if len(sys.argv) == 3:
+            for key in CFG_KEYS:
+                print(key, link.cfg_get(key))
+        elif len(sys.argv) == 4:
+            print(link.cfg_get(sys.argv[3]))
+        else:
+            link.cfg_set(sys.argv[3], int(sys.argv[4]))
+            print("record", link.cfg_commit())
+        link.close()
+        return 0
+    if what == "upload":
+        # intel hex or bin, the address applies to bin files only
+        address, data = load_image(sys.argv[4], int(sys.argv[5], 0) if len(sys.argv) > 5 else 0x1000)
+        link.img_upload(int(sys.argv[3]), address, data, sys.argv[4].replace("\\", "/").split("/")[-1])
+        print("slot %s: %d bytes at 0x%04x" % (sys.argv[3], len(data), address))
+        link.close()
+        return 0
+    if what == "update":
+        # firmware self-update, the device restarts and confirms the new firmware after a healthy run
+        images = []
+        for path in sys.argv[3:5]:
+            with open(path, "rb") as f:
+                images.append(f.read())
+        start = time.monotonic()
+        slot = link.ab_update(images)
+        link.close()
+        print("slot %d: %d bytes written, restarting" % (slot, len(images[slot])))
+        st = None
+        while time.monotonic() - start < 60:
+            time.sleep(1)
+            try:
+                link = UsbLink(sys.argv[1])
+                st = link.ab_status()
+                link.close()
+            except (serial.SerialException, RpcError, OSError):
+                continue
+            # the pending trial is cleared by the confirm or the rollback
+            if st["trial"] is None:
+                break
+        if st is None or st["trial"] is not None:
+            print("no confirmed firmware after 60 s")
+            return 1
+        if st["running"] != slot:
+            print("trial failed, back in slot %d" % st["running"])
+            return 1
+        print("slot %d confirmed after %.1f s" % (slot, time.monotonic() - start))
+        return 0
+    if what == "apply":
+        # profile lines: offset value [value ...], # starts a comment
+        changes = []
+        with open(sys.argv[3]) as f:
+            for line in f:
+                v = [int(a, 0) for a in line.split("#")[0].split()]
+                if v:
+                    changes.append((v[0], bytes(v[1:])))
+        print("written" if link.esc_settings_apply(changes) else "unchanged")
+        link.close()
+        return 0
+    if what == "capture":
+        # free run or trigger on a level change of one pin, seconds after the trigger
+        seconds = float(sys.argv[4]) if len(sys.argv) > 4 else 1.0
+        st, line, pwr = link.capture(seconds, sys.argv[5] if len(sys.argv) > 5 else None)
+        write_vcd(sys.argv[3], st, line, pwr)
+        print("%d line and %d power records, %.1f ns per cycle" % (len(line), len(pwr), st["div"] * 1e9 / st["clk_hz"]))
+        link.close()
+        return 0
+    if what == "sniff":
+        # bridge traffic, open with wireshark -X lua_script:tools/usblink.lua
+        records, lost = link.sniff(float(sys.argv[4]) if len(sys.argv) > 4 else 10.0)
+        write_pcapng(sys.argv[3], records)
+        for d, name in enumerate(SNIFF_DIR):
+            print("%-8s %6d bytes" % (name, sum(len(r[3]) for r in records if r[1] == d)))
+        print("%d records, %d lost" % (len(records), lost))
+        link.close()
+        return 0
+    if what == "log":
+        # print the firmware log for seconds (0 until interrupted), level is set on the device first
+        seconds = float(sys.argv[3]) if len(sys.argv) > 3 else 0
+        if len(sys.argv) > 4:
+            link.tlog_level(sys.argv[4])
+        msgs = load_tlog_msgs()
+        st = link.tlog_status()
+        if st["messages"] != len(msgs):
+            print("warning: firmware has %d messages, %s %d" % (st["messages"], TLOG_MSGS, len(msgs)))
+        end = time.monotonic() + seconds
+        try:
+            while not seconds or time.monotonic() < end:
+                recs = link.tlog_read()
+                for t, core, level, msg, margs in recs:
+                    print("%12.6f %d %-5s %s" % (t / 1e6, core, TLOG_LEVELS[min(level, 5)], format_tlog(msgs, msg, margs)))
+                if not recs:
+                    time.sleep(0.05)
+        except KeyboardInterrupt:
+            pass
+        link.close()
+        return 0
+    if what == "profile":
+        # time per function on both cores, sampled by a timer interrupt
+        syms = load_symbols(sys.argv[3])
+        seconds = float(sys.argv[4]) if len(sys.argv) > 4 else 5.0
+        period = int(sys.argv[5]) if len(sys.argv) > 5 else 100
+        for core, (samples, dropped, pcs) in enumerate(link.profile(seconds, period)):
+            print("core %d: %d samples, %d not counted (table full)" % (core, samples, dropped))
+            funcs = map_samples(syms, pcs)
+            for name, count in sorted(funcs.items(), key=lambda f: -f[1])[:25]:
+                print("  %6.2f%% %8d  %s" % (100.0 * count / max(samples, 1), count, name))
+        link.close()
+        return 0
+    args = [int(a) for a in sys.argv[3:]]
+    if what == "info":
+        print(link.info())
+    elif what == "boot":
+        last = 0
+        for t, stage in link.boot_trace():
+            print("%8d %+7d %s" % (t, t - last, stage))
+            last = t
+    elif what == "mode":
+        link.mode(args[0])
+    elif what == "pulse":
+        print(link.pulse())
+    elif what == "status":
+        print(link.status())
+    elif what == "angle":
+        link.angle(args[0])
+    elif what == "nanos":
+        link.nanos(args[0])
+    elif what == "profile":
+        link.profile(args[0])
+    elif what == "group":
+        if args:
+            link.group_start(args)
+        else:
+            link.group_stop()
+    elif what == "gset":
+        if link.group_set([us * 1000 for us in args]):
+            print("late")
+    elif what == "ramp":
+        link.cmd(OP_PLAY_CLEAR)
+        link.cmd(OP_PLAY_RAMP, struct.pack("<IIH", args[0] * 1000, args[1] * 1000, args[2]))
+        link.play_start(0)
+    elif what == "stop":
+        link.play_stop()
+    elif what == "latency":
+        res = link.latency(*args)
+        hist = res.pop("hist")
+        print(res)
+        print("histogram us:", " ".join("%d:%d" % (i, n) for i, n in enumerate(hist) if n))
+    elif what == "mem":
+        st = link.mem_status()
+        print("arena   %5d of %5d bytes, peak %d" % (st["arena_used"], st["arena"], st["arena_peak"]))
+        for core in range(2):
+            size, used = st["stack%d" % core], st["stack%d_used" % core]
+            print("stack %d %5d of %5d bytes%s" % (core, used, size, ", overflow" if used >= size else ""))
+    elif what == "relay":
+        st = link.relay_status(bool(args[0]) if args else False)
+        print(st)
+        # the output pulse starts at the trailing edge of the input pulse
+        print("added delay %d us" % (st["in_us"] + st["latency_us"][1]))
+    elif what == "fw":
+        print(link.ab_status())
+    elif what == "watch":
+        for core, (loops, worst, overruns) in enumerate(link.watch_status(bool(args[0]) if args else False)):
+            print("core %d %10d loops, worst %6d us, %d overruns" % (core, loops, worst, overruns))
+        print("last reset:", link.watch_last())
+    elif what == "line":
+        print(link.esc_line(args[0] if args else None, args[1] if len(args) > 1 else False))
+    elif what == "errors":
+        print(link.uart_errors(bool(args[0]) if args else False))
+    elif what == "images":
+        for slot in range(4):
+            print(slot, link.img_info(slot))
+    elif what == "flash":
+        print(link.esc_flash(args[0], args[1] if len(args) > 1 else None))
+    elif what == "settings":
+        data = link.esc_settings(bool(args[0]) if args else False)
+        for i in range(0, len(data), 16):
+            print("%02x: %s" % (i, data[i:i + 16].hex(" ")))
+    link.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -12,8 +12,19 @@
 
 #define CFG_TUSB_RHPORT0_MODE OPT_MODE_DEVICE
 
-#define CFG_TUD_CDC 1
+#define CFG_TUD_CDC 2
 #define CFG_TUD_CDC_RX_BUFSIZE 1024
 #define CFG_TUD_CDC_TX_BUFSIZE 1024
 
+/*! @brief Mass storage view of the connected ESC (esc_msc.c)
+ */
+#ifndef USBLINK_MSC
+#define USBLINK_MSC 0
+#endif
+
+#if USBLINK_MSC
+#define CFG_TUD_MSC 1
+#define CFG_TUD_MSC_EP_BUFSIZE 512
+#endif
+
 #endif /* _TUSB_CONFIG_H_ */
@@ -12,7 +12,12 @@
 #include <string.h>
 #include <tusb.h>
 
+#include "cfg.h"
+#include "esc_line.h"
+#include "sniff.h"
+#include "tlog.h"
 #include "uart_bridge.h"
+#include "usb_descriptors.h"
 #include "user_gpio.h"
 
 #ifdef CYW43_WL_GPIO_LED_PIN
@@ -23,6 +28,10 @@
 #define MIN(a, b) ((a > b) ? b : a)
 #endif /* MIN */
 
+#define UART_ERR_BITS (UART_UARTDR_FE_BITS | UART_UARTDR_PE_BITS | UART_UARTDR_BE_BITS | UART_UARTDR_OE_BITS)
+// buffer space for one received byte
+#define UART_RX_ROOM (UART_ERR_MARK ? 3 : 1)
+
 // prototypes
 void uart0_irq_fn(void);
 
@@ -84,6 +93,13 @@ void update_uart_cfg(void)
 
     mutex_enter_blocking(&ud->lc_mtx);
 
+    // the uart is used by someone else, the host settings are applied on resume
+    if (ud->suspended)
+    {
+        mutex_exit(&ud->lc_mtx);
+        return;
+    }
+
     if (ud->usb_lc.bit_rate != ud->uart_lc.bit_rate)
     {
         uart_set_baudrate(ui->inst, ud->usb_lc.bit_rate);
@@ -120,6 +136,7 @@ void usb_read_bytes(void)
             uint32_t count;
 
             count = tud_cdc_n_read(0, &ud->usb_buffer[ud->usb_pos], len);
+            sniff_chunk(SNIFF_USB_OUT, &ud->usb_buffer[ud->usb_pos], count, 0);
             ud->usb_pos += count;
         }
 
@@ -136,6 +153,7 @@ void usb_write_bytes(void)
         uint32_t count;
 
         count = tud_cdc_n_write(0, ud->uart_buffer, ud->uart_pos);
+        sniff_chunk(SNIFF_USB_IN, ud->uart_buffer, count, 0);
         if (count < ud->uart_pos)
         {
             memmove(ud->uart_buffer, &ud->uart_buffer[count], ud->uart_pos - count);
@@ -144,10 +162,37 @@ void usb_write_bytes(void)
 
         mutex_exit(&ud->uart_mtx);
 
-        if (count)
+        // full packets go out by themselves, a partial one waits for more
+        // data up to flush_us
+        if (count && !ud->flush_us)
         {
             tud_cdc_n_write_flush(0);
         }
+        else if (count && !ud->flush_pending)
+        {
+            ud->flush_pending = true;
+            ud->flush_start = time_us_32();
+        }
+    }
+    if (ud->flush_pending && time_us_32() - ud->flush_start >= ud->flush_us)
+    {
+        ud->flush_pending = false;
+        tud_cdc_n_write_flush(0);
+    }
+}
+
+// uart errors as SERIAL_STATE notification, before the data they came with
+static void usb_send_serial_state(void)
+{
+    uart_data_t *ud = &UART_DATA;
+
+    if (ud->serial_state && mutex_try_enter(&ud->uart_mtx, NULL))
+    {
+        if (usbd_cdc_serial_state(ud->serial_state | CDC_STATE_DCD | CDC_STATE_DSR))
+        {
+            ud->serial_state = 0;
+        }
+        mutex_exit(&ud->uart_mtx);
     }
 }
 
@@ -161,6 +206,7 @@ void usb_cdc_process(void)
     mutex_exit(&ud->lc_mtx);
 
     usb_read_bytes();
+    usb_send_serial_state();
     usb_write_bytes();
 }
 
@@ -192,6 +238,34 @@ inline void dbg_putc_usb(uint8_t data)
     mutex_exit(&ud->uart_mtx);
 }
 
+// count the errors of a received byte, returns its SERIAL_STATE bits
+static inline uint16_t uart_count_errors(uart_data_t *ud, uint32_t dr)
+{
+    uint16_t state = 0;
+
+    if (dr & UART_UARTDR_FE_BITS)
+    {
+        ud->err_count[UART_ERR_FRAMING]++;
+        state |= CDC_STATE_FRAMING;
+    }
+    if (dr & UART_UARTDR_PE_BITS)
+    {
+        ud->err_count[UART_ERR_PARITY]++;
+        state |= CDC_STATE_PARITY;
+    }
+    if (dr & UART_UARTDR_BE_BITS)
+    {
+        ud->err_count[UART_ERR_BREAK]++;
+        state |= CDC_STATE_BREAK;
+    }
+    if (dr & UART_UARTDR_OE_BITS)
+    {
+        ud->err_count[UART_ERR_OVERRUN]++;
+        state |= CDC_STATE_OVERRUN;
+    }
+    return state;
+}
+
 static inline void uart_read_bytes(void)
 {
     uart_data_t *ud = &UART_DATA;
@@ -199,13 +273,36 @@ static inline void uart_read_bytes(void)
 
     if (uart_is_readable(ui->inst))
     {
+        uint32_t start;
+        uint32_t dr;
+        uint8_t err = 0;
+
         mutex_enter_blocking(&ud->uart_mtx);
 
-        while (uart_is_readable(ui->inst) && (ud->uart_pos < BUFFER_SIZE))
+        start = ud->uart_pos;
+        while (uart_is_readable(ui->inst) && (ud->uart_pos + UART_RX_ROOM <= BUFFER_SIZE))
         {
-            ud->uart_buffer[ud->uart_pos] = uart_getc(ui->inst);
+            // data register with the error bits of this byte
+            dr = uart_get_hw(ui->inst)->dr;
+            if (dr & UART_ERR_BITS)
+            {
+                ud->serial_state |= uart_count_errors(ud, dr);
+#if UART_ERR_MARK
+                ud->uart_buffer[ud->uart_pos++] = 0xff;
+                ud->uart_buffer[ud->uart_pos++] = 0x00;
+#endif
+            }
+#if UART_ERR_MARK
+            else if ((dr & UART_UARTDR_DATA_BITS) == 0xff)
+            {
+                ud->uart_buffer[ud->uart_pos++] = 0xff;
+            }
+#endif
+            ud->uart_buffer[ud->uart_pos] = dr & UART_UARTDR_DATA_BITS;
+            err |= dr >> 8;
             ud->uart_pos++;
         }
+        sniff_chunk(SNIFF_UART_RX, &ud->uart_buffer[start], ud->uart_pos - start, err & 0x0f);
 
         mutex_exit(&ud->uart_mtx);
     }
@@ -245,7 +342,7 @@ void uart_write_bytes(void)
 {
     uart_data_t *ud = &UART_DATA;
 
-    if (ud->usb_pos && mutex_try_enter(&ud->usb_mtx, NULL))
+    if (ud->usb_pos && !ud->suspended && mutex_try_enter(&ud->usb_mtx, NULL))
     {
         const uart_id_t *ui = &UART_ID;
         uint32_t count = 0;
@@ -255,6 +352,7 @@ void uart_write_bytes(void)
             uart_putc_raw(ui->inst, ud->usb_buffer[count]);
             count++;
         }
+        sniff_chunk(SNIFF_UART_TX, ud->usb_buffer, count, 0);
 
         if (count < ud->usb_pos)
         {
@@ -287,11 +385,106 @@ void init_uart_hw(void)
                     stopbits_usb2uart(ud->usb_lc.stop_bits),
                     parity_usb2uart(ud->usb_lc.parity));
     uart_set_fifo_enabled(ui->inst, false);
+    ud->flush_us = cfg_get(CFG_BRIDGE_FLUSH_US);
 
     /* UART RX Interrupt */
     irq_set_exclusive_handler(ui->irq, ui->irq_fn);
     irq_set_enabled(ui->irq, true);
     uart_set_irq_enables(ui->inst, true, false);
+
+    esc_line_attach(true);
+}
+
+// hand the uart over to an on-device user (esc bootloader) with 8N1 at bit_rate,
+// the bridge stops forwarding until uart_bridge_resume()
+void uart_bridge_suspend(uint32_t bit_rate)
+{
+    const uart_id_t *ui = &UART_ID;
+    uart_data_t *ud = &UART_DATA;
+
+    mutex_enter_blocking(&ud->lc_mtx);
+    ud->suspended = true;
+    uart_set_irq_enables(ui->inst, false, false);
+    uart_set_baudrate(ui->inst, bit_rate);
+    uart_set_format(ui->inst, 8, 1, UART_PARITY_NONE);
+    // polled without interrupt, the fifo holds the bytes between the loops
+    uart_set_fifo_enabled(ui->inst, true);
+    // invalid settings, update_uart_cfg() restores the host settings after resume
+    ud->uart_lc.bit_rate = 0;
+    ud->uart_lc.data_bits = 0;
+    mutex_exit(&ud->lc_mtx);
+    TLOG(bridge_suspend, bit_rate);
+}
+
+void uart_bridge_resume(void)
+{
+    const uart_id_t *ui = &UART_ID;
+    uart_data_t *ud = &UART_DATA;
+
+    while (uart_is_readable(ui->inst))
+    {
+        uart_getc(ui->inst);
+    }
+    uart_set_fifo_enabled(ui->inst, false);
+    ud->suspended = false;
+    uart_set_irq_enables(ui->inst, true, false);
+    TLOG(bridge_resume);
+}
+
+// tx is fed back to rx inside the uart, the one-wire pins are released so that a
+// connected esc sees no traffic
+void uart_bridge_loopback(bool enable)
+{
+    const uart_id_t *ui = &UART_ID;
+
+    if (enable)
+    {
+        hw_set_bits(&uart_get_hw(ui->inst)->cr, UART_UARTCR_LBE_BITS);
+        gpio_set_function(ui->tx_pin, GPIO_FUNC_NULL);
+        gpio_set_function(ui->rx_pin, GPIO_FUNC_NULL);
+    }
+    else
+    {
+        hw_clear_bits(&uart_get_hw(ui->inst)->cr, UART_UARTCR_LBE_BITS);
+        gpio_set_function(ui->tx_pin, GPIO_FUNC_UART);
+        gpio_set_function(ui->rx_pin, GPIO_FUNC_UART);
+    }
+}
+
+// console closed and nothing buffered; the flash writes of the stores hold core 1 and
+// the interrupts of core 0, the bridge would lose usb and uart data meanwhile
+bool uart_bridge_idle(void)
+{
+    return !tud_cdc_n_connected(0) && UART_DATA.uart_pos == 0 && UART_DATA.usb_pos == 0;
+}
+
+// bytes waiting in the bridge buffers, read without the locks
+void uart_bridge_fill(uint32_t *uart_fill, uint32_t *usb_fill)
+{
+    *uart_fill = UART_DATA.uart_pos;
+    *usb_fill = UART_DATA.usb_pos;
+}
+
+void deinit_uart_hw(void)
+{
+    const uart_id_t *ui = &UART_ID;
+
+    esc_line_attach(false);
+
+    /* UART RX Interrupt */
+    uart_set_irq_enables(ui->inst, false, false);
+    irq_set_enabled(ui->irq, false);
+    irq_remove_handler(ui->irq, ui->irq_fn);
+
+    /* UART stop */
+    uart_deinit(ui->inst);
+
+    // back to plain inputs with default pulls and no inversion
+    gpio_set_outover(ui->tx_pin, GPIO_OVERRIDE_NORMAL);
+    gpio_set_inover(ui->rx_pin, GPIO_OVERRIDE_NORMAL);
+    gpio_set_pulls(ui->rx_pin, false, true);
+    gpio_init(ui->tx_pin);
+    gpio_init(ui->rx_pin);
 }
 
 void init_uart_data(void)
@@ -300,13 +493,13 @@ void init_uart_data(void)
     uart_data_t *ud = &UART_DATA;
 
     /* USB CDC LC */
-    ud->usb_lc.bit_rate = DEF_BIT_RATE;
+    ud->usb_lc.bit_rate = cfg_get(CFG_UART_BAUD);
     ud->usb_lc.data_bits = DEF_DATA_BITS;
     ud->usb_lc.parity = DEF_PARITY;
     ud->usb_lc.stop_bits = DEF_STOP_BITS;
 
     /* UART LC */
-    ud->uart_lc.bit_rate = DEF_BIT_RATE;
+    ud->uart_lc.bit_rate = cfg_get(CFG_UART_BAUD);
     ud->uart_lc.data_bits = DEF_DATA_BITS;
     ud->uart_lc.parity = DEF_PARITY;
     ud->uart_lc.stop_bits = DEF_STOP_BITS;
@@ -314,9 +507,39 @@ void init_uart_data(void)
     /* Buffer */
     ud->uart_pos = 0;
     ud->usb_pos = 0;
+    ud->suspended = false;
+    ud->serial_state = 0;
 
     /* Mutex */
     mutex_init(&ud->lc_mtx);
     mutex_init(&ud->uart_mtx);
     mutex_init(&ud->usb_mtx);
 }
+
+// framing, parity, break and overrun errors (u32 each) since boot or the last clear,
+// clear u8 (optional) resets the counters after reading them
+static uint8_t rpc_bridge_errors(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uart_data_t *ud = &UART_DATA;
+    uint32_t irq;
+
+    if (arg_len > 1)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 4 * UART_ERR_COUNT))
+        return RPC_ERR_NOSPACE;
+    // counted in the uart interrupt of this core
+    irq = save_and_disable_interrupts();
+    for (uint32_t i = 0; i < UART_ERR_COUNT; i++)
+    {
+        rpc_put_u32(&rsp[4 * i], ud->err_count[i]);
+        if (arg_len && arg[0])
+            ud->err_count[i] = 0;
+    }
+    restore_interrupts(irq);
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_bridge_cmds[] = {
+    {RPC_OP_BRIDGE_ERRORS, rpc_bridge_errors},
+};
+const uint32_t rpc_bridge_cmds_count = count_of(rpc_bridge_cmds);
@@ -8,6 +8,8 @@
 
 #include <tusb.h>
 
+#include "rpc.h"
+
 #define BUFFER_SIZE 2560
 
 #define DEF_BIT_RATE 115200
@@ -15,6 +17,29 @@
 #define DEF_PARITY 0
 #define DEF_DATA_BITS 8
 
+/*! @brief Mark bytes received with an error in the console stream like PARMRK:
+ *         0xFF 0x00 byte, a received 0xFF is sent as 0xFF 0xFF. Off by default,
+ *         the esc configurators expect the plain bytes.
+ */
+#ifndef UART_ERR_MARK
+#define UART_ERR_MARK 0
+#endif
+
+// uart error classes, index of the counters
+#define UART_ERR_FRAMING 0
+#define UART_ERR_PARITY 1
+#define UART_ERR_BREAK 2
+#define UART_ERR_OVERRUN 3
+#define UART_ERR_COUNT 4
+
+// cdc SERIAL_STATE bits
+#define CDC_STATE_DCD 0x01
+#define CDC_STATE_DSR 0x02
+#define CDC_STATE_BREAK 0x04
+#define CDC_STATE_FRAMING 0x10
+#define CDC_STATE_PARITY 0x20
+#define CDC_STATE_OVERRUN 0x40
+
 typedef struct
 {
     uart_inst_t *const inst;
@@ -36,15 +61,32 @@ typedef struct
     uint32_t usb_pos;
     mutex_t usb_mtx;
     uint32_t pending_echo_bytes;
+    bool suspended;
+    uint32_t err_count[UART_ERR_COUNT];
+    uint16_t serial_state;// error bits not yet sent to the host, under uart_mtx
+    uint32_t flush_us;    // usb flush policy, CFG_BRIDGE_FLUSH_US
+    bool flush_pending;   // partial packet not flushed since flush_start
+    uint32_t flush_start;
 } uart_data_t;
 
+extern const uart_id_t UART_ID;
+
 void init_uart_data(void);
 void init_uart_hw(void);
+void deinit_uart_hw(void);
 void usb_cdc_process(void);
 void update_uart_cfg(void);
 void uart_write_bytes(void);
+void uart_bridge_suspend(uint32_t bit_rate);
+void uart_bridge_resume(void);
+void uart_bridge_loopback(bool enable);
+void uart_bridge_fill(uint32_t *uart_fill, uint32_t *usb_fill);
+bool uart_bridge_idle(void);
 void dbg_print_usb(uint8_t *msg);
 void dbg_putc_usb(uint8_t data);
 void dbg_read_usb(uint8_t *msg);
 
+extern const rpc_cmd_t rpc_bridge_cmds[];
+extern const uint32_t rpc_bridge_cmds_count;
+
 #endif /* _UART_BRIDGE_H_ */
@@ -3,20 +3,32 @@
  * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
  */
 
-#include <hardware/flash.h>
+#include <device/usbd_pvt.h>
+#include <pico/unique_id.h>
 #include <tusb.h>
 
+#include "usb_descriptors.h"
+
 #define DESC_STR_MAX 20
 
 #define USBD_VID 0x2E8A /* Raspberry Pi */
 #define USBD_PID 0x000A /* Raspberry Pi Pico SDK CDC */
 
+#if USBLINK_MSC
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN * CFG_TUD_CDC + TUD_MSC_DESC_LEN)
+#else
 #define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN * CFG_TUD_CDC)
+#endif
 #define USBD_MAX_POWER_MA 500
 
 #define USBD_ITF_CDC_0 0
 #define USBD_ITF_CDC_1 2
+#define USBD_ITF_MSC 4
+#if USBLINK_MSC
+#define USBD_ITF_MAX 5
+#else
 #define USBD_ITF_MAX 4
+#endif
 
 #define USBD_CDC_0_EP_CMD 0x81
 
@@ -24,8 +36,20 @@
 
 #define USBD_CDC_0_EP_IN 0x82
 
-#define USBD_CDC_CMD_MAX_SIZE 8
+#define USBD_CDC_1_EP_CMD 0x83
+
+#define USBD_CDC_1_EP_OUT 0x03
+
+#define USBD_CDC_1_EP_IN 0x84
+
+#define USBD_MSC_EP_OUT 0x05
+
+#define USBD_MSC_EP_IN 0x85
+
+// a SERIAL_STATE notification in one packet
+#define USBD_CDC_CMD_MAX_SIZE 16
 #define USBD_CDC_IN_OUT_MAX_SIZE 64
+#define USBD_MSC_IN_OUT_MAX_SIZE 64
 
 #define USBD_STR_0 0x00
 #define USBD_STR_MANUF 0x01
@@ -33,6 +57,8 @@
 #define USBD_STR_SERIAL 0x03
 #define USBD_STR_SERIAL_LEN 17
 #define USBD_STR_CDC 0x04
+#define USBD_STR_CDC_RPC 0x05
+#define USBD_STR_MSC 0x06
 
 static const tusb_desc_device_t usbd_desc_device = {
     .bLength = sizeof(tusb_desc_device_t),
@@ -59,6 +85,15 @@ static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
     TUD_CDC_DESCRIPTOR(USBD_ITF_CDC_0, USBD_STR_CDC, USBD_CDC_0_EP_CMD,
                        USBD_CDC_CMD_MAX_SIZE, USBD_CDC_0_EP_OUT,
                        USBD_CDC_0_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+
+    TUD_CDC_DESCRIPTOR(USBD_ITF_CDC_1, USBD_STR_CDC_RPC, USBD_CDC_1_EP_CMD,
+                       USBD_CDC_CMD_MAX_SIZE, USBD_CDC_1_EP_OUT,
+                       USBD_CDC_1_EP_IN, USBD_CDC_IN_OUT_MAX_SIZE),
+
+#if USBLINK_MSC
+    TUD_MSC_DESCRIPTOR(USBD_ITF_MSC, USBD_STR_MSC, USBD_MSC_EP_OUT,
+                       USBD_MSC_EP_IN, USBD_MSC_IN_OUT_MAX_SIZE),
+#endif
 };
 
 static char usbd_serial[USBD_STR_SERIAL_LEN] = "000000000000";
@@ -68,6 +103,8 @@ static const char *const usbd_desc_str[] = {
     [USBD_STR_PRODUCT] = "Pico",
     [USBD_STR_SERIAL] = usbd_serial,
     [USBD_STR_CDC] = "Board CDC",
+    [USBD_STR_CDC_RPC] = "Board RPC",
+    [USBD_STR_MSC] = "Board ESC",
 };
 
 const uint8_t *tud_descriptor_device_cb(void)
@@ -112,13 +149,37 @@ const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid)
     return desc_str;
 }
 
+// the id is read from flash by the sdk before main, no flash access here
 void usbd_serial_init(void)
 {
-    uint8_t id[8];
+    pico_get_unique_board_id_string(usbd_serial, USBD_STR_SERIAL_LEN);
+}
 
-    flash_get_unique_id(id);
+// SERIAL_STATE notification of the console interface on its interrupt endpoint,
+// from the usb task only. The cdc driver does not use that endpoint itself.
+// false if not mounted or the last notification is still being sent
+bool usbd_cdc_serial_state(uint16_t state)
+{
+    static uint8_t notif[10];
 
-    snprintf(usbd_serial, USBD_STR_SERIAL_LEN,
-             "%02X%02X%02X%02X%02X%02X%02X%02X", id[0], id[1], id[2],
-             id[3], id[4], id[5], id[6], id[7]);
+    if (!tud_mounted() || !usbd_edpt_claim(0, USBD_CDC_0_EP_CMD))
+    {
+        return false;
+    }
+    notif[0] = 0xA1;// class request, interface to host
+    notif[1] = CDC_NOTIF_SERIAL_STATE;
+    notif[2] = 0;
+    notif[3] = 0;
+    notif[4] = USBD_ITF_CDC_0;
+    notif[5] = 0;
+    notif[6] = 2;
+    notif[7] = 0;
+    notif[8] = state & 0xff;
+    notif[9] = state >> 8;
+    if (!usbd_edpt_xfer(0, USBD_CDC_0_EP_CMD, notif, sizeof(notif)))
+    {
+        usbd_edpt_release(0, USBD_CDC_0_EP_CMD);
+        return false;
+    }
+    return true;
 }
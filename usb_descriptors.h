@@ -6,6 +6,9 @@
 #if !defined(_USB_DESCRIPTORS_H_)
 #define _USB_DESCRIPTORS_H_
 
+#include <tusb.h>
+
 void usbd_serial_init(void);
+bool usbd_cdc_serial_state(uint16_t state);
 
 #endif /* _USB_DESCRIPTORS_H_ */
@@ -12,6 +12,8 @@
 #include <pico/stdlib.h>
 #include <string.h>
 
+#include "input.h"
+#include "tlog.h"
 #include "uart_bridge.h"
 #include "user_gpio.h"
 
@@ -20,9 +22,9 @@
 #endif
 
 // input variable
-static uint8_t btn[3];
 static uint8_t vusb[3];
-static uint8_t escpwr[3];
+// esc power changes popped from the input queue
+static uint32_t escpwr_changes;
 
 // read usb power
 inline bool get_vusb(void)
@@ -122,22 +124,19 @@ void init_gpio(void)
     set_onboard_led(1);
     // read inputs
     vusb[0] = vusb[1] = vusb[2] = get_vusb();
-    escpwr[0] = escpwr[1] = get_escpower();
-    escpwr[2] = 255;
-    btn[0] = btn[1] = get_button();
-    btn[2] = 255;
+    input_init();
 }
 
-// get state of button 1=presses 0=relesed 255=unknown
+// get state of button 1=pressed 0=released
 uint8_t get_button_state(void)
 {
-    return btn[2];
+    return input_get_level(in_button);
 }
 
-// get state of esc power 1=power-up 0=power-down 255=unknown
+// get state of esc power 1=power-up 0=power-down
 uint8_t get_escpwr_state(void)
 {
-    return escpwr[2];
+    return input_get_level(in_power);
 }
 
 // sleep x times 10ms and feed wathdog
@@ -152,14 +151,13 @@ void sleep_x10ms(uint32_t wait)
     }
 }
 
-// check button at start up to define mode
-uint8_t opmode_select(void)
+// check button at start up to define mode, default_mode is used if not pressed
+uint8_t opmode_select(uint8_t default_mode)
 {
     const uint32_t looptime = 10;
     uint8_t state;
     uint8_t opmode;
     uint8_t bt_evnt;
-    uint8_t print_buf[128];
     uint32_t blink_on, blink_off, blink_cnt, ret_cnt;
 
     set_blue_led(0);
@@ -168,12 +166,12 @@ uint8_t opmode_select(void)
     while (1)
     {// first check until button settled up or down
         watchdog_update();
-        if (get_button() == 1 && get_button() == 1 && get_button() == 1)
+        if (get_button_state() == 0)
         {// button up
-            opmode = opmode_esc;
+            opmode = (default_mode == opmode_undev) ? opmode_esc : default_mode;
             return opmode;
         }
-        else if (get_button() == 0 && get_button() == 0 && get_button() == 0)
+        else
         {//  button down -> selection mode
             set_blue_led(1);
             state = 0;
@@ -183,7 +181,7 @@ uint8_t opmode_select(void)
                 switch (state)
                 {
                     case 0:// wait for button release
-                        if (get_button() == 1 && get_button() == 1 && get_button() == 1)
+                        if (check_button_event() == bt_up)
                         {
                             blink_on = 200 * 1000 / looptime;
                             blink_off = 200 * 1000 / looptime;
@@ -231,6 +229,11 @@ uint8_t opmode_select(void)
                         }
                         else if (bt_evnt == bt_evtup_long)
                         {
+                            if (QUIET_BOOT)
+                            {
+                                set_blue_led(0);
+                                return opmode;
+                            }
                             blink_on = 250 * 1000 / looptime;
                             blink_off = 250 * 1000 / looptime;
                             blink_cnt = 0;
@@ -272,88 +275,51 @@ uint8_t opmode_select(void)
     }
 }
 
-// check esc power gpio
+// check esc power, debounced by the input interrupts
 bool ceck_escpwr(void)
 {
-    if (get_escpower() == 1 && get_escpower() == 1 && get_escpower() == 1)
-    {
-        return 1;
-    }
-    else
-    {
-        return 0;
-    }
+    return get_escpwr_state() == 1;
+}
+
+// number of esc power changes so far, a changed count means that the esc may
+// have been replaced, even if the level was not seen low in between
+uint32_t get_escpwr_changes(void)
+{
+    return escpwr_changes;
 }
 
-// check for button events
+// next button event from the input queue, the button state if there is none;
+// power events are logged and counted on the way
 uint8_t check_button_event(void)
 {
-    static uint8_t state = 0;
-    static uint32_t time_cnt;
-    uint8_t ret;
-    bool button_buf[3];
-    uint8_t button_state;
-
-    button_buf[0] = get_button();
-    button_buf[1] = get_button();
-    button_buf[2] = get_button();
-    if (button_buf[0] == 1 && button_buf[1] == 1 && button_buf[2] == 1)
-        button_state = 0;
-    else if (button_buf[0] == 0 && button_buf[1] == 0 && button_buf[2] == 0)
-        button_state = 1;
-    else
-        button_state = 255;
-
-    switch (state)
+    input_event_t ev;
+
+    while (input_pop(&ev))
     {
-        case 0:// init, wait until not pressed
-            ret = bt_undev;
-            if (button_state == 0)
-            {
-                ret = bt_up;
-                time_cnt = 0;
-                state = 1;
-            }
-            break;
-        case 1:// button not pressed
-            ret = bt_up;
-            if (button_state == 1)
-            {
-                ret = bt_evtdown;
-                state = 2;
-            }
-            break;
-        case 2:// button down event
-            ret = bt_down;
-            state = 3;
-            break;
-        case 3:// button pressed
-            time_cnt++;
-            ret = bt_down;
-            if (button_state == 0)
-            {
-                ret = bt_evtup;
-                if (time_cnt > 150 * 100 && time_cnt < 1000 * 100)
-                {
-                    time_cnt = 0;
-                    ret = bt_evtup_short;
-                }
-                else if (time_cnt > 3000 * 100)
-                {
-                    time_cnt = 0;
-                    ret = bt_evtup_long;
-                }
-                state = 1;
-            }
-            break;
-        default:
-            time_cnt = 0;
-            state = 0;
-            ret = bt_undev;
-            break;
+        switch (ev.type)
+        {
+            case in_button_down:
+                return bt_evtdown;
+            case in_button_up:
+                // a press held since boot has no length
+                if (ev.len_us > BT_SHORT_MIN_MS * 1000 && ev.len_us < BT_SHORT_MAX_MS * 1000)
+                    return bt_evtup_short;
+                if (ev.len_us > BT_LONG_MS * 1000)
+                    return bt_evtup_long;
+                return bt_evtup;
+            case in_power_up:
+                TLOG(esc_power_up, ev.time_us);
+                escpwr_changes++;
+                break;
+            case in_power_down:
+                TLOG(esc_power_down, ev.len_us / 1000);
+                escpwr_changes++;
+                break;
+            default:
+                break;
+        }
     }
-
-    return ret;
+    return get_button_state() ? bt_down : bt_up;
 }
 
 void trigger_reset(void)
@@ -409,7 +375,7 @@ void test_code_opmode(void)
                 else if (bt_evnt == bt_evtup)// button released
                 {
                     state = 1;
-                    dbg_print_usb("goto select mode\n");
+                    TLOG(select_enter);
                 }
                 break;
             case 1:
@@ -420,27 +386,27 @@ void test_code_opmode(void)
                         set_blue_led(0);
                         set_red_led(1);
                         opmode = opmode_rec;
-                        dbg_print_usb("select opmode_rec\n");
+                        TLOG(select_mode, opmode);
                     }
                     else if (opmode == opmode_rec)
                     {
                         set_blue_led(1);
                         set_red_led(1);
                         opmode = opmode_servo;
-                        dbg_print_usb("select opmode_servo\n");
+                        TLOG(select_mode, opmode);
                     }
                     else if (opmode == opmode_servo)
                     {
                         set_blue_led(0);
                         set_red_led(0);
                         opmode = opmode_esc;
-                        dbg_print_usb("select opmode_esc\n");
+                        TLOG(select_mode, opmode);
                     }
                 }
                 else if (bt_evnt == bt_evtup_long)
                 {
                     // return opmode;
-                    dbg_print_usb("return selected opmode\n");
+                    TLOG(select_done);
                 }
                 break;
             default:
@@ -6,6 +6,13 @@
 #if !defined(_USER_GPIO_H_)
 #define _USER_GPIO_H_
 
+/*! @brief Skip the cosmetic led sequences at boot (blink after a watchdog reboot,
+ * confirmation after the mode selection)
+ */
+#ifndef QUIET_BOOT
+#define QUIET_BOOT 0
+#endif
+
 // pin definition
 #define ESC_PWR_PIN 2
 #define SW_PIN 15
@@ -14,6 +21,8 @@
 // pins for receiver and servo mode
 #define RECV_CH1_PIN 13
 #define SERV_CH1_PIN 12
+// receiver input of the signal relay, a free pin of the board
+#define RELAY_IN_PIN 14
 // defines for button_events
 #define bt_undev 0
 #define bt_up 1
@@ -22,11 +31,18 @@
 #define bt_evtup 4
 #define bt_evtup_short 5
 #define bt_evtup_long 6
+// press length of the button events in ms
+#define BT_SHORT_MIN_MS 150
+#define BT_SHORT_MAX_MS 1000
+#define BT_LONG_MS 3000
 // define operating modes
 #define opmode_undev 0
 #define opmode_esc 1
 #define opmode_rec 2
 #define opmode_servo 3
+// rpc only, not in the button selection
+#define opmode_bench 4
+#define opmode_relay 5
 
 void init_gpio(void);
 void set_onboard_led(bool led_on);
@@ -39,8 +55,9 @@ bool get_escpower(void);
 bool get_button(void);
 uint8_t get_button_state(void);
 uint8_t get_escpwr_state(void);
-uint8_t opmode_select(void);
+uint8_t opmode_select(uint8_t default_mode);
 bool ceck_escpwr(void);
+uint32_t get_escpwr_changes(void);
 uint8_t check_button_event(void);
 void trigger_reset(void);
 void sleep_x10ms(uint32_t wait);
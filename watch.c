@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+
+#include <hardware/watchdog.h>
+#include <pico/stdlib.h>
+#include <string.h>
+
+#include "tlog.h"
+#include "uart_bridge.h"
+#include "watch.h"
+
+#define WATCH_MAGIC 0x48435457 /* "WTCH" */
+
+// not cleared at boot, read back after a watchdog reboot
+watch_rec_t __uninitialized_ram(watch_rec);
+
+static watch_rec_t watch_last;
+static bool watch_last_valid;
+static volatile uint32_t watch_last_us[2];
+static const uint32_t watch_deadline_us[2] = {WATCH_DEADLINE0_US, WATCH_DEADLINE1_US};
+
+static uint32_t watch_uptime_ms(const watch_rec_t *r)
+{
+    return (((uint64_t)r->uptime_wraps << 32) | r->uptime_us) / 1000;
+}
+
+// early in main, before core 1 runs
+void watch_init(void)
+{
+    if (watch_rec.magic == WATCH_MAGIC && watchdog_enable_caused_reboot())
+    {
+        watch_last = watch_rec;
+        watch_last_valid = true;
+        TLOG(watch_reset, watch_last.step[0], watch_last.step[1], watch_last.stalled, watch_uptime_ms(&watch_last));
+    }
+    memset(&watch_rec, 0, sizeof(watch_rec));
+    watch_rec.magic = WATCH_MAGIC;
+}
+
+// once per pass of the main loop of a core
+void watch_loop(uint core)
+{
+    uint32_t now = time_us_32();
+    uint32_t dt = now - watch_last_us[core];
+
+    watch_last_us[core] = now;
+    // the first pass only starts the timing
+    if (watch_rec.loops[core]++ != 0)
+    {
+        if (dt > watch_rec.worst_us[core])
+            watch_rec.worst_us[core] = dt;
+        if (dt > watch_deadline_us[core])
+            watch_rec.overruns[core]++;
+    }
+    if (core == 0)
+    {
+        // kept cheap, the ms and the 64 bit time are made when the record is read
+        if (now < watch_rec.uptime_us)
+            watch_rec.uptime_wraps++;
+        watch_rec.uptime_us = now;
+        if ((watch_rec.loops[0] & (WATCH_FILL_PASSES - 1)) == 1)
+        {
+            uint32_t uart_fill, usb_fill;
+
+            uart_bridge_fill(&uart_fill, &usb_fill);
+            watch_rec.uart_fill = uart_fill;
+            watch_rec.usb_fill = usb_fill;
+        }
+        watch_rec.stalled = 0;
+    }
+    else if (watch_rec.loops[0] != 0 && !watch_rec.stalled &&
+             (int32_t)(now - watch_last_us[0]) > WATCH_STALL_US)
+    {
+        // core 0 feeds the watchdog, this is likely the last word before the reset
+        watch_rec.stall_ms = time_us_64() / 1000;
+        watch_rec.stalled = 1;
+    }
+}
+
+void watch_set_mode(uint8_t opmode)
+{
+    watch_rec.opmode = opmode;
+}
+
+// clear u8 (optional) resets worst times and overruns after reading
+// per core: loops u32, worst us u32, overruns u32
+static uint8_t rpc_watch_status(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    uint8_t *p = rsp;
+
+    if (arg_len > 1)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 24))
+        return RPC_ERR_NOSPACE;
+    for (uint32_t core = 0; core < 2; core++)
+    {
+        p = rpc_put_u32(p, watch_rec.loops[core]);
+        p = rpc_put_u32(p, watch_rec.worst_us[core]);
+        p = rpc_put_u32(p, watch_rec.overruns[core]);
+        if (arg_len && arg[0])
+        {
+            watch_rec.worst_us[core] = 0;
+            watch_rec.overruns[core] = 0;
+        }
+    }
+    return RPC_OK;
+}
+
+// record of the run before the last watchdog reboot: valid u8, uptime ms u32,
+// loops, worst us, overruns (u32 per core), step u8 per core, mode u8, stalled u8,
+// stall ms u32, uart fill u16, usb fill u16
+static uint8_t rpc_watch_last(const uint8_t *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{
+    const watch_rec_t *r = &watch_last;
+    uint8_t *p = rsp;
+
+    if (arg_len != 0)
+        return RPC_ERR_ARGS;
+    if (!rpc_room(rsp_len, 41))
+        return RPC_ERR_NOSPACE;
+    *p++ = watch_last_valid;
+    p = rpc_put_u32(p, watch_uptime_ms(r));
+    for (uint32_t core = 0; core < 2; core++)
+    {
+        p = rpc_put_u32(p, r->loops[core]);
+        p = rpc_put_u32(p, r->worst_us[core]);
+        p = rpc_put_u32(p, r->overruns[core]);
+    }
+    *p++ = r->step[0];
+    *p++ = r->step[1];
+    *p++ = r->opmode;
+    *p++ = r->stalled;
+    p = rpc_put_u32(p, r->stall_ms);
+    p = rpc_put_u16(p, r->uart_fill);
+    rpc_put_u16(p, r->usb_fill);
+    return RPC_OK;
+}
+
+const rpc_cmd_t rpc_watch_cmds[] = {
+    {RPC_OP_WATCH_STATUS, rpc_watch_status},
+    {RPC_OP_WATCH_LAST, rpc_watch_last},
+};
+const uint32_t rpc_watch_cmds_count = count_of(rpc_watch_cmds);
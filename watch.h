@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright (c) 2025 Marcus Schuster <ms@nixmail.com>
+ */
+
+#if !defined(_WATCH_H_)
+#define _WATCH_H_
+
+#include <tusb.h>
+
+#include "rpc.h"
+
+/*
+ * Loop monitor and watchdog post-mortem. Both main loops report each pass,
+ * the time of a pass is checked against the deadline of its core and the
+ * worst one is kept. The loops mark the step they are in.
+ *
+ * The counters, steps and bridge buffer levels are kept in a record in ram
+ * that is not initialized at boot, so it survives the watchdog reset. Core 1
+ * notes when core 0 stops passing its loop (the watchdog is fed there).
+ * After a watchdog reboot the record is kept as post-mortem for the host
+ * (rpc, usblink_rpc.py watch) and a log message.
+ */
+
+/*! @brief Deadline of a pass of the core 0 main loop in micro seconds
+ */
+#ifndef WATCH_DEADLINE0_US
+#define WATCH_DEADLINE0_US 5000
+#endif
+
+/*! @brief Deadline of a pass of the core 1 usb loop in micro seconds
+ */
+#ifndef WATCH_DEADLINE1_US
+#define WATCH_DEADLINE1_US 5000
+#endif
+
+/*! @brief Core 0 passes between two updates of the bridge buffer levels, power of 2
+ */
+#ifndef WATCH_FILL_PASSES
+#define WATCH_FILL_PASSES 256
+#endif
+
+/*! @brief Core 0 loop stall noted by core 1 before the watchdog (500ms) resets
+ */
+#ifndef WATCH_STALL_US
+#define WATCH_STALL_US 400000
+#endif
+
+// steps of the loops
+#define watch_st_init 0
+#define watch_st_uart_cfg 1
+#define watch_st_rpc 2
+#define watch_st_la 3
+#define watch_st_mode_switch 4
+#define watch_st_mode_task 5
+#define watch_st_sleep 6
+#define watch_st_reset 7
+#define watch_st_usb 8
+#define watch_st_cdc 9
+#define watch_st_rpc_usb 10
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t uptime_us;   // at the last pass of core 0, time_us_32()
+    uint32_t uptime_wraps;// of uptime_us
+    uint32_t loops[2];
+    uint32_t worst_us[2];
+    uint32_t overruns[2];
+    uint8_t step[2];
+    uint8_t opmode;
+    uint8_t stalled;      // core 1 saw core 0 stop
+    uint32_t stall_ms;    // uptime when core 0 was seen stalled
+    uint16_t uart_fill;   // bridge buffers, uart to usb
+    uint16_t usb_fill;    // usb to uart
+} watch_rec_t;
+
+extern watch_rec_t watch_rec;
+
+// step of the loop of a core
+static inline void watch_step(uint core, uint8_t step)
+{
+    watch_rec.step[core] = step;
+}
+
+void watch_init(void);
+void watch_loop(uint core);
+void watch_set_mode(uint8_t opmode);
+
+extern const rpc_cmd_t rpc_watch_cmds[];
+extern const uint32_t rpc_watch_cmds_count;
+
+#endif /* _WATCH_H_ */